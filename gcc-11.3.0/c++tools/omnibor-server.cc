@@ -0,0 +1,913 @@
+/* OmniBOR gitoid server.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+   This file is part of GCC.
+
+   GCC is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GCC is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GCC; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/* Compilations with -frecord-omnibor hash every file they read.  In a
+   parallel build they all start with an empty persistent gitoid cache,
+   so each of them hashes the same system headers.  This server runs for
+   the duration of the build, listening on a local socket in the OmniBOR
+   directory; the compilations ask it for the gitoids of the files they
+   read, and it keeps the gitoids in memory.  The protocol is described
+   in libcpp/include/omnibor-server.h.
+
+   Requests are answered one at a time from the table of gitoids, which
+   takes no time, so that no compilation waits for another one's file to
+   be hashed.  The files which are not in the table yet are hashed by
+   worker threads, each one once, while the compilations which asked for
+   them hash them too.  The table only holds the gitoids calculated
+   here, so that no client can have wrong ones given to the others.  */
+
+#include "config.h"
+
+// C++
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+// C
+#include <csignal>
+#include <cstring>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+// OS
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+#ifdef HAVE_AF_UNIX
+/* socket, bind, listen, accept, recvmsg, sockaddr_un  */
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+#if defined (HAVE_PSELECT) || defined (HAVE_SELECT)
+/* pselect or select  */
+#include <sys/select.h>
+#endif
+
+#include <getopt.h>
+
+// GCC
+#include "version.h"
+#include "ansidecl.h"
+#define HAVE_DECL_BASENAME 1 /* See comment in gcc/configure.ac.  */
+#include "libiberty.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "omnibor-server.h"
+
+#if defined (HAVE_AF_UNIX) && defined (SCM_RIGHTS) \
+  && (defined (HAVE_PSELECT) || defined (HAVE_SELECT)) \
+  && defined (HAVE_PTHREAD_H)
+#define SERVING 1
+#endif
+
+#if !HOST_HAS_O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#ifndef IS_DIR_SEPARATOR
+#define IS_DIR_SEPARATOR(C) ((C) == '/')
+#endif
+
+const char *progname;
+
+/* Speak thoughts out loud.  */
+static bool flag_noisy = false;
+
+/* Detach from the terminal once listening.  */
+static bool flag_daemon = false;
+
+/* Exit after this many seconds without a connection or request, if
+   nonzero.  */
+static unsigned long flag_idle = 0;
+
+/* The number of threads hashing files, or zero for one per processor.  */
+static unsigned long flag_threads = 0;
+
+/* A fatal error of some kind.  */
+
+static void ATTRIBUTE_NORETURN ATTRIBUTE_COLD ATTRIBUTE_PRINTF_1
+error (const char *msg, ...)
+{
+  fprintf (stderr, "%s:error: ", progname);
+  va_list args;
+
+  va_start (args, msg);
+  vfprintf (stderr, msg, args);
+  va_end (args);
+  fprintf (stderr, "\n");
+
+  exit (1);
+}
+
+/* Progress messages to the user.  */
+
+static bool ATTRIBUTE_PRINTF_1 ATTRIBUTE_COLD
+noisy (const char *fmt, ...)
+{
+  fprintf (stderr, "%s:", progname);
+  va_list args;
+  va_start (args, fmt);
+  vfprintf (stderr, fmt, args);
+  va_end (args);
+  fprintf (stderr, "\n");
+
+  return false;
+}
+
+/* More messages to the user.  */
+
+static void ATTRIBUTE_PRINTF_2
+fnotice (FILE *file, const char *fmt, ...)
+{
+  va_list args;
+
+  va_start (args, fmt);
+  vfprintf (file, fmt, args);
+  va_end (args);
+}
+
+static void ATTRIBUTE_NORETURN
+print_usage (int error_p)
+{
+  FILE *file = error_p ? stderr : stdout;
+  int status = error_p ? 1 : 0;
+
+  fnotice (file, "Usage: %s [OPTION...] [DIRECTORY]\n\n", progname);
+  fnotice (file, "OmniBOR gitoid server for the OmniBOR directory DIRECTORY\n"
+	   "(by default $OMNIBOR_DIR).\n\n");
+  fnotice (file, "  -d, --daemon     Run in the background once listening\n");
+  fnotice (file, "  -h, --help       Print this help, then exit\n");
+  fnotice (file, "  -i, --idle SECS  Exit after SECS seconds without"
+	   " requests\n");
+  fnotice (file, "  -n, --noisy      Print progress messages\n");
+  fnotice (file, "  -t, --threads N  Hash files on N threads (by default"
+	   " one per processor)\n");
+  fnotice (file, "  -v, --version    Print version number, then exit\n");
+  fnotice (file, "Send SIGTERM(%d) to terminate\n", SIGTERM);
+  fnotice (file, "\nFor bug reporting instructions, please see:\n%s.\n",
+	   bug_report_url);
+  exit (status);
+}
+
+/* Print version information and exit.  */
+
+static void ATTRIBUTE_NORETURN
+print_version (void)
+{
+  fnotice (stdout, "%s %s%s\n", progname, pkgversion_string, version_string);
+  fprintf (stdout, "Copyright %s 2022 Free Software Foundation, Inc.\n",
+	   ("(C)"));
+  fnotice (stdout,
+	   ("This is free software; see the source for copying conditions.\n"
+	    "There is NO warranty; not even for MERCHANTABILITY or \n"
+	    "FITNESS FOR A PARTICULAR PURPOSE.\n\n"));
+  exit (0);
+}
+
+/* Process args, return index to first non-arg.  */
+
+static int
+process_args (int argc, char **argv)
+{
+  static const struct option options[] =
+    {
+     { "daemon", no_argument,	NULL, 'd' },
+     { "help",	no_argument,	NULL, 'h' },
+     { "idle",	required_argument, NULL, 'i' },
+     { "noisy",	no_argument,	NULL, 'n' },
+     { "threads", required_argument, NULL, 't' },
+     { "version", no_argument,	NULL, 'v' },
+     { 0, 0, 0, 0 }
+    };
+  int opt;
+  const char *opts = "dhi:nt:v";
+  while ((opt = getopt_long (argc, argv, opts, options, NULL)) != -1)
+    {
+      switch (opt)
+	{
+	case 'd':
+	  flag_daemon = true;
+	  break;
+	case 'h':
+	  print_usage (false);
+	  /* print_usage will exit.  */
+	case 'i':
+	  {
+	    char *endp;
+	    flag_idle = strtoul (optarg, &endp, 10);
+	    if (endp == optarg || *endp)
+	      error ("invalid idle time '%s'", optarg);
+	  }
+	  break;
+	case 'n':
+	  flag_noisy = true;
+	  break;
+	case 't':
+	  {
+	    char *endp;
+	    flag_threads = strtoul (optarg, &endp, 10);
+	    if (endp == optarg || *endp || !flag_threads)
+	      error ("invalid number of threads '%s'", optarg);
+	  }
+	  break;
+	case 'v':
+	  print_version ();
+	  /* print_version will exit.  */
+	default:
+	  print_usage (true);
+	  /* print_usage will exit.  */
+	}
+    }
+
+  return optind;
+}
+
+#if SERVING
+
+/* The identity of a file, as in the requests.  */
+
+struct file_id
+{
+  uint64_t dev, ino, size;
+  int64_t mtime, ctime;
+
+  file_id (const omnibor_server_request &r)
+    : dev (r.dev), ino (r.ino), size (r.size),
+      mtime (r.mtime), ctime (r.ctime)
+  {
+  }
+  file_id (const struct stat &st)
+    : dev (st.st_dev), ino (st.st_ino), size (st.st_size),
+      mtime (st.st_mtime), ctime (st.st_ctime)
+  {
+  }
+
+  bool operator== (const file_id &b) const
+  {
+    return (dev == b.dev && ino == b.ino && size == b.size
+	    && mtime == b.mtime && ctime == b.ctime);
+  }
+  bool operator< (const file_id &b) const
+  {
+    if (dev != b.dev)
+      return dev < b.dev;
+    if (ino != b.ino)
+      return ino < b.ino;
+    if (size != b.size)
+      return size < b.size;
+    if (mtime != b.mtime)
+      return mtime < b.mtime;
+    return ctime < b.ctime;
+  }
+};
+
+struct gitoids
+{
+  unsigned char sha1[20];
+  unsigned char sha256[32];
+};
+
+/* The gitoids of every file hashed so far.  */
+static std::map<file_id, gitoids> gitoid_map;
+
+/* Statistics for the noisy.  */
+static unsigned long num_requests, num_unknown, num_hashed;
+
+/* A client, and the part of its current request received so far.  */
+
+struct client
+{
+  int fd;
+  size_t got;
+  omnibor_server_request request;
+
+  /* The descriptor which came with the request, or -1.  */
+  int file_fd;
+};
+
+/* We increment this to tell the server to shut down.  */
+static volatile int term = false;
+
+/* A terminate signal.  Shutdown gracefully.  */
+
+static void
+term_signal (int sig)
+{
+  signal (sig, term_signal);
+  term = term + 1;
+}
+
+/* Return true if the file with identity ID was modified within the
+   last second; see omnibor_racily_clean in libcpp.  */
+
+static bool
+racily_clean (const file_id &id)
+{
+  time_t now = time (NULL);
+  return id.mtime >= now - 1 || id.ctime >= now - 1;
+}
+
+/* Calculate the SHA1 and SHA256 gitoids of the SIZE bytes of the file
+   open on FD into G, as libcpp does.  The file is read with pread, so
+   that the offset which the client shares with us is left alone.  Return
+   false if the file does not hold exactly SIZE bytes.  */
+
+static bool
+hash_file (int fd, uint64_t size, gitoids *g)
+{
+  struct sha1_ctx ctx_sha1;
+  struct sha256_ctx ctx_sha256;
+  char header[32];
+  int len = snprintf (header, sizeof (header), "blob %lu",
+		      (unsigned long) size);
+
+  sha1_init_ctx (&ctx_sha1);
+  sha256_init_ctx (&ctx_sha256);
+  sha1_process_bytes (header, len + 1, &ctx_sha1);
+  sha256_process_bytes (header, len + 1, &ctx_sha256);
+
+  std::vector<char> chunk (64 * 1024);
+  uint64_t total = 0;
+
+  /* Read one byte beyond SIZE, to notice a file which has grown.  */
+  while (total <= size)
+    {
+      uint64_t want = size - total + 1;
+      ssize_t count = pread (fd, chunk.data (),
+			     want < chunk.size () ? want : chunk.size (),
+			     total);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	break;
+      total += count;
+      if (total > size)
+	break;
+      sha1_process_bytes (chunk.data (), count, &ctx_sha1);
+      sha256_process_bytes (chunk.data (), count, &ctx_sha256);
+    }
+
+  if (total != size)
+    return false;
+
+  sha1_finish_ctx (&ctx_sha1, g->sha1);
+  sha256_finish_ctx (&ctx_sha256, g->sha256);
+  return true;
+}
+
+/* The most files waiting for a worker thread.  Each of them holds a
+   descriptor, so that they must leave room for the clients below
+   FD_SETSIZE.  */
+#define MAX_QUEUED 256
+
+/* A file to hash, with identity ID and open on FD.  */
+
+struct hash_job
+{
+  file_id id;
+  int fd;
+};
+
+/* TABLE_LOCK protects gitoid_map, the statistics and the work of the
+   threads hashing files.  */
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static std::vector<pthread_t> workers;
+static std::deque<hash_job> job_queue;
+
+/* The files queued or being hashed, which are not queued again.  */
+static std::set<file_id> pending;
+
+/* Set to tell the worker threads to exit.  */
+static bool stopping;
+
+static void
+lock_table (void)
+{
+  pthread_mutex_lock (&table_lock);
+}
+
+static void
+unlock_table (void)
+{
+  pthread_mutex_unlock (&table_lock);
+}
+
+/* A worker thread: hash the queued files, and add their gitoids to the
+   table.  */
+
+static void *
+worker (void *)
+{
+  lock_table ();
+  for (;;)
+    {
+      while (job_queue.empty () && !stopping)
+	pthread_cond_wait (&work_cond, &table_lock);
+      if (stopping)
+	break;
+
+      hash_job job = job_queue.front ();
+      job_queue.pop_front ();
+      bool known = gitoid_map.count (job.id) != 0;
+      unlock_table ();
+
+      /* The file must not have changed while it was hashed.  */
+      gitoids g;
+      struct stat st;
+      bool ok = (!known && hash_file (job.fd, job.id.size, &g)
+		 && fstat (job.fd, &st) == 0 && file_id (st) == job.id);
+      close (job.fd);
+
+      lock_table ();
+      if (ok && gitoid_map.insert (std::make_pair (job.id, g)).second)
+	num_hashed++;
+      pending.erase (job.id);
+    }
+  unlock_table ();
+
+  return NULL;
+}
+
+/* Start the worker threads.  They do not take the terminate signals,
+   which are for the thread serving the clients.  */
+
+static void
+start_workers (void)
+{
+  unsigned long num = flag_threads;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (!num)
+    {
+      long nprocs = sysconf (_SC_NPROCESSORS_ONLN);
+      num = nprocs > 0 ? nprocs : 1;
+    }
+#endif
+  if (!num)
+    num = 1;
+
+  sigset_t block, mask;
+  sigemptyset (&block);
+  sigaddset (&block, SIGTERM);
+  sigaddset (&block, SIGINT);
+  sigaddset (&block, SIGHUP);
+  pthread_sigmask (SIG_BLOCK, &block, &mask);
+
+  for (unsigned long ix = 0; ix != num; ix++)
+    {
+      pthread_t thread;
+      if (pthread_create (&thread, NULL, worker, NULL) != 0)
+	break;
+      workers.push_back (thread);
+    }
+
+  pthread_sigmask (SIG_SETMASK, &mask, NULL);
+  flag_noisy && noisy ("Hashing files on %lu threads",
+		       (unsigned long) workers.size ());
+}
+
+/* Stop the worker threads, dropping the files not hashed yet.  */
+
+static void
+stop_workers (void)
+{
+  lock_table ();
+  stopping = true;
+  for (auto iter = job_queue.begin (); iter != job_queue.end (); ++iter)
+    close (iter->fd);
+  job_queue.clear ();
+  pthread_cond_broadcast (&work_cond);
+  unlock_table ();
+
+  for (auto iter = workers.begin (); iter != workers.end (); ++iter)
+    pthread_join (*iter, NULL);
+  workers.clear ();
+}
+
+/* Queue the file with identity ID, which came with the request of
+   client C, to be hashed by a worker thread, if there is room and it is
+   not queued already.  The caller holds TABLE_LOCK.  */
+
+static void
+queue_file (const file_id &id, client &c)
+{
+  if (workers.empty () || job_queue.size () >= MAX_QUEUED
+      || !pending.insert (id).second)
+    return;
+
+  hash_job job = { id, c.file_fd };
+  job_queue.push_back (job);
+  c.file_fd = -1;
+  pthread_cond_signal (&work_cond);
+}
+
+/* Answer the request of client C, whose file descriptor, if any, came
+   with it, from the table of gitoids.  If the file is not there, it is
+   handed to the worker threads.  */
+
+static enum omnibor_server_status
+answer (client &c, omnibor_server_reply &reply)
+{
+  struct stat st;
+
+  if (c.file_fd < 0 || fstat (c.file_fd, &st) != 0 || !S_ISREG (st.st_mode))
+    return OMNIBOR_SERVER_ERROR;
+
+  /* The file must be the one which the client read, and must not be
+     racily clean; see omnibor_cache_insert in libcpp.  */
+  file_id id (st);
+  if (!(id == file_id (c.request)) || racily_clean (id))
+    return OMNIBOR_SERVER_CHANGED;
+
+  enum omnibor_server_status status = OMNIBOR_SERVER_OK;
+  lock_table ();
+  auto iter = gitoid_map.find (id);
+  if (iter != gitoid_map.end ())
+    {
+      memcpy (reply.sha1, iter->second.sha1, sizeof (reply.sha1));
+      memcpy (reply.sha256, iter->second.sha256, sizeof (reply.sha256));
+    }
+  else
+    {
+      status = OMNIBOR_SERVER_UNKNOWN;
+      num_unknown++;
+      queue_file (id, c);
+    }
+  unlock_table ();
+
+  return status;
+}
+
+/* Read what client C sent, and answer its request once it is complete.
+   Return false if the connection is to be closed.  The socket of C does
+   not block, so that a client which does not take its reply at once is
+   dropped rather than holding up the others.  */
+
+static bool
+process_client (client &c)
+{
+  struct iovec iov;
+  iov.iov_base = (char *) &c.request + c.got;
+  iov.iov_len = sizeof (c.request) - c.got;
+
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int) * 4)];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr msg;
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  ssize_t count = recvmsg (c.fd, &msg, 0);
+  if (count < 0 && (errno == EINTR || errno == EAGAIN
+		    || errno == EWOULDBLOCK))
+    return true;
+
+  /* Take every descriptor which came along, keeping the first.  */
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg); cmsg;
+       cmsg = CMSG_NXTHDR (&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+	unsigned num = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+	for (unsigned ix = 0; ix != num; ix++)
+	  {
+	    int fd;
+	    memcpy (&fd, CMSG_DATA (cmsg) + ix * sizeof (int), sizeof (int));
+	    if (c.file_fd < 0)
+	      c.file_fd = fd;
+	    else
+	      close (fd);
+	  }
+      }
+
+  if (count <= 0)
+    return false;
+
+  c.got += count;
+  if (c.got != sizeof (c.request))
+    return true;
+
+  if (c.request.magic != OMNIBOR_SERVER_MAGIC)
+    {
+      flag_noisy && noisy ("Dropping client speaking another protocol");
+      return false;
+    }
+
+  if (c.request.kind != OMNIBOR_SERVER_LOOKUP)
+    {
+      flag_noisy && noisy ("Dropping client with unknown request %u",
+			   (unsigned) c.request.kind);
+      return false;
+    }
+
+  omnibor_server_reply reply;
+  memset (&reply, 0, sizeof (reply));
+  reply.magic = OMNIBOR_SERVER_MAGIC;
+  reply.status = answer (c, reply);
+  num_requests++;
+
+  if (c.file_fd >= 0)
+    close (c.file_fd);
+  c.file_fd = -1;
+  c.got = 0;
+
+  size_t sent = 0;
+  while (sent != sizeof (reply))
+    {
+      count = write (c.fd, (const char *) &reply + sent,
+		     sizeof (reply) - sent);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	return false;
+      sent += count;
+    }
+
+  return true;
+}
+
+/* Close the connection of client C.  */
+
+static void
+close_client (client &c)
+{
+  if (c.file_fd >= 0)
+    close (c.file_fd);
+  close (c.fd);
+}
+
+/* Bind a socket to PATH and listen on it.  A socket left behind by a
+   server which is gone is replaced.  Only the user who runs the server
+   may connect to it.  */
+
+static int
+listen_local (const std::string &path)
+{
+  sockaddr_un addr;
+
+  if (path.size () >= sizeof (addr.sun_path))
+    error ("socket name '%s' is too long", path.c_str ());
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  memcpy (addr.sun_path, path.c_str (), path.size ());
+
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    error ("cannot create socket: %s", xstrerror (errno));
+
+  mode_t mask = umask (0077);
+  if (bind (fd, (sockaddr *) &addr, sizeof (addr)) != 0)
+    {
+      if (errno != EADDRINUSE)
+	error ("cannot bind '%s': %s", path.c_str (), xstrerror (errno));
+
+      int probe = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (probe >= 0
+	  && connect (probe, (sockaddr *) &addr, sizeof (addr)) == 0)
+	error ("a server is already listening on '%s'", path.c_str ());
+      if (probe >= 0)
+	close (probe);
+
+      flag_noisy && noisy ("Replacing stale socket '%s'", path.c_str ());
+      unlink (path.c_str ());
+      if (bind (fd, (sockaddr *) &addr, sizeof (addr)) != 0)
+	error ("cannot bind '%s': %s", path.c_str (), xstrerror (errno));
+    }
+  umask (mask);
+
+  if (listen (fd, SOMAXCONN) != 0)
+    error ("cannot listen on '%s': %s", path.c_str (), xstrerror (errno));
+
+  return fd;
+}
+
+/* Detach from the terminal and the parent process, which exits.  */
+
+static void
+daemonize (void)
+{
+  fflush (stderr);
+  pid_t pid = fork ();
+  if (pid < 0)
+    error ("cannot fork: %s", xstrerror (errno));
+  if (pid > 0)
+    {
+      flag_noisy && noisy ("Serving as process %ld", (long) pid);
+      _exit (0);
+    }
+
+  setsid ();
+  int null_fd = open ("/dev/null", O_RDWR | O_CLOEXEC);
+  if (null_fd >= 0)
+    {
+      dup2 (null_fd, 0);
+      dup2 (null_fd, 1);
+      if (!flag_noisy)
+	dup2 (null_fd, 2);
+      if (null_fd > 2)
+	close (null_fd);
+    }
+}
+
+/* A server listening on bound socket SOCK_FD.  */
+
+static void
+server (int sock_fd)
+{
+  signal (SIGTERM, term_signal);
+  signal (SIGINT, term_signal);
+  signal (SIGHUP, term_signal);
+
+#ifdef HAVE_PSELECT
+  sigset_t mask;
+  {
+    sigset_t block;
+    sigemptyset (&block);
+    sigaddset (&block, SIGTERM);
+    sigaddset (&block, SIGINT);
+    sigaddset (&block, SIGHUP);
+    sigprocmask (SIG_BLOCK, &block, &mask);
+  }
+#endif
+
+  start_workers ();
+
+  std::vector<client> clients;
+  time_t last_activity = time (NULL);
+  while (!term)
+    {
+      fd_set readers;
+      FD_ZERO (&readers);
+      FD_SET (sock_fd, &readers);
+      int limit = sock_fd + 1;
+      for (auto iter = clients.begin (); iter != clients.end (); ++iter)
+	{
+	  FD_SET (iter->fd, &readers);
+	  if (iter->fd >= limit)
+	    limit = iter->fd + 1;
+	}
+
+      /* Wait for one or more events, or for the idle time to pass.  */
+      time_t left = 0;
+      if (flag_idle)
+	{
+	  left = last_activity + flag_idle - time (NULL);
+	  if (left <= 0)
+	    {
+	      flag_noisy && noisy ("Idle for %lu seconds", flag_idle);
+	      break;
+	    }
+	}
+
+#ifdef HAVE_PSELECT
+      struct timespec timeout;
+      timeout.tv_sec = left;
+      timeout.tv_nsec = 0;
+      int event_count = pselect (limit, &readers, NULL, NULL,
+				 flag_idle ? &timeout : NULL, &mask);
+#else
+      struct timeval timeout;
+      timeout.tv_sec = left;
+      timeout.tv_usec = 0;
+      int event_count = select (limit, &readers, NULL, NULL,
+				flag_idle ? &timeout : NULL);
+#endif
+      if (event_count < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error ("cannot %s: %s",
+#ifdef HAVE_PSELECT
+		 "pselect",
+#else
+		 "select",
+#endif
+		 xstrerror (errno));
+	}
+      if (event_count == 0)
+	continue;
+
+      last_activity = time (NULL);
+
+      for (size_t ix = 0; ix != clients.size ();)
+	if (FD_ISSET (clients[ix].fd, &readers)
+	    && !process_client (clients[ix]))
+	  {
+	    close_client (clients[ix]);
+	    clients[ix] = clients.back ();
+	    clients.pop_back ();
+	  }
+	else
+	  ix++;
+
+      if (FD_ISSET (sock_fd, &readers))
+	{
+	  int fd = accept (sock_fd, NULL, NULL);
+	  if (fd < 0)
+	    {
+	      if (errno != EINTR && errno != ECONNABORTED)
+		error ("cannot accept: %s", xstrerror (errno));
+	    }
+	  else if (fd >= FD_SETSIZE)
+	    /* The client hashes its files itself.  */
+	    close (fd);
+	  else
+	    {
+	      fcntl (fd, F_SETFD, FD_CLOEXEC);
+	      fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	      client c;
+	      c.fd = fd;
+	      c.got = 0;
+	      c.file_fd = -1;
+	      clients.push_back (c);
+	    }
+	}
+    }
+
+#ifdef HAVE_PSELECT
+  /* Restore the signal mask.  */
+  sigprocmask (SIG_SETMASK, &mask, NULL);
+#endif
+
+  for (auto iter = clients.begin (); iter != clients.end (); ++iter)
+    close_client (*iter);
+  close (sock_fd);
+
+  stop_workers ();
+}
+
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  const char *p = argv[0] + strlen (argv[0]);
+  while (p != argv[0] && !IS_DIR_SEPARATOR (p[-1]))
+    --p;
+  progname = p;
+
+#ifdef SIGPIPE
+  /* Ignore sigpipe, so read/write get an error.  */
+  signal (SIGPIPE, SIG_IGN);
+#endif
+
+  int argno = process_args (argc, argv);
+
+  const char *dir = getenv ("OMNIBOR_DIR");
+  if (argno != argc)
+    dir = argv[argno++];
+  if (argno != argc || !dir || !*dir)
+    print_usage (true);
+
+#if SERVING
+  /* The OmniBOR directory may not have been created yet by the
+     compilations.  */
+  if (mkdir (dir, 0777) != 0 && errno != EEXIST)
+    error ("cannot create '%s': %s", dir, xstrerror (errno));
+
+  std::string path = std::string (dir) + "/" OMNIBOR_SERVER_SOCKET;
+  int sock_fd = listen_local (path);
+  flag_noisy && noisy ("Listening on '%s'", path.c_str ());
+
+  if (flag_daemon)
+    daemonize ();
+
+  server (sock_fd);
+  unlink (path.c_str ());
+
+  flag_noisy && noisy ("%lu requests, %lu unknown, %lu files hashed",
+		       num_requests, num_unknown, num_hashed);
+#else
+  error ("local sockets or threads are not supported on this host");
+#endif
+
+  return 0;
+}
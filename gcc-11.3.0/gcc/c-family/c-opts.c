@@ -41,7 +41,6 @@ along with GCC; see the file COPYING3.  If not see
 #include "mkdeps.h"
 #include "dumpfile.h"
 #include "file-prefix-map.h"    /* add_*_prefix_map()  */
-#include "omnibor.h"
 
 #ifndef DOLLARS_IN_IDENTIFIERS
 # define DOLLARS_IN_IDENTIFIERS true
@@ -531,6 +530,14 @@ c_common_handle_option (size_t scode, const char *arg, HOST_WIDE_INT value,
       cpp_opts->input_charset = arg;
       break;
 
+    case OPT_finclude_dir_cache_:
+      cpp_opts->include_dir_cache = arg;
+      break;
+
+    case OPT_finclude_guard_cache_:
+      cpp_opts->include_guard_cache = arg;
+      break;
+
     case OPT_ftemplate_depth_:
       max_tinst_depth = value;
       break;
@@ -1254,6 +1261,15 @@ get_dump_info (int phase, dump_flags_t *flags)
   return original_dump_file;
 }
 
+/* Return the deps buffer of the preprocessor, which lists the files the
+   front end read, for the OmniBOR Document files.  */
+
+class mkdeps *
+c_common_omnibor_deps (void)
+{
+  return cpp_get_deps (parse_in);
+}
+
 /* Common finish hook for the C, ObjC and C++ front ends.  */
 void
 c_common_finish (void)
@@ -1281,49 +1297,36 @@ c_common_finish (void)
 	}
     }
 
-  /* If the calculation of the OmniBOR information is enabled, do it here.
-     Also, determine the directory to store the OmniBOR files in this order of
-     precedence.
-	1. Use the directory name passed with -frecord-omnibor= option.
-	2. Use the location set in OMNIBOR_DIR environment variable.  */
-  if (str_record_omnibor
-      || (getenv ("OMNIBOR_DIR") && strlen (getenv ("OMNIBOR_DIR")) > 0))
-    {
-      std::string omnibor_dir = "";
+  /* For performance, avoid tearing down cpplib's internal structures
+     with cpp_destroy ().  */
+  cpp_finish (parse_in, deps_stream);
 
-      if (str_record_omnibor)
-	omnibor_dir = str_record_omnibor;
-      if (omnibor_dir == "")
+  /* Tell the driver what else the result depends on.  It does not store
+     the result in the OmniBOR cache without the file, so the file is
+     removed rather than left incomplete.  */
+  if (str_omnibor_cache_probes)
+    {
+      FILE *probes = fopen (str_omnibor_cache_probes, "a");
+      if (probes != NULL)
 	{
-	  const char *env_omnibor = getenv ("OMNIBOR_DIR");
-	  if (env_omnibor != NULL)
-	    omnibor_dir = env_omnibor;
+	  cpp_write_include_probes (parse_in, probes);
+	  if (ferror (probes) | fclose (probes))
+	    remove (str_omnibor_cache_probes);
 	}
-
-      std::string gitoid_sha1 = "", gitoid_sha256 = "";
-      if (omnibor_dir.length () > 0)
-        {
-          gitoid_sha1 =
-		deps_write_sha1_omnibor (parse_in, omnibor_dir.c_str());
-          gitoid_sha256 =
-		deps_write_sha256_omnibor (parse_in, omnibor_dir.c_str());
-        }
-      /* This else should be unreachable.  */
-      else
-        {
-	  gitoid_sha1 = "";
-	  gitoid_sha256 = "";
-        }
-      if (gitoid_sha1 != "" && gitoid_sha256 != "")
-	elf_record_omnibor_write_gitoid (gitoid_sha1, gitoid_sha256);
-      else
-	fatal_error (input_location,
-		     "Error in creation of OmniBOR Document files");
     }
 
-  /* For performance, avoid tearing down cpplib's internal structures
-     with cpp_destroy ().  */
-  cpp_finish (parse_in, deps_stream);
+  if (time_report
+      && (cpp_opts->include_dir_cache || cpp_opts->include_guard_cache))
+    {
+      struct cpp_include_cache_stats stats;
+      cpp_get_include_cache_stats (parse_in, &stats);
+      if (cpp_opts->include_dir_cache)
+	fprintf (stderr, "include directory cache: %u lookups avoided\n",
+		 stats.dir_lookups_avoided);
+      if (cpp_opts->include_guard_cache)
+	fprintf (stderr, "include guard cache: %u headers not read\n",
+		 stats.headers_not_read);
+    }
 
   if (deps_stream && deps_stream != out_stream && deps_stream != stdout
       && (ferror (deps_stream) || fclose (deps_stream)))
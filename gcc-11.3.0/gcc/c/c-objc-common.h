@@ -28,6 +28,8 @@ along with GCC; see the file COPYING3.  If not see
 #define LANG_HOOKS_IDENTIFIER_SIZE C_SIZEOF_STRUCT_LANG_IDENTIFIER
 #undef LANG_HOOKS_FINISH
 #define LANG_HOOKS_FINISH c_common_finish
+#undef LANG_HOOKS_OMNIBOR_DEPS
+#define LANG_HOOKS_OMNIBOR_DEPS c_common_omnibor_deps
 #undef LANG_HOOKS_OPTION_LANG_MASK
 #define LANG_HOOKS_OPTION_LANG_MASK c_common_option_lang_mask
 #undef LANG_HOOKS_COMPLAIN_WRONG_LANG_P
@@ -51,6 +51,7 @@ along with GCC; see the file COPYING3.  If not see
 #include "obstack.h"
 #include "intl.h"
 #include "version.h"
+#include "mkdeps.h"
 
 /* On certain systems, we have code that works by scanning the object file
    directly.  But this code uses system-specific header files and library
@@ -283,6 +284,18 @@ struct lto_object_list
 
 static struct lto_object_list lto_objects;
 
+/* When the OmniBOR information is recorded, the OmniBOR Document files of
+   the output file list the input files of the link, with the gitoids of
+   their own Document files from their .note.omnibor sections, and the
+   LTRANS units which replace the LTO IR of some of them.  */
+
+#define OMNIBOR_NOTE_SECTION ".note.omnibor"
+
+static const char *record_omnibor_dir;	/* The OmniBOR directory.  */
+static char **omnibor_inputs;		/* The input files.  */
+static unsigned omnibor_inputs_num, omnibor_inputs_alloc;
+static char *omnibor_ltrans_file;	/* List of the LTRANS units.  */
+
 /* Special kinds of symbols that a name may denote.  */
 
 enum symkind {
@@ -400,6 +413,9 @@ tool_cleanup (bool from_signal)
 
   if (lto_o_files)
     maybe_unlink_list (lto_o_files);
+
+  if (omnibor_ltrans_file)
+    maybe_unlink (omnibor_ltrans_file);
 }
 
 static void
@@ -748,6 +764,219 @@ maybe_run_lto_and_relink (char **lto_ld_argv, char **object_lst,
   else
     post_ld_pass (false); /* No LTO objects were found, no temp file.  */
 }
+
+/* Return the value of the hex digit C, or -1.  */
+
+static int
+omnibor_hex_digit (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+/* Store in GITOID the LEN bytes of the lowercase hex gitoid at HEX.
+   Return false if HEX does not start with 2 * LEN hex digits followed by
+   a space.  */
+
+static bool
+omnibor_parse_gitoid (const char *hex, unsigned len, unsigned char *gitoid)
+{
+  for (unsigned i = 0; i != len; i++)
+    {
+      int hi = omnibor_hex_digit (hex[2 * i]);
+      int lo = hi < 0 ? -1 : omnibor_hex_digit (hex[2 * i + 1]);
+      if (lo < 0)
+	return false;
+      gitoid[i] = hi << 4 | lo;
+    }
+
+  return hex[2 * len] == ' ';
+}
+
+/* Return the 4-byte field of a note at P.  varasm.c writes the fields of
+   the .note.omnibor notes in little-endian order.  */
+
+static unsigned
+omnibor_note_field (const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (unsigned) p[3] << 24;
+}
+
+/* Store in BOM the gitoids of the SHA1 and SHA256 OmniBOR Document files
+   of the object file open on FD, read from its .note.omnibor section;
+   the rest of the file is not read.  Return false if it has no such
+   section, or not exactly one note of each kind, as when it was linked
+   with -r from several object files.  */
+
+static bool
+omnibor_read_note (int fd, struct omnibor_gitoids *bom)
+{
+  const char *errmsg;
+  int err;
+  simple_object_read *inobj = simple_object_start_read (fd, 0,
+							LTO_SEGMENT_NAME,
+							&errmsg, &err);
+  if (!inobj)
+    return false;
+
+  off_t offset, length;
+  int found = simple_object_find_section (inobj, OMNIBOR_NOTE_SECTION,
+					  &offset, &length, &errmsg, &err);
+  simple_object_release_read (inobj);
+  if (!found || length <= 0)
+    return false;
+
+  unsigned char *buf = XNEWVEC (unsigned char, length);
+  bool ok = (lseek (fd, offset, SEEK_SET) == offset
+	     && read (fd, buf, length) == length);
+  unsigned num_sha1 = 0, num_sha256 = 0;
+
+  for (off_t pos = 0; ok && length - pos >= 12; )
+    {
+      unsigned namesz = omnibor_note_field (buf + pos);
+      unsigned descsz = omnibor_note_field (buf + pos + 4);
+      unsigned type = omnibor_note_field (buf + pos + 8);
+      off_t name = pos + 12;
+      off_t desc = name + ((namesz + 3) & ~3u);
+      pos = desc + ((descsz + 3) & ~3u);
+      if (namesz > length || descsz > length || pos > length)
+	break;
+
+      if (namesz != sizeof "OMNIBOR"
+	  || memcmp (buf + name, "OMNIBOR", sizeof "OMNIBOR") != 0)
+	continue;
+      /* NT_GITOID_SHA1 has a value 1 and NT_GITOID_SHA256 a value 2.  */
+      if (type == 1 && descsz == sizeof (bom->sha1))
+	{
+	  memcpy (bom->sha1, buf + desc, descsz);
+	  num_sha1++;
+	}
+      else if (type == 2 && descsz == sizeof (bom->sha256))
+	{
+	  memcpy (bom->sha256, buf + desc, descsz);
+	  num_sha256++;
+	}
+    }
+
+  XDELETEVEC (buf);
+  return num_sha1 == 1 && num_sha256 == 1;
+}
+
+/* Remember the input file NAME of the link for the OmniBOR Document
+   files, if they are recorded.  */
+
+static void
+add_omnibor_input (const char *name)
+{
+  if (record_omnibor_dir == NULL)
+    return;
+
+  if (omnibor_inputs_num == omnibor_inputs_alloc)
+    {
+      omnibor_inputs_alloc = omnibor_inputs_alloc * 2 + 16;
+      omnibor_inputs = XRESIZEVEC (char *, omnibor_inputs,
+				   omnibor_inputs_alloc);
+    }
+  omnibor_inputs[omnibor_inputs_num++] = xstrdup (name);
+}
+
+static int
+omnibor_input_cmp (const void *a, const void *b)
+{
+  return strcmp (*(char *const *) a, *(char *const *) b);
+}
+
+/* Record the LTRANS units listed in the file named by
+   COLLECT_OMNIBOR_LTRANS, by the drivers which compiled them, in D.  */
+
+static void
+add_omnibor_ltrans_units (class mkdeps *d)
+{
+  FILE *stream = fopen (omnibor_ltrans_file, "r");
+  if (stream == NULL)
+    return;
+
+  int c;
+  while ((c = getc (stream)) != EOF)
+    obstack_1grow (&temporary_obstack, c);
+  obstack_1grow (&temporary_obstack, '\0');
+  fclose (stream);
+
+  char *start = XOBFINISH (&temporary_obstack, char *);
+  while (*start)
+    {
+      char *end = strchr (start, '\n');
+      if (end == NULL)
+	break;
+      *end = '\0';
+
+      struct omnibor_gitoids gitoids;
+      const unsigned sha1_len = sizeof (gitoids.sha1);
+      const unsigned sha256_len = sizeof (gitoids.sha256);
+      char *sha256 = start + 2 * sha1_len + 1;
+      if ((size_t) (end - start) > 2 * sha1_len + 2 * sha256_len + 2
+	  && omnibor_parse_gitoid (start, sha1_len, gitoids.sha1)
+	  && omnibor_parse_gitoid (sha256, sha256_len, gitoids.sha256))
+	deps_record_omnibor_input (d, sha256 + 2 * sha256_len + 1, &gitoids,
+				   NULL);
+
+      start = end + 1;
+    }
+
+  obstack_free (&temporary_obstack, temporary_firstobj);
+}
+
+/* Write the OmniBOR Document files of the output file of the link, once
+   it has been linked, together with its metadata files, which the driver
+   finishes.  The gitoids of the input files are taken from the gitoid
+   cache of the OmniBOR directory where possible.  */
+
+static void
+maybe_record_omnibor (void)
+{
+  if (record_omnibor_dir == NULL)
+    return;
+
+  class mkdeps *d = deps_init ();
+
+  /* The same archive is often named several times.  */
+  qsort (omnibor_inputs, omnibor_inputs_num, sizeof (char *),
+	 omnibor_input_cmp);
+  for (unsigned i = 0; i != omnibor_inputs_num; i++)
+    {
+      if (i && strcmp (omnibor_inputs[i - 1], omnibor_inputs[i]) == 0)
+	continue;
+
+      int fd = open (omnibor_inputs[i], O_RDONLY | O_BINARY);
+      if (fd == -1)
+	continue;
+
+      const struct omnibor_gitoids *gitoids = deps_omnibor_file_gitoids (fd);
+      struct omnibor_gitoids bom;
+      if (gitoids)
+	deps_record_omnibor_input (d, omnibor_inputs[i], gitoids,
+				   omnibor_read_note (fd, &bom) ? &bom : NULL);
+      close (fd);
+    }
+
+  add_omnibor_ltrans_units (d);
+
+  std::string gitoid_sha1, gitoid_sha256;
+  set_omnibor_outfile (output_file);
+  deps_write_omnibor (d, record_omnibor_dir, &gitoid_sha1, &gitoid_sha256);
+  deps_free (d);
+
+  if (gitoid_sha1.empty () || gitoid_sha256.empty ())
+    warning (0, "cannot write the OmniBOR Document files of %qs",
+	     output_file);
+  else if (verbose)
+    notice ("OmniBOR Document files of %s: %s %s\n", output_file,
+	    gitoid_sha1.c_str (), gitoid_sha256.c_str ());
+}
+
 /* Entry point for linker invoation.  Called from main in collect2.c.
    LD_ARGV is an array of arguments for the linker.  */
 
@@ -1023,6 +1252,16 @@ main (int argc, char **argv)
 	else if (strncmp (q, "-save-temps", 11) == 0)
 	  /* FIXME: Honour =obj.  */
 	  save_temps = true;
+	else if (strncmp (q, "-frecord-omnibor=", 17) == 0)
+	  record_omnibor_dir = q[17] ? xstrdup (q + 17) : NULL;
+	else if (strcmp (q, "-frecord-omnibor-pack") == 0)
+	  set_omnibor_pack (true);
+	else if (strcmp (q, "-fno-record-omnibor-pack") == 0)
+	  set_omnibor_pack (false);
+	else if (strcmp (q, "-frecord-omnibor-fsync") == 0)
+	  set_omnibor_fsync (true);
+	else if (strcmp (q, "-fno-record-omnibor-fsync") == 0)
+	  set_omnibor_fsync (false);
 	else if (strcmp (q, "-dumpdir") == 0)
 	  dumppfx = xstrdup (extract_string (&p));
 	else if (strcmp (q, "-o") == 0
@@ -1032,6 +1271,21 @@ main (int argc, char **argv)
     }
     obstack_free (&temporary_obstack, temporary_firstobj);
 
+    /* Like the driver, record the OmniBOR information in the directory
+       given by -frecord-omnibor=, or else by OMNIBOR_DIR.  The drivers
+       which compile the LTRANS units, under the linker or lto-wrapper,
+       list them in the file named by COLLECT_OMNIBOR_LTRANS.  */
+    if (record_omnibor_dir == NULL
+	&& (p = getenv ("OMNIBOR_DIR")) != NULL && *p != '\0')
+      record_omnibor_dir = p;
+    if (record_omnibor_dir != NULL)
+      {
+	set_omnibor_dir (record_omnibor_dir);
+	omnibor_ltrans_file = make_temp_file (".omnibor");
+	putenv (concat ("COLLECT_OMNIBOR_LTRANS=", omnibor_ltrans_file,
+			NULL));
+      }
+
     verbose = verbose || debug;
     save_temps = save_temps || debug;
     find_file_set_debug (debug);
@@ -1506,6 +1760,7 @@ main (int argc, char **argv)
 		  *ld2++ = arg;
 		}
 	    }
+	  add_omnibor_input (arg);
 	  if (p[1] == 'o' || p[1] == 'l')
 	    *object++ = arg;
 #ifdef COLLECT_EXPORT_LIST
@@ -1672,6 +1927,7 @@ main (int argc, char **argv)
 	else
 	  post_ld_pass (/*temp_file*/false);
 
+	maybe_record_omnibor ();
 	return 0;
       }
   }
@@ -1741,6 +1997,7 @@ main (int argc, char **argv)
       maybe_unlink (export_file);
 #endif
       post_ld_pass (/*temp_file*/false);
+      maybe_record_omnibor ();
       return 0;
     }
 
@@ -1839,6 +2096,7 @@ main (int argc, char **argv)
   scan_prog_file (output_file, PASS_SECOND, SCAN_ALL);
 #endif
 
+  maybe_record_omnibor ();
   return 0;
 }
 
@@ -3538,6 +3538,11 @@ class GTY((chain_next ("%h.parent"), for_user)) module_state {
 		     const char *dialect, unsigned extensions);
   void write_env (elf_out *to);
 
+ private:
+  /* OmniBOR information, for the importers.  */
+  void write_omnibor (elf_out *to, cpp_reader *);
+  void read_omnibor (cpp_reader *);
+
  private:
   /* Import tables. */
   void write_imports (bytes_out &cfg, bool direct);
@@ -14062,6 +14067,61 @@ module_state::write_env (elf_out *to)
   vars.release ();
 }
 
+/* Write the gitoids of the OmniBOR Document files of this module, which
+   list its inputs, to MOD_SNAME_PFX.omb.  An importer records the CMI
+   with a reference to them, instead of the inputs themselves.  */
+
+void
+module_state::write_omnibor (elf_out *to, cpp_reader *reader)
+{
+  struct omnibor_gitoids gitoids;
+  deps_omnibor_document_gitoids (reader, &gitoids);
+
+  bytes_out sec (to);
+  sec.begin ();
+  sec.buf (&gitoids, sizeof (gitoids));
+  unsigned crc = 0;
+  sec.end (to, to->name (MOD_SNAME_PFX ".omb"), &crc);
+}
+
+/* Record the CMI in the OmniBOR Document files of the importer, with
+   the gitoids of the OmniBOR Document files of this module if the CMI
+   has them.  Only the CMI is hashed, not the inputs of the module.  */
+
+void
+module_state::read_omnibor (cpp_reader *reader)
+{
+  const char *file = maybe_add_cmi_prefix (filename);
+  struct omnibor_gitoids gitoids;
+  struct stat st;
+  int fd = open (file, O_RDONLY | O_CLOEXEC | O_BINARY);
+  bool ok = (fd >= 0 && fstat (fd, &st) == 0
+	     && deps_omnibor_hash_fd (fd, st.st_size, &gitoids));
+  if (fd >= 0)
+    close (fd);
+  if (!ok)
+    return;
+
+  struct omnibor_gitoids bom;
+  bool have_bom = false;
+  if (unsigned snum = from ()->find (MOD_SNAME_PFX ".omb"))
+    {
+      bytes_in sec;
+
+      if (sec.begin (loc, from (), snum))
+	{
+	  if (const void *data = sec.buf (sizeof (bom)))
+	    {
+	      memcpy (&bom, data, sizeof (bom));
+	      have_bom = true;
+	    }
+	  have_bom = sec.end (from ()) && have_bom;
+	}
+    }
+
+  deps_add_omnibor_input (reader, file, &gitoids, have_bom ? &bom : NULL);
+}
+
 /* Write the direct or indirect imports.
    u:N
    {
@@ -17528,6 +17588,7 @@ ool_cmp (const void *a_, const void *b_)
      MOD_SNAME_PFX.ini      : inits
      MOD_SNAME_PFX.cnt      : counts
      MOD_SNAME_PFX.cfg      : config data
+     MOD_SNAME_PFX.omb      : OmniBOR Document gitoids
 */
 
 void
@@ -17803,6 +17864,9 @@ module_state::write (elf_out *to, cpp_reader *reader)
   if (false)
     write_env (to);
 
+  if (omnibor_enabled)
+    write_omnibor (to, reader);
+
   trees_out::instrument ();
   dump () && dump ("Wrote %u sections", to->get_section_limit ());
 }
@@ -18657,6 +18721,8 @@ module_state::do_import (cpp_reader *reader, bool outermost)
       loadedness = ML_CONFIG;
       lazy_open++;
       ok = read_initial (reader);
+      if (ok && omnibor_enabled)
+	read_omnibor (reader);
       slurp->lru = ++lazy_lru;
     }
 
@@ -53,6 +53,7 @@ along with GCC; see the file COPYING3.  If not see
 
 #include "d-tree.h"
 #include "id.h"
+#include "omnibor.h"
 
 
 /* Array of D frontend type/decl nodes.  */
@@ -283,6 +284,23 @@ deps_write (Module *module, obstack *buffer)
   obstack_1grow (buffer, '\0');
 }
 
+/* Record the source files of all the modules which were loaded, and the
+   files whose contents they imported, for the OmniBOR Document files.  */
+
+static void
+omnibor_add_module_files (void)
+{
+  for (size_t i = 0; i < Module::amodules.length; i++)
+    {
+      Module *m = Module::amodules[i];
+
+      omnibor_add_dependency (m->srcfile->name->str);
+
+      for (size_t j = 0; j < m->contentImportedFiles.length; j++)
+	omnibor_add_dependency (m->contentImportedFiles[j]);
+    }
+}
+
 /* Implements the lang_hooks.init_options routine for language D.
    This initializes the global state for the D frontend before calling
    the option handlers.  */
@@ -1112,6 +1130,8 @@ d_parse_file (void)
       d_maybe_set_builtin (m);
     }
 
+  omnibor_add_module_files ();
+
   /* Do not attempt to generate output files if errors or warnings occurred.  */
   if (global.errors || global.warnings)
     goto had_errors;
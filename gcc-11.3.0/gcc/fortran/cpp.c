@@ -31,6 +31,7 @@ along with GCC; see the file COPYING3.  If not see
 #include "incpath.h"
 #include "cppbuiltin.h"
 #include "mkdeps.h"
+#include "omnibor.h"
 
 #ifndef TARGET_SYSTEM_ROOT
 # define TARGET_SYSTEM_ROOT NULL
@@ -218,9 +219,17 @@ gfc_cpp_makedep (void)
   return gfc_cpp_option.deps;
 }
 
+/* Record that the file NAME was read, for the OmniBOR Document files and,
+   with -M, for the make dependencies.  */
+
 void
 gfc_cpp_add_dep (const char *name, bool system)
 {
+  omnibor_add_dependency (name);
+
+  if (!gfc_cpp_makedep ())
+    return;
+
   if (!gfc_cpp_option.deps_skip_system || !system)
     if (mkdeps *deps = cpp_get_deps (cpp_in))
       deps_add_dep (deps, name);
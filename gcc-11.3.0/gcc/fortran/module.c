@@ -1102,8 +1102,7 @@ gzopen_included_file_1 (const char *name, gfc_directorylist *list,
       f = gzopen (fullname, "r");
       if (f != NULL)
        {
-         if (gfc_cpp_makedep ())
-           gfc_cpp_add_dep (fullname, system);
+	 gfc_cpp_add_dep (fullname, system);
 
 	 free (module_fullpath);
 	 module_fullpath = xstrdup (fullname);
@@ -1124,8 +1123,7 @@ gzopen_included_file (const char *name, bool include_cwd, bool module)
       f = gzopen (name, "r");
       if (f)
 	{
-	  if (gfc_cpp_makedep ())
-	    gfc_cpp_add_dep (name, false);
+	  gfc_cpp_add_dep (name, false);
 
 	  free (module_fullpath);
 	  module_fullpath = xstrdup (name);
@@ -1148,8 +1146,7 @@ gzopen_intrinsic_module (const char* name)
       f = gzopen (name, "r");
       if (f)
 	{
-	  if (gfc_cpp_makedep ())
-	    gfc_cpp_add_dep (name, true);
+	  gfc_cpp_add_dep (name, true);
 
 	  free (module_fullpath);
 	  module_fullpath = xstrdup (name);
@@ -434,8 +434,7 @@ open_included_file (const char *name, gfc_directorylist *list,
       f = gfc_open_file (fullname);
       if (f != NULL)
 	{
-	  if (gfc_cpp_makedep ())
-	    gfc_cpp_add_dep (fullname, system);
+	  gfc_cpp_add_dep (fullname, system);
 
 	  return f;
 	}
@@ -457,7 +456,7 @@ gfc_open_included_file (const char *name, bool include_cwd, bool module)
   if (IS_ABSOLUTE_PATH (name) || include_cwd)
     {
       f = gfc_open_file (name);
-      if (f && gfc_cpp_makedep ())
+      if (f)
 	gfc_cpp_add_dep (name, false);
     }
 
@@ -45,6 +45,8 @@ compilation is specified by a string called a "spec".  */
 #include "spellcheck.h"
 #include "sha1.h"
 #include "sha256.h"
+#include "omnibor-pack.h"
+#include "omnibor-cache.h"
 
 
 
@@ -53,13 +55,26 @@ compilation is specified by a string called a "spec".  */
 #define MAX_FILE_SIZE_STRING_LENGTH 256
 
 /* Command line passed by the user.  This is not NULL only when
-   OmniBOR calculation is enabled.  */
+   OmniBOR calculation is enabled.  It is allocated on omnibor_obstack.  */
 static char *omnibor_build_cmd = NULL;
-
-/* The input file which is currently being processed when completing
-   the metadata file in the OmniBOR concept.  This is used only when
-   -c or -S options are specified and -o option is not specified.  */
-static char *omnibor_current_input_file = NULL;
+static struct obstack omnibor_obstack;
+
+/* The directory in which the OmniBOR information is stored: the one given
+   by the last -frecord-omnibor= option or else by OMNIBOR_DIR.  NULL when
+   OmniBOR calculation is disabled.  It is resolved once, from the command
+   line, and passed to the compiler proper explicitly.  */
+static const char *omnibor_dir = NULL;
+
+/* While a compilation whose result may be stored in the OmniBOR cache
+   runs, the file to which the standard error of its commands is copied
+   as it is shown, so that its diagnostics can be stored with the result
+   and replayed when it is reused, and the paths of the compiler
+   programs found by the driver, one per line.  The compiler proper
+   appends to the file OMNIBOR_CACHE_PROBES what else the result depends
+   on; see cpp_write_include_probes.  */
+static const char *omnibor_cache_stderr;
+static char *omnibor_cache_programs;
+static const char *omnibor_cache_probes;
 
 /* Manage the manipulation of env vars.
 
@@ -439,6 +454,7 @@ static const char *version_compare_spec_function (int, const char **);
 static const char *include_spec_function (int, const char **);
 static const char *find_file_spec_function (int, const char **);
 static const char *find_plugindir_spec_function (int, const char **);
+static const char *omnibor_options_spec_function (int, const char **);
 static const char *print_asm_header_spec_function (int, const char **);
 static const char *compare_debug_dump_opt_spec_function (int, const char **);
 static const char *compare_debug_self_opt_spec_function (int, const char **);
@@ -1263,7 +1279,7 @@ static const char *cpp_options =
 "%(cpp_unique_options) %1 %{m*} %{std*&ansi&trigraphs} %{W*&pedantic*} %{w}\
  %{f*} %{g*:%{%:debug-level-gt(0):%{g*}\
  %{!fno-working-directory:-fworking-directory}}} %{O*}\
- %{undef} %{save-temps*:-fpch-preprocess}";
+ %{undef} %{save-temps*:-fpch-preprocess} %:omnibor-options()";
 
 /* Pass -d* flags, possibly modifying -dumpdir, -dumpbase et al.
 
@@ -1292,7 +1308,8 @@ static const char *cc1_options =
  %{coverage:-fprofile-arcs -ftest-coverage}\
  %{fprofile-arcs|fprofile-generate*|coverage:\
    %{!fprofile-update=single:\
-     %{pthread:-fprofile-update=prefer-atomic}}}";
+     %{pthread:-fprofile-update=prefer-atomic}}}\
+ %:omnibor-options()";
 
 static const char *asm_options =
 "%{-target-help:%:print-asm-header()} "
@@ -1775,6 +1792,7 @@ static const struct spec_function static_spec_functions[] =
   { "include",			include_spec_function },
   { "find-file",		find_file_spec_function },
   { "find-plugindir",		find_plugindir_spec_function },
+  { "omnibor-options",		omnibor_options_spec_function },
   { "print-asm-header",		print_asm_header_spec_function },
   { "compare-debug-dump-opt",	compare_debug_dump_opt_spec_function },
   { "compare-debug-self-opt",	compare_debug_self_opt_spec_function },
@@ -2134,6 +2152,9 @@ static int have_o = 0;
 /* Was the option -E passed.  */
 static int have_E = 0;
 
+/* Was the option -S passed.  */
+static int have_S = 0;
+
 /* Pointer to output file name passed in with -o. */
 static const char *output_file = 0;
 
@@ -3422,7 +3443,9 @@ execute (void)
 
       errmsg = pex_run (pex,
 			((i + 1 == n_commands ? PEX_LAST : 0)
-			 | (string == commands[i].prog ? PEX_SEARCH : 0)),
+			 | (string == commands[i].prog ? PEX_SEARCH : 0)
+			 | (omnibor_cache_stderr && i + 1 == n_commands
+			    ? PEX_STDERR_TO_PIPE : 0)),
 			string, CONST_CAST (char **, commands[i].argv),
 			NULL, NULL, &err);
       if (errmsg != NULL)
@@ -3434,10 +3457,41 @@ execute (void)
 		       string, errmsg);
 	}
 
+      /* The result of the compilation depends on the programs which run
+	 it, so they are recorded in the manifest of the OmniBOR cache.
+	 Those searched for in PATH, such as the assembler, are not.  */
+      if (omnibor_cache_stderr && string != commands[i].prog)
+	omnibor_cache_programs = reconcat (omnibor_cache_programs,
+					   omnibor_cache_programs
+					   ? omnibor_cache_programs : "",
+					   string, "\n", NULL);
+
       if (i && string != commands[i].prog)
 	free (CONST_CAST (char *, string));
     }
 
+  /* Show the diagnostics of a compilation which may be stored in the
+     OmniBOR cache as they come, and keep a copy.  Its commands are not
+     piped together, so the last one is the only one.  If the copy is
+     incomplete, it is removed, and not created again by the next
+     command, so that the result is not stored.  */
+  if (omnibor_cache_stderr)
+    {
+      FILE *in = pex_read_err (pex, 0);
+      FILE *out = NULL;
+      if (access (omnibor_cache_stderr, F_OK) == 0)
+	out = fopen (omnibor_cache_stderr, "ab");
+      char line[1024];
+      while (in != NULL && fgets (line, sizeof (line), in) != NULL)
+	{
+	  fputs (line, stderr);
+	  if (out != NULL)
+	    fputs (line, out);
+	}
+      if (in == NULL || out == NULL || (ferror (out) | fclose (out)))
+	remove (omnibor_cache_stderr);
+    }
+
   execution_count++;
 
   /* Wait for all the subprocesses to finish.  */
@@ -3666,6 +3720,13 @@ struct infile
   struct compiler *incompiler;
   bool compiled;
   bool preprocessed;
+  /* With the OmniBOR cache, the file which holds the standard error of
+     the commands which compiled this input, the paths of the compiler
+     programs they ran, one per line, and the file to which the compiler
+     proper wrote what else the result depends on; see execute.  */
+  const char *omnibor_stderr;
+  char *omnibor_programs;
+  const char *omnibor_probes;
 };
 
 /* Also a vector of input files specified.  */
@@ -4193,6 +4254,7 @@ driver_handle_option (struct gcc_options *opts,
     case OPT_print_sysroot_headers_suffix:
     case OPT_time:
     case OPT_wrapper:
+    case OPT_fomnibor_cache_:
       /* These options set the variables specified in common.opt
 	 automatically, and do not need to be saved for spec
 	 processing.  */
@@ -4474,6 +4536,10 @@ driver_handle_option (struct gcc_options *opts,
       have_E = true;
       break;
 
+    case OPT_S:
+      have_S = true;
+      break;
+
     case OPT_x:
       spec_lang = arg;
       if (!strcmp (spec_lang, "none"))
@@ -8023,557 +8089,1121 @@ compare_files (char *cmpfile[])
   return ret;
 }
 
-/* Append the string str2 to the end of the string str1.  */
+/* Store the lowercase hexadecimal representation of the LEN bytes of
+   RESBLOCK, followed by a NUL, in HEX.  */
 
 static void
-omnibor_append_to_string (char **str1, const char *str2,
-			  unsigned long len1, unsigned long len2)
+omnibor_hex (const unsigned char resblock[], unsigned len, char *hex)
 {
-  *str1 = (char *) xrealloc
-	(*str1, sizeof (char) * (len1 + len2 + 1));
-  memcpy (*str1 + len1, str2, len2);
-  (*str1)[len1 + len2] = '\0';
+  static const char *const lut = "0123456789abcdef";
+
+  for (unsigned i = 0; i != len; i++)
+    {
+      hex[2 * i] = lut[resblock[i] >> 4];
+      hex[2 * i + 1] = lut[resblock[i] & 15];
+    }
+  hex[2 * len] = '\0';
 }
 
-/* Set the string str1 to have the contents of the string str2.  */
+/* The size of the chunks in which the output file is read to calculate
+   its gitoids.  */
+#define OMNIBOR_READ_CHUNK (64 * 1024)
 
-static void
-omnibor_set_contents (char **str1, const char *str2, unsigned long len)
+/* Calculate both the SHA1 and the SHA256 gitoids using the contents of
+   the given file, which is read only once, in chunks of fixed size.  Only
+   the SHA1 gitoid is calculated if RESBLOCK_SHA256 is NULL.  Return false
+   if the size of the file cannot be found, or if it does not hold as
+   many bytes as that size when read, as deps_omnibor_hash_fd does.  */
+
+static bool
+calculate_omnibor_gitoids (FILE *dependency_file,
+			   unsigned char resblock_sha1[],
+			   unsigned char resblock_sha256[])
 {
-  *str1 = (char *) xrealloc
-	(*str1, sizeof (char) * (len + 1));
-  memcpy (*str1, str2, len);
-  (*str1)[len] = '\0';
+  long file_size;
+  if (fseek (dependency_file, 0L, SEEK_END) != 0
+      || (file_size = ftell (dependency_file)) == -1
+      || fseek (dependency_file, 0L, SEEK_SET) != 0)
+    return false;
+
+  /* This length should be enough for everything up to 64B, which should
+     cover long type.  */
+  char init_data[MAX_FILE_SIZE_STRING_LENGTH];
+  int init_len = snprintf (init_data, sizeof (init_data), "blob %ld",
+			   file_size);
+
+  char *chunk = XNEWVEC (char, OMNIBOR_READ_CHUNK);
+  size_t count;
+  unsigned long total = 0;
+
+  /* Calculate the hashes.  */
+  struct sha1_ctx ctx_sha1;
+  struct sha256_ctx ctx_sha256;
+
+  sha1_init_ctx (&ctx_sha1);
+  sha256_init_ctx (&ctx_sha256);
+
+  sha1_process_bytes (init_data, init_len + 1, &ctx_sha1);
+  if (resblock_sha256)
+    sha256_process_bytes (init_data, init_len + 1, &ctx_sha256);
+  while ((count = fread (chunk, 1, OMNIBOR_READ_CHUNK, dependency_file)))
+    {
+      total += count;
+      sha1_process_bytes (chunk, count, &ctx_sha1);
+      if (resblock_sha256)
+	sha256_process_bytes (chunk, count, &ctx_sha256);
+    }
+
+  XDELETEVEC (chunk);
+  if (ferror (dependency_file) || total != (unsigned long) file_size)
+    return false;
+
+  sha1_finish_ctx (&ctx_sha1, resblock_sha1);
+  if (resblock_sha256)
+    sha256_finish_ctx (&ctx_sha256, resblock_sha256);
+  return true;
 }
 
-/* Return the position of the first occurrence after start_pos position
-   of char c in str string (start_pos is the first position to check),
-   otherwise -1.  */
+/* Checks whether to add an assembler option --omnibor-tempfile to the
+   options passed to the assembler.  It is an indication to the assembler
+   that its input is a temporary assembly file generated by GCC during the
+   compilation process whose end result is either an object file or an
+   executable.  That option should be passed only when OmniBOR calculation
+   is enabled for GCC.  */
 
-static int
-omnibor_find_char_from_pos (unsigned start_pos, char c, const char *str)
+void
+omnibor_assembler_option_check (void)
 {
-  if (str)
-    for (unsigned ix = start_pos; ix < strlen (str); ++ix)
-      if (str[ix] == c)
-	return ix;
-
-  return -1;
+  if ((have_exactly_c || !have_c) &&
+       strcmp ("c", input_suffix) == 0 &&
+       omnibor_dir != NULL)
+    add_assembler_option ("--omnibor-tempfile", 18);
 }
 
-/* Return the position of the last occurrence after start_pos position
-   of char c in str string (start_pos is the first position to check),
-   otherwise -1.  */
+/* Return the path of the file which the compilation of the input file
+   INPUT finally produces: the -o file, a.out when linking, or the name
+   of INPUT with its suffix, whatever its length, replaced by .o or .s
+   otherwise.  Return NULL if the output goes to stdout.  The result
+   has to be freed by the caller.  */
 
-static int
-omnibor_find_last_char_from_pos (unsigned start_pos, char c,
-				 const char *str)
+static char *
+omnibor_output_file_name (const char *input)
 {
-  int ret = -1;
-  if (str)
-    for (unsigned ix = start_pos; ix < strlen (str); ++ix)
-      if (str[ix] == c)
-	ret = ix;
+  if (output_file != NULL && *output_file != '\0')
+    return strcmp (output_file, "-") ? xstrdup (output_file) : NULL;
 
-  return ret;
+  if (!have_c)
+    return xstrdup ("a.out");
+  if (have_E)
+    return NULL;
+
+  const char *base = lbasename (input);
+  const char *dot = strrchr (base, '.');
+  int len = dot && dot != base ? dot - base : strlen (base);
+  return xasprintf ("%.*s%s", len, base, have_S ? ".s" : ".o");
 }
 
-/* Get the substring of length len of the str2 string starting from
-   the start position and put it in the str1 string.  */
+/* Complete the OmniBOR metadata file named NAME in the directory
+   METADATA_DIR, whose output file has the gitoid GITOID, and rename it
+   after that gitoid.  The compiler leaves a slot of the width of the
+   gitoid after "outfile: ", so the gitoid is written there in place and
+   the build command line is appended; the rest of the file is neither
+   read nor rewritten.  */
 
 static void
-omnibor_substr (char **str1, unsigned start, unsigned len,
-		const char *str2)
+omnibor_finish_metadata_file (const char *metadata_dir, const char *name,
+			      const char *gitoid)
 {
-  if (str2)
+  static const char outfile_tag[] = "outfile: ";
+  const size_t tag_len = sizeof (outfile_tag) - 1;
+  const size_t gitoid_len = strlen (gitoid);
+
+  char *filename_path = concat (metadata_dir, name, ".metadata", NULL);
+  FILE *metadata_file = fopen (filename_path, "rb+");
+  if (metadata_file == NULL)
+    {
+      free (filename_path);
+      return;
+    }
+
+  /* Check that the slot is there and still empty.  */
+  char *slot = XNEWVEC (char, tag_len + gitoid_len);
+  bool ok = (fread (slot, 1, tag_len + gitoid_len, metadata_file)
+	     == tag_len + gitoid_len
+	     && memcmp (slot, outfile_tag, tag_len) == 0);
+  for (size_t i = tag_len; ok && i != tag_len + gitoid_len; i++)
+    ok = slot[i] == ' ';
+  XDELETEVEC (slot);
+
+  if (ok)
     {
-      *str1 = (char *) xrealloc
-	(*str1, sizeof (char) * (len + 1));
-      memcpy (*str1, str2 + start, len);
-      (*str1)[len] = '\0';
+      /* Add the gitoid of the output file in the appropriate place.  */
+      fseek (metadata_file, tag_len, SEEK_SET);
+      fwrite (gitoid, sizeof (char), gitoid_len, metadata_file);
+
+      /* Add the build command line in the appropriate place.  */
+      fseek (metadata_file, 0L, SEEK_END);
+      if (omnibor_build_cmd)
+	fputs (omnibor_build_cmd, metadata_file);
+      else
+	fputs ("not available", metadata_file);
+      fputs ("\n==== End of raw info for this process\n", metadata_file);
     }
+  ok = fclose (metadata_file) == 0 && ok;
+
+  if (ok)
+    {
+      char *new_filename_path = concat (metadata_dir, gitoid, NULL);
+
+      /* Check if a file with the name equal to the new name for the
+	 metadata file already exists.  That is the case when GCC invokes
+	 linker and OmniBOR calculation is enabled there as well, because
+	 both GCC and linker have the same output file, hence the same
+	 gitoid is used to name the metadata file in both tools.  In that
+	 case, remove the file created by linker (for now) before
+	 renaming metadata file in GCC.  */
+      FILE *fp = fopen (new_filename_path, "r");
+      if (fp != NULL)
+	{
+	  fclose (fp);
+	  remove (new_filename_path);
+	}
+
+      rename (filename_path, new_filename_path);
+      free (new_filename_path);
+    }
+
+  free (filename_path);
 }
 
-/* Calculate the SHA1 gitoid using the contents of the given file.  */
+/* Complete the SHA1 and SHA256 OmniBOR metadata files of the output file
+   of the input file INPUT.  The output file is read only once, to
+   calculate both of its gitoids, which are stored in SHA1_GITOID and
+   SHA256_GITOID.  Return true if the metadata files were completed.  */
 
-static void
-calculate_sha1_omnibor (FILE *dependency_file, unsigned char resblock[])
+static bool
+omnibor_complete_metadata_files (const char *input,
+				 char sha1_gitoid[2 * GITOID_LENGTH_SHA1 + 1],
+				 char sha256_gitoid[2 * GITOID_LENGTH_SHA256
+						    + 1])
 {
-  fseek (dependency_file, 0L, SEEK_END);
-  long file_size = ftell (dependency_file);
-  fseek (dependency_file, 0L, SEEK_SET);
+  char *output_file_name = omnibor_output_file_name (input);
+  if (output_file_name == NULL)
+    return false;
 
-  /* This length should be enough for everything up to 64B, which should
-     cover long type.  */
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
+  /* Extract the name part of the path of the output file.  */
+  const char *slash = strrchr (output_file_name, '/');
+  if (slash != NULL && slash[1] == '\0')
+    {
+      free (output_file_name);
+      return false;
+    }
+  const char *output_file_name_strip = slash ? slash + 1 : output_file_name;
+
+  char *sha1_dir = concat (omnibor_dir, "/metadata/gnu/gitoid_blob_sha1/",
+			   NULL);
+  char *sha256_dir = concat (omnibor_dir, "/metadata/gnu/gitoid_blob_sha256/",
+			     NULL);
+
+  /* Do not read the output file if the compiler wrote no metadata.  */
+  char *sha1_file = concat (sha1_dir, output_file_name_strip, ".metadata",
+			    NULL);
+  char *sha256_file = concat (sha256_dir, output_file_name_strip,
+			      ".metadata", NULL);
+  bool have_metadata = (access (sha1_file, F_OK) == 0
+			|| access (sha256_file, F_OK) == 0);
+  free (sha256_file);
+  free (sha1_file);
+
+  FILE *output_file_handle = (have_metadata
+			      ? fopen (output_file_name, "rb") : NULL);
+  unsigned char resblock_sha1[GITOID_LENGTH_SHA1];
+  unsigned char resblock_sha256[GITOID_LENGTH_SHA256];
+  bool ok = (output_file_handle != NULL
+	     && calculate_omnibor_gitoids (output_file_handle, resblock_sha1,
+					   resblock_sha256));
+  if (output_file_handle != NULL)
+    fclose (output_file_handle);
+  if (ok)
+    {
+      omnibor_hex (resblock_sha1, GITOID_LENGTH_SHA1, sha1_gitoid);
+      omnibor_finish_metadata_file (sha1_dir, output_file_name_strip,
+				    sha1_gitoid);
+      omnibor_hex (resblock_sha256, GITOID_LENGTH_SHA256, sha256_gitoid);
+      omnibor_finish_metadata_file (sha256_dir, output_file_name_strip,
+				    sha256_gitoid);
+    }
+
+  free (sha256_dir);
+  free (sha1_dir);
+  free (output_file_name);
+  return ok;
+}
+
+/* The OmniBOR compilation result cache, enabled by -fomnibor-cache=<dir>.
+
+   When the OmniBOR information is recorded, the object file produced by
+   compiling an input file with -c is stored in the cache, keyed by the
+   gitoid of the OmniBOR Document file of the compilation, which is a
+   content hash of every file the compiler read, by the command line and
+   by the identity of the compiler.  So that the Document can be found
+   without running the preprocessor, the cache also keeps, for each
+   command line and input file, a manifest of the inputs of the last
+   compilation with their gitoids, taken from the OmniBOR metadata file:
+   if none of them has changed, neither has the Document.  The manifest
+   also lists the compiler programs which ran, with their gitoids, and
+   the paths at which the compiler looked for a header in vain: a header
+   created at one of them, which shadows one later in the search path,
+   changes the Document.  A compilation whose output depends on the date
+   or time, or whose compiler does not report those paths, is not stored.
+   The diagnostics of the compilation are kept to be replayed.  The
+   cache directory holds:
+
+     manifests/<key>			the manifest for command line KEY
+     objects/<key>-<document>.o		the object file
+     objects/<key>-<document>.sha1	its SHA1 OmniBOR metadata file
+     objects/<key>-<document>.sha256	its SHA256 OmniBOR metadata file
+     objects/<key>-<document>.err	the diagnostics of its compilation,
+					without colors
+
+   Files are copied into and out of the cache rather than hard-linked,
+   so that later in-place changes to an object file cannot corrupt the
+   cache.  */
+
+/* Return true if the OmniBOR cache may be used for this compilation.  */
+
+static bool
+omnibor_cache_p (void)
+{
+  return (omnibor_cache_dir != NULL && *omnibor_cache_dir != '\0'
+	  && omnibor_dir != NULL
+	  && have_exactly_c && !have_S && !have_E
+	  && !compare_debug && !save_temps_flag);
+}
+
+/* Return true if one of the comma-separated options ARG, as passed on
+   by -Wp, or -Wa, starts with PREFIX.  */
+
+static bool
+omnibor_passed_option_p (const char *arg, const char *prefix)
+{
+  for (const char *p = arg; p; p = strchr (p, ','))
+    {
+      if (*p == ',')
+	p++;
+      if (strncmp (p, prefix, strlen (prefix)) == 0)
+	return true;
+    }
+  return false;
+}
 
-  char *init_data = (char *) xcalloc (1, sizeof (char));
-  omnibor_append_to_string (&init_data, "blob ", strlen (init_data),
-			    strlen ("blob "));
-  omnibor_append_to_string (&init_data, buff_for_file_size, strlen (init_data),
-			    strlen (buff_for_file_size));
-  omnibor_append_to_string (&init_data, "\0", strlen (init_data), 1);
+/* Add the SHA1 gitoid of the file PATH to CTX.  Return false if the file
+   cannot be read.  */
 
-  char *file_contents = (char *) xcalloc (file_size, sizeof (char));
-  fread (file_contents, 1, file_size, dependency_file);
+static bool
+omnibor_cache_key_file (struct sha1_ctx *ctx, const char *path)
+{
+  unsigned char gitoid[GITOID_LENGTH_SHA1];
+  if (path == NULL || !omnibor_file_sha1_gitoid (omnibor_dir, path, gitoid))
+    return false;
+  sha1_process_bytes (gitoid, sizeof (gitoid), ctx);
+  return true;
+}
+
+/* Return the key in the OmniBOR cache of the compilation of INPUT with
+   the options DECODED_OPTIONS, as a string of hex digits which the
+   caller has to free.  The options which only affect where the output,
+   the OmniBOR information and the verbose output go are left out, and
+   the contents of the specs files and plugins are included.  Return
+   NULL if the compilation cannot be cached, because it writes files
+   which the cache does not keep, such as dependency files, split DWARF,
+   coverage notes or stack usage files, or because a specs file or a
+   plugin cannot be read.  The compiler programs themselves are checked
+   with the manifest; see omnibor_cache_store.  */
 
-  /* Calculate the hash.  */
+static char *
+omnibor_cache_key (const struct cl_decoded_option *decoded_options,
+		   unsigned int decoded_options_count, const char *input)
+{
+  static const char *const env_vars[]
+    = { "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH", "OBJC_INCLUDE_PATH",
+	"SOURCE_DATE_EPOCH" };
   struct sha1_ctx ctx;
+  unsigned char resblock[GITOID_LENGTH_SHA1];
 
   sha1_init_ctx (&ctx);
 
-  sha1_process_bytes (init_data, strlen (init_data) + 1, &ctx);
-  sha1_process_bytes (file_contents, file_size, &ctx);
+  /* The compiler, the directory and the input file.  */
+  const char *parts[] = { version_string, spec_machine, getpwd (), input };
+  for (unsigned i = 0; i != ARRAY_SIZE (parts); i++)
+    sha1_process_bytes (parts[i], strlen (parts[i]) + 1, &ctx);
 
-  sha1_finish_ctx (&ctx, resblock);
+  for (unsigned i = 0; i != ARRAY_SIZE (env_vars); i++)
+    {
+      const char *value = env.get (env_vars[i]);
+      sha1_process_bytes (env_vars[i], strlen (env_vars[i]) + 1, &ctx);
+      if (value)
+	sha1_process_bytes (value, strlen (value) + 1, &ctx);
+    }
 
-  free (file_contents);
-  free (init_data);
+  for (unsigned int j = 1; j < decoded_options_count; j++)
+    {
+      const char *arg = decoded_options[j].arg;
+      switch (decoded_options[j].opt_index)
+	{
+	case OPT_SPECIAL_input_file:
+	case OPT_o:
+	case OPT_v:
+	case OPT_frecord_omnibor_:
+	case OPT_frecord_omnibor_fsync:
+	case OPT_frecord_omnibor_jobs_:
+	case OPT_frecord_omnibor_outfile_:
+	case OPT_frecord_omnibor_pack:
+	case OPT_fomnibor_cache_:
+	  continue;
+
+	case OPT_MD:
+	case OPT_MMD:
+	case OPT_MF:
+	case OPT_gsplit_dwarf:
+	case OPT_coverage:
+	case OPT_fprofile_arcs:
+	case OPT_ftest_coverage:
+	case OPT_fprofile_generate:
+	case OPT_fprofile_generate_:
+	case OPT_fprofile_note_:
+	case OPT_fstack_usage:
+	case OPT_fcallgraph_info:
+	case OPT_fcallgraph_info_:
+	case OPT_fdump_:
+	case OPT_fopt_info_:
+	case OPT_aux_info:
+	  return NULL;
+
+	case OPT_Wp_:
+	case OPT_Xpreprocessor:
+	  if (omnibor_passed_option_p (arg, "-M"))
+	    return NULL;
+	  break;
+
+	case OPT_Wa_:
+	case OPT_Xassembler:
+	  /* Listings and dependency files of the assembler.  */
+	  if (omnibor_passed_option_p (arg, "-a")
+	      || omnibor_passed_option_p (arg, "--MD"))
+	    return NULL;
+	  break;
+
+	case OPT_specs_:
+	case OPT_fplugin_:
+	  {
+	    char *path;
+	    if (decoded_options[j].opt_index == OPT_specs_)
+	      path = find_a_file (&startfile_prefixes, arg, R_OK, true);
+	    else
+	      {
+		/* A plugin named without a directory or suffix is looked
+		   for in the plugin directory, as in add_new_plugin.  */
+		bool name_is_short = !IS_ABSOLUTE_PATH (arg);
+		for (const char *pc = arg; name_is_short && *pc; pc++)
+		  if (*pc == '.' || IS_DIR_SEPARATOR (*pc))
+		    name_is_short = false;
+		path = (name_is_short
+			? concat (find_file ("plugin"), "/", arg, ".so", NULL)
+			: xstrdup (arg));
+	      }
+	    bool ok = omnibor_cache_key_file (&ctx, path);
+	    free (path);
+	    if (!ok)
+	      return NULL;
+	  }
+	  break;
+	}
+
+      const char *text = decoded_options[j].orig_option_with_args_text;
+      sha1_process_bytes (text, strlen (text) + 1, &ctx);
+    }
+
+  char *key = XNEWVEC (char, 2 * GITOID_LENGTH_SHA1 + 1);
+  sha1_finish_ctx (&ctx, resblock);
+  omnibor_hex (resblock, GITOID_LENGTH_SHA1, key);
+  return key;
 }
 
-/* Calculate the SHA256 gitoid using the contents of the given file.  */
+/* Return the contents of the file PATH, or NULL if it cannot be read.
+   The caller has to free them.  */
 
-static void
-calculate_sha256_omnibor (FILE *dependency_file, unsigned char resblock[])
+static char *
+omnibor_read_file (const char *path)
 {
-  fseek (dependency_file, 0L, SEEK_END);
-  long file_size = ftell (dependency_file);
-  fseek (dependency_file, 0L, SEEK_SET);
+  FILE *f = fopen (path, "rb");
+  if (f == NULL)
+    return NULL;
 
-  /* This length should be enough for everything up to 64B, which should
-     cover long type.  */
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
+  char *contents = NULL;
+  long size;
+  if (fseek (f, 0L, SEEK_END) == 0
+      && (size = ftell (f)) >= 0
+      && fseek (f, 0L, SEEK_SET) == 0)
+    {
+      contents = XNEWVEC (char, size + 1);
+      if (fread (contents, 1, size, f) == (size_t) size)
+	contents[size] = '\0';
+      else
+	{
+	  free (contents);
+	  contents = NULL;
+	}
+    }
 
-  char *init_data = (char *) xcalloc (1, sizeof (char));
-  omnibor_append_to_string (&init_data, "blob ", strlen (init_data),
-			    strlen ("blob "));
-  omnibor_append_to_string (&init_data, buff_for_file_size, strlen (init_data),
-			    strlen (buff_for_file_size));
-  omnibor_append_to_string (&init_data, "\0", strlen (init_data), 1);
+  fclose (f);
+  return contents;
+}
 
-  char *file_contents = (char *) xcalloc (file_size, sizeof (char));
-  fread (file_contents, 1, file_size, dependency_file);
+/* Copy the contents of the file PATH, which holds diagnostics, to the
+   standard error.  */
 
-  /* Calculate the hash.  */
-  struct sha256_ctx ctx;
+static void
+omnibor_print_file (const char *path)
+{
+  char *contents = omnibor_read_file (path);
+  if (contents)
+    {
+      fputs (contents, stderr);
+      free (contents);
+    }
+}
 
-  sha256_init_ctx (&ctx);
+/* Remove from the file PATH, which holds diagnostics, the escape
+   sequences which color them and turn their URLs into links: the Control
+   Sequence Introducer ones, which end with a byte from '@' to '~', and
+   the Operating System Command ones, which end with BEL or ESC \.
+   Return true on success.  */
 
-  sha256_process_bytes (init_data, strlen (init_data) + 1, &ctx);
-  sha256_process_bytes (file_contents, file_size, &ctx);
+static bool
+omnibor_strip_escapes (const char *path)
+{
+  char *text = omnibor_read_file (path);
+  if (text == NULL)
+    return false;
 
-  sha256_finish_ctx (&ctx, resblock);
+  char *out = text;
+  const char *p = text;
+  while (*p)
+    if (p[0] == '\033' && p[1] == '[')
+      {
+	for (p += 2; *p && (*p < '@' || *p > '~'); p++)
+	  ;
+	if (*p)
+	  p++;
+      }
+    else if (p[0] == '\033' && p[1] == ']')
+      {
+	for (p += 2; *p && *p != '\a' && (p[0] != '\033' || p[1] != '\\');
+	     p++)
+	  ;
+	if (*p == '\a')
+	  p++;
+	else if (*p)
+	  p += 2;
+      }
+    else
+      *out++ = *p++;
 
-  free (file_contents);
-  free (init_data);
+  FILE *f = fopen (path, "wb");
+  bool ok = (f != NULL
+	     && fwrite (text, 1, out - text, f) == (size_t) (out - text));
+  if (f != NULL)
+    ok = fclose (f) == 0 && ok;
+  free (text);
+  return ok;
 }
 
-/* Stores 1 if the -frecord-omnibor=<dir> option is specified in the
-   COLLECT_GCC_OPTIONS environment variable or 0 otherwise, in the
-   memory pointed to by is_omnibor_enabled argument.  If
-   -frecord-omnibor=<dir> is specified, <dir> is stored in the
-   memory pointed to by dir.  */
+/* Copy the file FROM to TO, through a temporary file which is renamed
+   into place, so that TO is either complete or absent.  Return true on
+   success.  */
 
-void
-is_omnibor_option_specified (int *is_omnibor_enabled, char **dir)
+static bool
+omnibor_copy_file (const char *from, const char *to)
 {
-  char *temp = (char *) xcalloc (1, sizeof (char));
-  const char *gcc_options = env.get ("COLLECT_GCC_OPTIONS");
+  FILE *in = fopen (from, "rb");
+  if (in == NULL)
+    return false;
 
-  int old_i = 0, i = 0;
-  while ((i = omnibor_find_char_from_pos (i, ' ', gcc_options)) != -1)
+  char *temp = xasprintf ("%s.%ld.tmp", to, (long) getpid ());
+  FILE *out = fopen (temp, "wb");
+  bool ok = out != NULL;
+  if (ok)
     {
-      omnibor_substr (&temp, old_i, i - old_i, gcc_options);
-      if (strncmp ("'-frecord-omnibor=", temp,
-		   strlen ("'-frecord-omnibor=")) == 0)
-	{
-	  *is_omnibor_enabled = 1;
-	  omnibor_substr (&temp, old_i + 18, i - old_i - 18 - 1, gcc_options);
-	  omnibor_set_contents (dir, temp, strlen (temp));
-	  free (temp);
-	  return;
-	}
-
-      i = i + 1;
-      old_i = i;
+      char *chunk = XNEWVEC (char, OMNIBOR_READ_CHUNK);
+      size_t count;
+      while (ok && (count = fread (chunk, 1, OMNIBOR_READ_CHUNK, in)))
+	ok = fwrite (chunk, 1, count, out) == count;
+      ok = ok && !ferror (in);
+      XDELETEVEC (chunk);
+      ok = fclose (out) == 0 && ok;
     }
+  fclose (in);
 
-  *is_omnibor_enabled = 0;
-  omnibor_set_contents (dir, "", 0);
+  if (ok)
+    ok = rename (temp, to) == 0;
+  if (!ok)
+    remove (temp);
   free (temp);
-  return;
+  return ok;
 }
 
-/* Checks whether to add an assembler option --omnibor-tempfile to the
-   options passed to the assembler.  It is an indication to the assembler
-   that its input is a temporary assembly file generated by GCC during the
-   compilation process whose end result is either an object file or an
-   executable.  That option should be passed only when OmniBOR calculation
-   is enabled for GCC.  */
+/* Convert the first 2 * LEN hex digits of HEX into the LEN bytes of
+   RESBLOCK.  Return false if HEX does not start with that many hex
+   digits.  */
 
-void
-omnibor_assembler_option_check (void)
+static bool
+omnibor_unhex (const char *hex, unsigned len, unsigned char *resblock)
 {
-  int is_omnibor_option_enabled;
-  char *option_dir = (char *) xcalloc (1, sizeof (char));
-  is_omnibor_option_specified (&is_omnibor_option_enabled, &option_dir);
+  for (unsigned i = 0; i != len; i++)
+    {
+      unsigned byte;
+      if (!ISXDIGIT (hex[2 * i]) || !ISXDIGIT (hex[2 * i + 1])
+	  || sscanf (hex + 2 * i, "%2x", &byte) != 1)
+	return false;
+      resblock[i] = byte;
+    }
+  return true;
+}
 
-  if ((have_exactly_c || !have_c) &&
-       strcmp ("c", input_suffix) == 0 &&
-     ((env.get ("OMNIBOR_DIR") && strlen (env.get ("OMNIBOR_DIR")) > 0) ||
-       is_omnibor_option_enabled == 1))
-    add_assembler_option ("--omnibor-tempfile", 18);
-  free (option_dir);
+/* The number of bytes at the end of the incoming pack file which are
+   scanned for a Document file before all of it is.  The Document of a
+   compilation just run is among the last records.  */
+#define OMNIBOR_PACK_RECENT (256 * 1024)
+
+/* Return true if the SHA1 OmniBOR Document file named after the gitoid
+   DOCUMENT is in the OmniBOR directory, either as a separate file or in
+   one of its pack files.  The incoming pack file, which is not indexed,
+   is only scanned in full if the Document is not found otherwise.  */
+
+static bool
+omnibor_document_exists_p (const char *document)
+{
+  char *path = xasprintf ("%s/objects/gitoid_blob_sha1/%.2s/%s", omnibor_dir,
+			  document, document + 2);
+  bool exists = access (path, F_OK) == 0;
+  free (path);
+  if (exists)
+    return true;
+
+  unsigned char gitoid[GITOID_LENGTH_SHA1];
+  return (omnibor_unhex (document, GITOID_LENGTH_SHA1, gitoid)
+	  && (omnibor_pack_find (omnibor_dir, OMNIBOR_PACK_DOCUMENT_SHA1,
+				 gitoid, OMNIBOR_PACK_RECENT)
+	      || omnibor_pack_find (omnibor_dir, OMNIBOR_PACK_DOCUMENT_SHA1,
+				    gitoid, OMNIBOR_PACK_INCOMING_ALL)));
 }
 
-/* Complete the OmniBOR metadata file.  Parameter hash_func must be either
-   0 (SHA1 metadata file) or 1 (SHA256 metadata file).  */
+/* With -frecord-omnibor-pack, move the finished OmniBOR metadata file
+   named after the hex gitoid GITOID, of kind KIND, from the OmniBOR
+   directory into its incoming pack file, as the compiler does with the
+   Document files, unless it is in one of the indexed pack files
+   already.  */
 
 static void
-omnibor_complete_metadata_file (bool omnibor_option_enabled,
-				char *option_dir, int hash_func)
+omnibor_pack_metadata_file (enum omnibor_pack_kind kind, const char *gitoid)
 {
-  if (hash_func != 0 && hash_func != 1)
+  if (!flag_record_omnibor_pack)
     return;
 
-  char *filename_path = (char *) xcalloc (1, sizeof (char));
-  char *new_filename_path = (char *) xcalloc (1, sizeof (char));
-
-  if (omnibor_option_enabled)
-    omnibor_set_contents (&filename_path, option_dir, strlen (option_dir));
-  else
+  unsigned len = (kind == OMNIBOR_PACK_METADATA_SHA1
+		  ? GITOID_LENGTH_SHA1 : GITOID_LENGTH_SHA256);
+  char *path = concat (omnibor_dir, "/metadata/gnu/gitoid_blob_",
+		       len == GITOID_LENGTH_SHA1 ? "sha1/" : "sha256/",
+		       gitoid, NULL);
+  unsigned char resblock[GITOID_LENGTH_SHA256];
+  char *contents;
+  if (strlen (gitoid) == 2 * len
+      && omnibor_unhex (gitoid, len, resblock)
+      && (contents = omnibor_read_file (path)) != NULL)
     {
-      const char *env_omnibor = env.get ("OMNIBOR_DIR");
-      if (env_omnibor != NULL)
-	omnibor_set_contents (&filename_path, env_omnibor, strlen (env_omnibor));
-      else
-	{
-	  free (new_filename_path);
-	  free (filename_path);
-	  return;
-	}
+      if (omnibor_pack_find (omnibor_dir, kind, resblock, 0)
+	  || omnibor_pack_append (omnibor_dir, kind, resblock, contents,
+				  strlen (contents)))
+	remove (path);
+      free (contents);
     }
+  free (path);
+}
+
+/* Compare the gitoids pointed to by A and B, for qsort.  */
+
+static int
+omnibor_gitoid_cmp (const void *a, const void *b)
+{
+  return strcmp (*(const char *const *) a, *(const char *const *) b);
+}
 
-  if (strcmp ("", filename_path) == 0)
+/* Store the object file OUTPUT, with the SHA1 and SHA256 gitoids
+   SHA1_GITOID and SHA256_GITOID, in the OmniBOR cache under KEY.  Its
+   inputs are taken from its SHA1 OmniBOR metadata file.  The standard
+   error of its compilation is in the file STDERR_FILE, the paths of the
+   compiler programs which ran it are listed one per line in PROGRAMS,
+   and what else its output depends on in the file PROBES_FILE.  */
+
+static void
+omnibor_cache_store (const char *key, const char *output,
+		     const char *sha1_gitoid, const char *sha256_gitoid,
+		     const char *stderr_file, const char *programs,
+		     const char *probes_file)
+{
+  /* Without the complete probes, or with an output which depends on the
+     time, a later compilation cannot be known to have the same result.
+     Each probe ends with a newline.  */
+  char *probes = omnibor_read_file (probes_file);
+  if (probes == NULL)
+    return;
+  for (const char *p = probes; *p; p = strchr (p, '\n') + 1)
+    if (strncmp (p, "time\n", strlen ("time\n")) == 0
+	|| strchr (p, '\n') == NULL)
+      {
+	free (probes);
+	return;
+      }
+
+  char *sha1_metadata = concat (omnibor_dir, "/metadata/gnu/gitoid_blob_sha1/",
+				sha1_gitoid, NULL);
+  char *sha256_metadata = concat (omnibor_dir,
+				  "/metadata/gnu/gitoid_blob_sha256/",
+				  sha256_gitoid, NULL);
+  char *metadata = omnibor_read_file (sha1_metadata);
+  if (metadata == NULL)
     {
-      free (new_filename_path);
-      free (filename_path);
+      free (sha256_metadata);
+      free (sha1_metadata);
       return;
     }
 
-  omnibor_append_to_string (&filename_path, "/metadata/gnu/",
-			    strlen (filename_path), strlen ("/metadata/gnu/"));
-
-  if (hash_func == 0)
-    omnibor_append_to_string (&filename_path, "gitoid_blob_sha1/",
-			      strlen (filename_path),
-			      strlen ("gitoid_blob_sha1/"));
-  else
-    omnibor_append_to_string (&filename_path, "gitoid_blob_sha256/",
-			      strlen (filename_path),
-			      strlen ("gitoid_blob_sha256/"));
-
-  char *output_file_name = (char *) xcalloc (1, sizeof (char));
-  /* Also create a variable for the name part of the path of the output file,
-     stripped off of the directory part, if it exists.  */
-  char *output_file_name_strip = (char *) xcalloc (1, sizeof (char));
-
-  /* Option -o is not specified, so the name of the output file has to
-     to be deducted from the input file or be a.out in the case when
-     linking is done as well.  */
-  if (output_file == NULL || strcmp ("", output_file) == 0)
-    {
-      /* Case when linking is done as well.  */
-      if (!have_c)
-	omnibor_set_contents (&output_file_name, "a.out", strlen ("a.out"));
-      /* Case when -c option is used.  */
-      else if (have_exactly_c)
-	{
-	  /* TODO: Apart from supporting input file extensions with one
-	     character, support also '.cpp' extension.  */
-	  int start =
-		omnibor_find_last_char_from_pos (0, '/',
-						 omnibor_current_input_file)
-		+ 1;
-	  omnibor_substr (&output_file_name, start,
-			  strlen (omnibor_current_input_file) - 2 - start,
-			  omnibor_current_input_file);
-	  omnibor_append_to_string (&output_file_name, ".o",
-				    strlen (output_file_name),
-				    strlen (".o"));
-	}
-      /* Case when -E option is used.  In this case, the output file
-	 does not exist, because the preprocessed file will be
-	 outputed to stdout or stderr.  */
-      else if (have_E)
+  /* Collect the inputs, and recompute the gitoid of the Document file
+     from theirs, in the same way as the compiler does.  */
+  static const char infile_tag[] = "infile: ";
+  static const char path_tag[] = " path: ";
+  auto_vec<const char *> gitoids;
+  struct obstack manifest;
+  obstack_init (&manifest);
+  for (char *line = metadata; line && *line; )
+    {
+      char *next = strchr (line, '\n');
+      if (next)
+	*next++ = '\0';
+      if (strncmp (line, infile_tag, sizeof (infile_tag) - 1) == 0)
 	{
-	  free (output_file_name_strip);
-	  free (output_file_name);
-	  free (new_filename_path);
-	  free (filename_path);
-	  return;
+	  char *gitoid = line + sizeof (infile_tag) - 1;
+	  char *path = strstr (gitoid, path_tag);
+	  if (path)
+	    {
+	      *path = '\0';
+	      path += sizeof (path_tag) - 1;
+	      gitoids.safe_push (gitoid);
+	      obstack_grow (&manifest, "infile ", strlen ("infile "));
+	      obstack_grow (&manifest, gitoid, strlen (gitoid));
+	      obstack_1grow (&manifest, ' ');
+	      obstack_grow (&manifest, path, strlen (path));
+	      obstack_1grow (&manifest, '\n');
+	    }
 	}
-      /* Case when -S option is used.  */
-      else
+      line = next;
+    }
+
+  /* The compiler programs are checked like the inputs.  */
+  bool ok = true;
+  for (const char *p = programs; ok && p && *p; )
+    {
+      const char *end = strchr (p, '\n');
+      char *path = xstrndup (p, end - p);
+      unsigned char resblock[GITOID_LENGTH_SHA1];
+      char hex[2 * GITOID_LENGTH_SHA1 + 1];
+      ok = omnibor_file_sha1_gitoid (omnibor_dir, path, resblock);
+      if (ok)
 	{
-	  /* TODO: Apart from supporting input file extensions with one
-	     character, support also '.cpp' extension.  */
-	  int start =
-		omnibor_find_last_char_from_pos (0, '/',
-						 omnibor_current_input_file)
-		+ 1;
-	  omnibor_substr (&output_file_name, start,
-			  strlen (omnibor_current_input_file) - 2 - start,
-			  omnibor_current_input_file);
-	  omnibor_append_to_string (&output_file_name, ".s",
-				    strlen (output_file_name),
-				    strlen (".s"));
+	  omnibor_hex (resblock, GITOID_LENGTH_SHA1, hex);
+	  obstack_grow (&manifest, "program ", strlen ("program "));
+	  obstack_grow (&manifest, hex, strlen (hex));
+	  obstack_1grow (&manifest, ' ');
+	  obstack_grow (&manifest, path, strlen (path));
+	  obstack_1grow (&manifest, '\n');
 	}
-      omnibor_set_contents (&output_file_name_strip, output_file_name,
-			    strlen (output_file_name));
+      free (path);
+      p = end + 1;
     }
-  /* Option -o is specified, so the name of the output file is taken from
-     that option.  */
-  else
-    {
-      omnibor_set_contents (&output_file_name, output_file,
-			    strlen (output_file));
 
-      /* Extract the name part of the path of the output file.  */
+  /* The probes are "absent <path>" lines, which go to the manifest as
+     they are.  */
+  static const char absent_tag[] = "absent ";
+  for (const char *p = probes; *p; )
+    {
+      const char *end = strchr (p, '\n') + 1;
+      if (strncmp (p, absent_tag, sizeof (absent_tag) - 1) == 0)
+	obstack_grow (&manifest, p, end - p);
+      p = end;
+    }
+  obstack_1grow (&manifest, '\0');
+  char *infiles = XOBFINISH (&manifest, char *);
 
-      int pos = omnibor_find_last_char_from_pos (0, '/', output_file);
-      if (pos == -1)
-	omnibor_set_contents (&output_file_name_strip, output_file,
-			      strlen (output_file));
-      else if ((long unsigned) pos + 1 < strlen (output_file))
-	{
-	  char *output_file_strip = (char *) xcalloc (1, sizeof (char));
-	  omnibor_substr (&output_file_strip, pos + 1,
-			  strlen (output_file) - pos - 1,
-			  output_file);
-	  omnibor_set_contents (&output_file_name_strip, output_file_strip,
-				strlen (output_file_strip));
-	  free (output_file_strip);
-	}
-      else
+  gitoids.qsort (omnibor_gitoid_cmp);
+  struct sha1_ctx ctx;
+  unsigned char resblock[GITOID_LENGTH_SHA1];
+  char document[2 * GITOID_LENGTH_SHA1 + 1];
+  static const char header[] = "gitoid:blob:sha1\n";
+  size_t len = sizeof (header) - 1;
+  for (unsigned i = 0; i != gitoids.length (); i++)
+    len += strlen ("blob \n") + strlen (gitoids[i]);
+  char init_data[MAX_FILE_SIZE_STRING_LENGTH];
+  int init_len = snprintf (init_data, sizeof (init_data), "blob %lu",
+			   (unsigned long) len);
+  sha1_init_ctx (&ctx);
+  sha1_process_bytes (init_data, init_len + 1, &ctx);
+  sha1_process_bytes (header, sizeof (header) - 1, &ctx);
+  for (unsigned i = 0; i != gitoids.length (); i++)
+    {
+      sha1_process_bytes ("blob ", strlen ("blob "), &ctx);
+      sha1_process_bytes (gitoids[i], strlen (gitoids[i]), &ctx);
+      sha1_process_bytes ("\n", 1, &ctx);
+    }
+  sha1_finish_ctx (&ctx, resblock);
+  omnibor_hex (resblock, GITOID_LENGTH_SHA1, document);
+
+  /* The Document may differ, for example when it refers to the Documents
+     of imported modules; then the compilation is not cached.  */
+  if (ok && omnibor_document_exists_p (document))
+    {
+      char *objects = concat (omnibor_cache_dir, "/objects", NULL);
+      char *manifests = concat (omnibor_cache_dir, "/manifests", NULL);
+      mkdir (omnibor_cache_dir, 0777);
+      mkdir (objects, 0777);
+      mkdir (manifests, 0777);
+
+      char *entry = concat (objects, "/", key, "-", document, NULL);
+      char *entry_o = concat (entry, ".o", NULL);
+      char *entry_sha1 = concat (entry, ".sha1", NULL);
+      char *entry_sha256 = concat (entry, ".sha256", NULL);
+      char *entry_err = concat (entry, ".err", NULL);
+      char *manifest_path = concat (manifests, "/", key, NULL);
+      char *temp = xasprintf ("%s.%ld.tmp", manifest_path, (long) getpid ());
+
+      /* Write the manifest last, so that it only refers to complete
+	 entries.  */
+      FILE *f;
+      if (omnibor_copy_file (output, entry_o)
+	  && omnibor_copy_file (sha1_metadata, entry_sha1)
+	  && omnibor_copy_file (sha256_metadata, entry_sha256)
+	  && omnibor_strip_escapes (stderr_file)
+	  && omnibor_copy_file (stderr_file, entry_err)
+	  && (f = fopen (temp, "wb")) != NULL)
 	{
-	  free (output_file_name_strip);
-	  free (output_file_name);
-	  free (new_filename_path);
-	  free (filename_path);
-	  return;
+	  fprintf (f, "document %s\nobject %s %s\n", document, sha1_gitoid,
+		   sha256_gitoid);
+	  fputs (infiles, f);
+	  if ((fclose (f) != 0 || rename (temp, manifest_path) != 0))
+	    remove (temp);
 	}
+
+      free (temp);
+      free (manifest_path);
+      free (entry_err);
+      free (entry_sha256);
+      free (entry_sha1);
+      free (entry_o);
+      free (entry);
+      free (manifests);
+      free (objects);
     }
 
-  /* Remember the directory part of the metadata file so that renaming of that
-     file later is easier.  */
-  omnibor_set_contents (&new_filename_path, filename_path,
-			strlen (filename_path));
-  omnibor_append_to_string (&filename_path, output_file_name_strip,
-			    strlen (filename_path),
-			    strlen (output_file_name_strip));
-  omnibor_append_to_string (&filename_path, ".metadata", strlen (filename_path),
-			    strlen (".metadata"));
+  obstack_free (&manifest, NULL);
+  free (metadata);
+  free (sha256_metadata);
+  free (sha1_metadata);
+  free (probes);
+}
 
-  FILE *metadata_file = fopen (filename_path, "rb+");
-  if (metadata_file != NULL)
-    {
-      static const char *const lut = "0123456789abcdef";
-      char *gitoid_output_file = (char *) xcalloc (1, sizeof (char));
-      char *high_ch = (char *) xmalloc (sizeof (char) * 2);
-      high_ch[1] = '\0';
-      char *low_ch = (char *) xmalloc (sizeof (char) * 2);
-      low_ch[1] = '\0';
+/* Look up the compilation of INPUT in the OmniBOR cache under KEY.  If
+   none of the inputs and compiler programs listed in its manifest has
+   changed, and none of the headers it looked for in vain has appeared
+   since, copy the cached object file to the output file, and its
+   OmniBOR metadata files to the OmniBOR directory unless they are there
+   already, print its diagnostics again and return true.  */
 
-      FILE *output_file_handle = fopen (output_file_name, "rb");
-      if (output_file_handle == NULL)
+static bool
+omnibor_cache_lookup (const char *key, const char *input)
+{
+  char *manifest_path = concat (omnibor_cache_dir, "/manifests/", key, NULL);
+  char *manifest = omnibor_read_file (manifest_path);
+  free (manifest_path);
+  if (manifest == NULL)
+    return false;
+
+  static const char document_tag[] = "document ";
+  static const char object_tag[] = "object ";
+  static const char infile_tag[] = "infile ";
+  static const char program_tag[] = "program ";
+  static const char absent_tag[] = "absent ";
+  const char *document = NULL, *sha1_gitoid = NULL, *sha256_gitoid = NULL;
+  bool ok = true;
+  for (char *line = manifest; ok && line && *line; )
+    {
+      char *next = strchr (line, '\n');
+      if (next)
+	*next++ = '\0';
+
+      if (strncmp (line, document_tag, sizeof (document_tag) - 1) == 0)
+	document = line + sizeof (document_tag) - 1;
+      else if (strncmp (line, object_tag, sizeof (object_tag) - 1) == 0)
 	{
-	  free (low_ch);
-	  free (high_ch);
-	  free (gitoid_output_file);
-	  fclose (metadata_file);
-	  free (output_file_name_strip);
-	  free (output_file_name);
-	  free (new_filename_path);
-	  free (filename_path);
-	  return;
+	  char *sep;
+	  sha1_gitoid = line + sizeof (object_tag) - 1;
+	  ok = (sep = strchr (line + sizeof (object_tag) - 1, ' ')) != NULL;
+	  if (ok)
+	    {
+	      *sep = '\0';
+	      sha256_gitoid = sep + 1;
+	    }
 	}
-
-      if (hash_func == 0)
+      else if (strncmp (line, infile_tag, sizeof (infile_tag) - 1) == 0
+	       || strncmp (line, program_tag, sizeof (program_tag) - 1) == 0)
 	{
+	  /* Check that the input or compiler program still has the
+	     recorded contents.  The gitoids are taken from the persistent
+	     gitoid cache, as the compiler does, so that only the files
+	     which have changed since they were last hashed are read.  */
+	  char *gitoid = strchr (line, ' ') + 1;
+	  char *path = strchr (gitoid, ' ');
 	  unsigned char resblock[GITOID_LENGTH_SHA1];
+	  char hex[2 * GITOID_LENGTH_SHA1 + 1];
+	  ok = (path != NULL
+		&& omnibor_file_sha1_gitoid (omnibor_dir, path + 1, resblock));
+	  if (ok)
+	    {
+	      *path = '\0';
+	      omnibor_hex (resblock, GITOID_LENGTH_SHA1, hex);
+	      ok = strcmp (hex, gitoid) == 0;
+	    }
+	}
+      else if (strncmp (line, absent_tag, sizeof (absent_tag) - 1) == 0)
+	ok = access (line + sizeof (absent_tag) - 1, F_OK) != 0;
+      line = next;
+    }
 
-	  calculate_sha1_omnibor (output_file_handle, resblock);
+  char *output = NULL;
+  ok = (ok && document && sha1_gitoid && sha256_gitoid
+	&& strlen (document) == 2 * GITOID_LENGTH_SHA1
+	&& omnibor_document_exists_p (document)
+	&& (output = omnibor_output_file_name (input)) != NULL);
+  if (ok)
+    {
+      char *entry = concat (omnibor_cache_dir, "/objects/", key, "-",
+			    document, NULL);
+      char *entry_o = concat (entry, ".o", NULL);
+      ok = omnibor_copy_file (entry_o, output);
 
-	  for (unsigned i = 0; i != GITOID_LENGTH_SHA1; ++i)
+      if (ok)
+	{
+	  const char *kinds[] = { "sha1", "sha256" };
+	  const char *gitoids[] = { sha1_gitoid, sha256_gitoid };
+	  const enum omnibor_pack_kind pack_kinds[]
+	    = { OMNIBOR_PACK_METADATA_SHA1, OMNIBOR_PACK_METADATA_SHA256 };
+	  for (unsigned i = 0; i != ARRAY_SIZE (kinds); i++)
 	    {
-	      high_ch[0] = lut[resblock[i] >> 4];
-	      low_ch[0] = lut[resblock[i] & 15];
-	      omnibor_append_to_string (&gitoid_output_file, high_ch,
-					i * 2, 2);
-	      omnibor_append_to_string (&gitoid_output_file, low_ch,
-					i * 2 + 1, 2);
+	      char *metadata = concat (omnibor_dir,
+				       "/metadata/gnu/gitoid_blob_", kinds[i],
+				       "/", gitoids[i], NULL);
+	      if (access (metadata, F_OK) != 0)
+		{
+		  char *entry_metadata = concat (entry, ".", kinds[i], NULL);
+		  if (omnibor_copy_file (entry_metadata, metadata))
+		    omnibor_pack_metadata_file (pack_kinds[i], gitoids[i]);
+		  free (entry_metadata);
+		}
+	      free (metadata);
 	    }
 
-	  omnibor_append_to_string (&new_filename_path, gitoid_output_file,
-				    strlen (new_filename_path),
-				    2 * GITOID_LENGTH_SHA1);
-
-	  /* Add the gitoid of the output file in the appropriate place.  */
-
-	  fseek (metadata_file, 0L, SEEK_END);
-	  long file_size = ftell (metadata_file);
-	  fseek (metadata_file, strlen ("outfile: "), SEEK_SET);
-	  long left_size = file_size - strlen ("outfile: ");
-	  char *temp_buffer = (char *) xmalloc (sizeof (char) * left_size);
-	  fread (temp_buffer, sizeof (char), left_size, metadata_file);
-	  fseek (metadata_file, strlen ("outfile: "), SEEK_SET);
-	  fwrite (gitoid_output_file, sizeof (char),
-		  2 * GITOID_LENGTH_SHA1, metadata_file);
-	  fwrite (temp_buffer, sizeof (char), left_size, metadata_file);
-	  free (temp_buffer);
-
-	  /* Add the build command line in the appropriate place.  */
-
-	  fseek (metadata_file, 0L, SEEK_END);
-	  if (omnibor_build_cmd)
-	    fwrite (omnibor_build_cmd, sizeof (char),
-		    strlen (omnibor_build_cmd), metadata_file);
-	  else
-	    fwrite ("not available", sizeof (char),
-		    strlen ("not available"), metadata_file);
+	  if (verbose_flag)
+	    fnotice (stderr, "Reusing %s from the OmniBOR cache for %s\n",
+		     entry_o, input);
 
-	  fwrite ("\n==== End of raw info for this process\n",
-		  sizeof (char),
-		  strlen ("\n==== End of raw info for this process\n"),
-		  metadata_file);
+	  char *entry_err = concat (entry, ".err", NULL);
+	  omnibor_print_file (entry_err);
+	  free (entry_err);
 	}
-      else
-	{
-	  unsigned char resblock[GITOID_LENGTH_SHA256];
 
-	  calculate_sha256_omnibor (output_file_handle, resblock);
+      free (entry_o);
+      free (entry);
+    }
+
+  free (output);
+  free (manifest);
+  return ok;
+}
 
-	  for (unsigned i = 0; i != GITOID_LENGTH_SHA256; ++i)
-	    {
-	      high_ch[0] = lut[resblock[i] >> 4];
-	      low_ch[0] = lut[resblock[i] & 15];
-	      omnibor_append_to_string (&gitoid_output_file, high_ch,
-					i * 2, 2);
-	      omnibor_append_to_string (&gitoid_output_file, low_ch,
-					i * 2 + 1, 2);
-	    }
+/* When collect2 records the inputs of a link in OmniBOR, it names in the
+   COLLECT_OMNIBOR_LTRANS environment variable a file in which the
+   compilations of LTO IR run by lto-wrapper list their output files, one
+   "<SHA1 gitoid> <SHA256 gitoid> <path>" line each.  The LTRANS units are
+   thus hashed by the jobs which produce them, in parallel when
+   lto-wrapper runs them with make and its jobserver.  Append the line of
+   the output file of this compilation, if it is one of those.  */
 
-	  omnibor_append_to_string (&new_filename_path, gitoid_output_file,
-				    strlen (new_filename_path),
-				    2 * GITOID_LENGTH_SHA256);
-
-	  /* Add the gitoid of the output file in the appropriate place.  */
-
-	  fseek (metadata_file, 0L, SEEK_END);
-	  long file_size = ftell (metadata_file);
-	  fseek (metadata_file, strlen ("outfile: "), SEEK_SET);
-	  long left_size = file_size - strlen ("outfile: ");
-	  char *temp_buffer = (char *) xmalloc (sizeof (char) * left_size);
-	  fread (temp_buffer, sizeof (char), left_size, metadata_file);
-	  fseek (metadata_file, strlen ("outfile: "), SEEK_SET);
-	  fwrite (gitoid_output_file, sizeof (char),
-		  2 * GITOID_LENGTH_SHA256, metadata_file);
-	  fwrite (temp_buffer, sizeof (char), left_size, metadata_file);
-	  free (temp_buffer);
-
-	  /* Add the build command line in the appropriate place.  */
-
-	  fseek (metadata_file, 0L, SEEK_END);
-	  if (omnibor_build_cmd)
-	    fwrite (omnibor_build_cmd, sizeof (char),
-		    strlen (omnibor_build_cmd), metadata_file);
-	  else
-	    fwrite ("not available", sizeof (char),
-		    strlen ("not available"), metadata_file);
+static void
+omnibor_list_lto_output (void)
+{
+  const char *list = env.get ("COLLECT_OMNIBOR_LTRANS");
+  if (list == NULL || *list == '\0' || seen_error ()
+      || output_file == NULL || strcmp (output_file, "-") == 0)
+    return;
 
-	  fwrite ("\n==== End of raw info for this process\n",
-		  sizeof (char),
-		  strlen ("\n==== End of raw info for this process\n"),
-		  metadata_file);
-	}
+  /* The WPA stage has no output file of its own.  */
+  bool lto_input = false;
+  for (int i = 0; i < n_infiles; i++)
+    if (infiles[i].language && strcmp (infiles[i].language, "lto") == 0)
+      lto_input = true;
+  if (!lto_input)
+    return;
 
-      fclose (output_file_handle);
-      free (low_ch);
-      free (high_ch);
-      free (gitoid_output_file);
-      fclose (metadata_file);
+  FILE *output_file_handle = fopen (output_file, "rb");
+  if (output_file_handle == NULL)
+    return;
 
-      /* Check if a file with the name equal to the new name for the
-	 metadata file already exists.  That is the case when GCC invokes
-	 linker and OmniBOR calculation is enabled there as well, because
-	 both GCC and linker have the same output file, hence the same
-	 gitoid is used to name the metadata file in both tools.  In that
-	 case, remove the file created by linker (for now) before
-	 renaming metadata file in GCC.  */
-      FILE *fp = fopen (new_filename_path, "r");
-      if (fp != NULL)
-	{
-	  fclose (fp);
-	  remove (new_filename_path);
-	}
+  unsigned char resblock_sha1[GITOID_LENGTH_SHA1];
+  unsigned char resblock_sha256[GITOID_LENGTH_SHA256];
+  char sha1_gitoid[2 * GITOID_LENGTH_SHA1 + 1];
+  char sha256_gitoid[2 * GITOID_LENGTH_SHA256 + 1];
 
-      rename (filename_path, new_filename_path);
+  bool ok = calculate_omnibor_gitoids (output_file_handle, resblock_sha1,
+				       resblock_sha256);
+  fclose (output_file_handle);
+  if (!ok)
+    return;
+  omnibor_hex (resblock_sha1, GITOID_LENGTH_SHA1, sha1_gitoid);
+  omnibor_hex (resblock_sha256, GITOID_LENGTH_SHA256, sha256_gitoid);
+
+  /* Write the line at once, so that the lines of the jobs which run in
+     parallel are not interleaved.  */
+  char *line = concat (sha1_gitoid, " ", sha256_gitoid, " ", output_file,
+		       "\n", NULL);
+  int fd = open (list, O_WRONLY | O_APPEND | O_BINARY);
+  if (fd != -1)
+    {
+      if (write (fd, line, strlen (line)) < 0)
+	warning (0, "cannot write to %qs: %m", list);
+      close (fd);
     }
+  free (line);
+}
 
-  free (output_file_name_strip);
-  free (output_file_name);
-  free (new_filename_path);
-  free (filename_path);
+/* Complete the OmniBOR metadata files of the compilation of INPUT, and
+   store its result in the OmniBOR cache if it was run to be stored there,
+   as recorded in INFILE (which may be NULL), under the key given by the
+   options DECODED_OPTIONS.  */
+
+static void
+omnibor_finish_compilation (const char *input, const struct infile *infile,
+			    const struct cl_decoded_option *decoded_options,
+			    unsigned int decoded_options_count)
+{
+  char sha1_gitoid[2 * GITOID_LENGTH_SHA1 + 1];
+  char sha256_gitoid[2 * GITOID_LENGTH_SHA256 + 1];
+
+  if (!omnibor_complete_metadata_files (input, sha1_gitoid, sha256_gitoid))
+    return;
+
+  /* The cache entry is made from the separate metadata files, so they
+     are packed afterwards.  */
+  char *key = NULL;
+  if (omnibor_cache_p () && infile != NULL && infile->omnibor_stderr != NULL)
+    key = omnibor_cache_key (decoded_options, decoded_options_count, input);
+  if (key != NULL)
+    {
+      char *output = omnibor_output_file_name (input);
+      omnibor_cache_store (key, output, sha1_gitoid, sha256_gitoid,
+			   infile->omnibor_stderr, infile->omnibor_programs,
+			   infile->omnibor_probes);
+      free (output);
+      free (key);
+    }
+
+  omnibor_pack_metadata_file (OMNIBOR_PACK_METADATA_SHA1, sha1_gitoid);
+  omnibor_pack_metadata_file (OMNIBOR_PACK_METADATA_SHA256, sha256_gitoid);
+}
+
+/* Store the user and system times used by the driver itself so far, in
+   seconds, in *UT and *ST.  */
+
+static void
+omnibor_get_times (double *ut, double *st)
+{
+#ifdef HAVE_GETRUSAGE
+  struct rusage rusage;
+  if (getrusage (RUSAGE_SELF, &rusage) == 0)
+    {
+      *ut = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1.0e6;
+      *st = rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1.0e6;
+      return;
+    }
+#endif
+  *ut = get_run_time () / 1.0e6;
+  *st = 0;
+}
+
+/* Report the times the driver spent finishing the OmniBOR information
+   since UT0 and ST0, as the times of the commands it runs are reported
+   with -time and -time=.  */
+
+static void
+omnibor_report_times (double ut0, double st0)
+{
+  double ut, st;
+  omnibor_get_times (&ut, &st);
+  ut -= ut0;
+  st -= st0;
+
+  if (report_times)
+    fnotice (stderr, "# %s %.2f %.2f\n", "omnibor", ut, st);
+  if (report_times_to_file)
+    fprintf (report_times_to_file, "%g %g %s\n", ut, st, "omnibor");
 }
 
 /* If OmniBOR concept is enabled, finish the OmniBOR metadata files
    properly here.  That includes putting the gitoid of the output file
    in the proper place in the metadata file, renaming the metadata file
    with that gitoid and adding the build command line in the proper
-   place as well.  */
+   place as well.  The results of the compilations are then stored in
+   the OmniBOR cache, if it is enabled.  The outputs of the compilations
+   of LTO IR are listed for collect2 whether or not the OmniBOR
+   directory is known here.  */
 
 void
 driver::maybe_finish_omnibor_work () const
 {
-  int is_omnibor_option_enabled;
-  char *option_dir = (char *) xcalloc (1, sizeof (char));
-  is_omnibor_option_specified (&is_omnibor_option_enabled, &option_dir);
-  if (is_omnibor_option_enabled == 1
-      || (env.get ("OMNIBOR_DIR") && strlen (env.get ("OMNIBOR_DIR")) > 0))
+  omnibor_list_lto_output ();
+
+  if (omnibor_dir != NULL)
     {
-      omnibor_current_input_file = (char *) xcalloc (1, sizeof (char));
+      double ut0 = 0, st0 = 0;
+      if (report_times || report_times_to_file)
+	omnibor_get_times (&ut0, &st0);
 
       if (n_infiles > 1 && (have_c && !have_E))
 	for (int i = 0; i < n_infiles; ++i)
-	  {
-	    omnibor_set_contents (&omnibor_current_input_file,
-				  infiles[i].name, strlen (infiles[i].name));
-	    omnibor_complete_metadata_file (is_omnibor_option_enabled == 1,
-					    option_dir, 0);
-	    omnibor_complete_metadata_file (is_omnibor_option_enabled == 1,
-					    option_dir, 1);
-	  }
+	  omnibor_finish_compilation (infiles[i].name, &infiles[i],
+				      decoded_options, decoded_options_count);
       else
+	omnibor_finish_compilation (gcc_input_filename,
+				    n_infiles == 1 ? &infiles[0] : NULL,
+				    decoded_options, decoded_options_count);
+
+      if (omnibor_build_cmd)
 	{
-	  if (have_c && !have_E)
-	    omnibor_set_contents (&omnibor_current_input_file,
-				  gcc_input_filename,
-				  strlen (gcc_input_filename));
-	  omnibor_complete_metadata_file (is_omnibor_option_enabled == 1,
-					  option_dir, 0);
-	  omnibor_complete_metadata_file (is_omnibor_option_enabled == 1,
-					  option_dir, 1);
+	  obstack_free (&omnibor_obstack, NULL);
+	  omnibor_build_cmd = NULL;
 	}
 
-      free (omnibor_current_input_file);
-
-      if (omnibor_build_cmd)
-	free (omnibor_build_cmd);
+      if (report_times || report_times_to_file)
+	omnibor_report_times (ut0, st0);
     }
-  free (option_dir);
 }
 
 driver::driver (bool can_finalize, bool debug) :
@@ -8678,24 +9308,26 @@ driver::decode_argv (int argc, const char **argv)
   for (i = 0; i < argc; ++i)
     if (!strncmp (argv[i], "-frecord-omnibor=",
 		  strlen ("-frecord-omnibor=")))
-      is_omnibor_option_enabled = true;
+      {
+	is_omnibor_option_enabled = true;
+	if (argv[i][strlen ("-frecord-omnibor=")] != '\0')
+	  omnibor_dir = argv[i] + strlen ("-frecord-omnibor=");
+      }
+  if (omnibor_dir == NULL
+      && env.get ("OMNIBOR_DIR") && strlen (env.get ("OMNIBOR_DIR")) > 0)
+    omnibor_dir = env.get ("OMNIBOR_DIR");
 
-  if (is_omnibor_option_enabled ||
-     (env.get ("OMNIBOR_DIR") && strlen (env.get ("OMNIBOR_DIR")) > 0))
+  if (is_omnibor_option_enabled || omnibor_dir != NULL)
     {
-      omnibor_build_cmd = (char *) xcalloc (1, sizeof (char));
-      omnibor_append_to_string (&omnibor_build_cmd, argv[0],
-				strlen (omnibor_build_cmd),
-				strlen (argv[0]));
+      obstack_init (&omnibor_obstack);
+      obstack_grow (&omnibor_obstack, argv[0], strlen (argv[0]));
       for (i = 1; i < argc; ++i)
 	{
-	  omnibor_append_to_string (&omnibor_build_cmd, " ",
-				    strlen (omnibor_build_cmd),
-				    strlen (" "));
-	  omnibor_append_to_string (&omnibor_build_cmd, argv[i],
-				    strlen (omnibor_build_cmd),
-				    strlen (argv[i]));
+	  obstack_1grow (&omnibor_obstack, ' ');
+	  obstack_grow (&omnibor_obstack, argv[i], strlen (argv[i]));
 	}
+      obstack_1grow (&omnibor_obstack, '\0');
+      omnibor_build_cmd = XOBFINISH (&omnibor_obstack, char *);
     }
 }
 
@@ -9358,6 +9990,9 @@ driver::prepare_infiles ()
 	}
       infiles[i].compiled = false;
       infiles[i].preprocessed = false;
+      infiles[i].omnibor_stderr = NULL;
+      infiles[i].omnibor_programs = NULL;
+      infiles[i].omnibor_probes = NULL;
     }
 
   if (!combine_inputs && have_c && have_o && lang_n_infiles > 1)
@@ -9421,7 +10056,40 @@ driver::do_spec_on_infiles () const
 		  debug_check_temp_file[1] = NULL;
 		}
 
-	      value = do_spec (input_file_compiler->spec);
+	      /* With the OmniBOR cache, a compilation whose inputs have
+		 not changed need not be run again.  */
+	      char *key = NULL;
+	      if (omnibor_cache_p ())
+		key = omnibor_cache_key (decoded_options,
+					 decoded_options_count,
+					 infiles[i].name);
+	      if (key && omnibor_cache_lookup (key, infiles[i].name))
+		value = 0;
+	      else if (key)
+		{
+		  /* Keep what the result is stored with in the cache.  */
+		  omnibor_cache_stderr = make_temp_file (".err");
+		  record_temp_file (omnibor_cache_stderr, 1, 0);
+		  /* The probes file exists only if the compiler wrote it.  */
+		  omnibor_cache_probes = make_temp_file (".probes");
+		  record_temp_file (omnibor_cache_probes, 1, 0);
+		  remove (omnibor_cache_probes);
+		  /* Only the last of piped commands can have its standard
+		     error read by execute.  */
+		  int saved_use_pipes = use_pipes;
+		  use_pipes = 0;
+		  value = do_spec (input_file_compiler->spec);
+		  use_pipes = saved_use_pipes;
+		  infiles[i].omnibor_stderr = omnibor_cache_stderr;
+		  infiles[i].omnibor_programs = omnibor_cache_programs;
+		  infiles[i].omnibor_probes = omnibor_cache_probes;
+		  omnibor_cache_stderr = NULL;
+		  omnibor_cache_programs = NULL;
+		  omnibor_cache_probes = NULL;
+		}
+	      else
+		value = do_spec (input_file_compiler->spec);
+	      free (key);
 	      infiles[i].compiled = true;
 	      if (value < 0)
 		this_file_error = 1;
@@ -11030,6 +11698,54 @@ find_plugindir_spec_function (int argc, const char **argv ATTRIBUTE_UNUSED)
   return option;
 }
 
+/* %:omnibor-options spec function.  When OmniBOR calculation is enabled,
+   pass the OmniBOR directory and the path of the file which the
+   compilation of the current input file finally produces to the
+   compiler proper, so that it does not have to work them out from
+   COLLECT_GCC_OPTIONS, and the file to write the probes of the
+   OmniBOR cache to, if the result may be stored there.  The standard
+   error of the compiler proper is then a pipe, so whether to color the
+   diagnostics and link their URLs is decided here instead, from the
+   terminal of the driver.  */
+static const char *
+omnibor_options_spec_function (int argc, const char **argv ATTRIBUTE_UNUSED)
+{
+  if (argc != 0)
+    abort ();
+
+  if (omnibor_dir == NULL)
+    return NULL;
+
+  char *dir = quote_spec (xstrdup (omnibor_dir));
+  char *outfile = omnibor_output_file_name (gcc_input_filename);
+  char *option;
+  if (outfile != NULL)
+    {
+      outfile = quote_spec (outfile);
+      option = concat ("-frecord-omnibor=", dir,
+		       " -frecord-omnibor-outfile=", outfile, NULL);
+      free (outfile);
+    }
+  else
+    option = concat ("-frecord-omnibor=", dir, NULL);
+  free (dir);
+
+  if (omnibor_cache_probes != NULL)
+    {
+      char *probes = quote_spec (xstrdup (omnibor_cache_probes));
+      option = reconcat (option, option, " -fomnibor-cache-probes=",
+			 probes, NULL);
+      free (probes);
+    }
+  if (omnibor_cache_stderr != NULL && global_dc->show_color)
+    option = reconcat (option, option, " -fdiagnostics-color=always", NULL);
+  if (omnibor_cache_stderr != NULL
+      && global_dc->printer->url_format != URL_FORMAT_NONE)
+    option = reconcat (option, option, " -fdiagnostics-urls=always", NULL);
+
+  return option;
+}
+
 
 /* %:print-asm-header spec function.  Print a banner to say that the
    following output is from the assembler.  */
@@ -11677,6 +12393,9 @@ driver::finalize ()
   have_c = 0;
   have_exactly_c = 0;
   have_o = 0;
+  have_E = 0;
+  have_S = 0;
+  omnibor_dir = NULL;
 
   temp_names = NULL;
   execution_count = 0;
@@ -31,6 +31,7 @@ along with GCC; see the file COPYING3.  If not see
 #include "output.h"	/* for assemble_string */
 #include "common/common-target.h"
 #include "go-c.h"
+#include "omnibor.h"
 
 /* The segment name we pass to simple_object_start_read to find Go
    export data.  */
@@ -141,6 +142,12 @@ go_read_export_data (int fd, off_t offset, char **pbuf, size_t *plen,
   *pbuf = NULL;
   *plen = 0;
 
+  /* Every file which the Go frontend proper looks for export data in,
+     whatever its format, is first read here at offset 0.  It does not
+     tell the rest of the compiler which files it imports otherwise.  */
+  if (offset == 0)
+    omnibor_add_dependency_fd (fd);
+
   sobj = simple_object_start_read (fd, offset, GO_EXPORT_SEGMENT_NAME,
 				   &errmsg, perr);
   if (sobj == NULL)
@@ -35,6 +35,7 @@ enum classify_record
   { RECORD_IS_STRUCT, RECORD_IS_CLASS, RECORD_IS_INTERFACE };
 
 class substring_loc;
+class mkdeps;
 
 /* The following hooks are documented in langhooks.c.  Must not be
    NULL.  */
@@ -611,6 +612,12 @@ struct lang_hooks
   /* Invoked before the early_finish debug hook is invoked.  */
   void (*finalize_early_debug) (void);
 
+  /* Return the deps buffer which lists the files the front end read, for
+     the OmniBOR Document files, or NULL if the front end keeps no such
+     list.  The files entered in the line table are then recorded, with
+     those named by omnibor_add_dependency.  */
+  class mkdeps *(*omnibor_deps) (void);
+
   /* Whenever you add entries here, make sure you adjust langhooks-def.h
      and langhooks.c accordingly.  */
 };
@@ -0,0 +1,291 @@
+/* Language-independent recording of the OmniBOR information.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This file is part of GCC.
+
+GCC is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free
+Software Foundation; either version 3, or (at your option) any later
+version.
+
+GCC is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with GCC; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/* The OmniBOR Document files of a compilation list the files which the
+   front end read, whatever the language.  The C family front ends keep
+   that list in the deps buffer of their cpp_reader, and hand it over
+   with the omnibor_deps language hook.  The other front ends read their
+   source files through the line table, which this file walks, and name
+   anything else they read, such as Fortran module files and D imports,
+   with omnibor_add_dependency, or with omnibor_add_dependency_fd when
+   only a file descriptor is known, as for Go export data.  Either way
+   the list goes through the same hashing and storing code in libcpp.  */
+
+#include "config.h"
+#include "system.h"
+#include "coretypes.h"
+#include "options.h"
+#include "tree.h"
+#include "diagnostic-core.h"
+#include "langhooks.h"
+#include "timevar.h"
+#include "cpplib.h"
+#include "mkdeps.h"
+#include "omnibor.h"
+
+/* The files which the front end named with omnibor_add_dependency, in
+   the order in which they were first named.  */
+static vec<const char *> omnibor_dependencies;
+static hash_set<nofree_string_hash> *omnibor_dependency_set;
+
+/* The files which the front end named with omnibor_add_dependency_fd,
+   and their gitoids, which remain valid until the end of the process.  */
+struct omnibor_fd_dependency
+{
+  char *name;
+  const struct omnibor_gitoids *gitoids;
+};
+static vec<omnibor_fd_dependency> omnibor_fd_dependencies;
+
+/* The dependencies of the compilation, once omnibor_start has handed
+   them over to libcpp, after which no more can be added, and whether
+   they were collected here rather than by the front end.  */
+static class mkdeps *omnibor_deps_buffer;
+static bool omnibor_own_deps;
+
+/* Return the directory to store the OmniBOR files in, or NULL if the
+   calculation of the OmniBOR information is not enabled.  The directory
+   is determined in this order of precedence.
+	1. Use the directory name passed with -frecord-omnibor= option.
+	2. Use the location set in OMNIBOR_DIR environment variable.  */
+
+const char *
+omnibor_record_dir (void)
+{
+  if (str_record_omnibor && *str_record_omnibor)
+    return str_record_omnibor;
+
+  const char *env_omnibor = getenv ("OMNIBOR_DIR");
+  if (env_omnibor && *env_omnibor)
+    return env_omnibor;
+
+  /* An empty -frecord-omnibor= is diagnosed when the OmniBOR Document
+     files cannot be created.  */
+  return str_record_omnibor;
+}
+
+/* Return the number of threads which calculate the OmniBOR gitoids of
+   the dependencies while the file is parsed, as set with
+   -frecord-omnibor-jobs=.  By default one thread is used, unless make
+   runs jobs in parallel: every processor is then likely to be busy
+   compiling already.  */
+
+static int
+omnibor_record_jobs (void)
+{
+  if (flag_record_omnibor_jobs >= 0)
+    return flag_record_omnibor_jobs;
+
+  const char *makeflags = getenv ("MAKEFLAGS");
+  if (makeflags
+      && (strstr (makeflags, "--jobserver-auth=")
+	  || strstr (makeflags, "--jobserver-fds=")))
+    return 0;
+
+  return 1;
+}
+
+/* Pass the OmniBOR options on to libcpp, which calculates the gitoids
+   and writes the OmniBOR files for every front end.  This is done before
+   the front end reads its main file, since the OmniBOR directory also
+   holds the persistent cache of gitoids.  */
+
+void
+omnibor_init (void)
+{
+  set_omnibor_dir (omnibor_record_dir ());
+  set_omnibor_jobs (omnibor_record_jobs ());
+  set_omnibor_fsync (flag_record_omnibor_fsync);
+  set_omnibor_pack (flag_record_omnibor_pack);
+  set_omnibor_outfile (str_record_omnibor_outfile);
+}
+
+/* Record that the front end read the file NAME, if the OmniBOR
+   information is calculated.  Naming a file more than once is harmless.  */
+
+void
+omnibor_add_dependency (const char *name)
+{
+  if (omnibor_record_dir () == NULL || name == NULL || *name == '\0')
+    return;
+  gcc_assert (omnibor_deps_buffer == NULL);
+
+  if (omnibor_dependency_set == NULL)
+    omnibor_dependency_set = new hash_set<nofree_string_hash>;
+  if (omnibor_dependency_set->contains (name))
+    return;
+
+  name = xstrdup (name);
+  omnibor_dependency_set->add (name);
+  omnibor_dependencies.safe_push (name);
+}
+
+/* Record that the front end read the regular file open on FD, which it
+   does not name, if the OmniBOR information is calculated.  Its gitoids
+   are calculated at once, while FD is still open, and its name is taken
+   from /proc where the host has it.  The file offset of FD is kept.  */
+
+void
+omnibor_add_dependency_fd (int fd)
+{
+  if (omnibor_record_dir () == NULL)
+    return;
+  gcc_assert (omnibor_deps_buffer == NULL);
+
+  off_t pos = lseek (fd, 0, SEEK_CUR);
+  if (pos < 0 || lseek (fd, 0, SEEK_SET) < 0)
+    return;
+  const struct omnibor_gitoids *gitoids = deps_omnibor_file_gitoids (fd);
+  lseek (fd, pos, SEEK_SET);
+  if (gitoids == NULL)
+    return;
+
+  for (unsigned ix = 0; ix != omnibor_fd_dependencies.length (); ix++)
+    if (memcmp (omnibor_fd_dependencies[ix].gitoids, gitoids,
+		sizeof (*gitoids)) == 0)
+      return;
+
+  /* lrealpath returns its argument if it cannot resolve it.  */
+  char *proc = xasprintf ("/proc/self/fd/%d", fd);
+  omnibor_fd_dependency dep;
+  dep.name = lrealpath (proc);
+  dep.gitoids = gitoids;
+  if (strcmp (dep.name, proc) == 0)
+    {
+      free (dep.name);
+      dep.name = xstrdup ("not available");
+    }
+  free (proc);
+  omnibor_fd_dependencies.safe_push (dep);
+}
+
+/* Name the files which the front end entered in the line table, which
+   are its source files.  */
+
+static void
+omnibor_add_line_table_files (void)
+{
+  for (unsigned ix = 0; ix != LINEMAPS_ORDINARY_USED (line_table); ix++)
+    {
+      const line_map_ordinary *map
+	= LINEMAPS_ORDINARY_MAP_AT (line_table, ix);
+
+      /* Skip <built-in>, <command-line> and the like.  */
+      const char *name = ORDINARY_MAP_FILE_NAME (map);
+      if (map->reason == LC_ENTER && name && name[0] != '<')
+	omnibor_add_dependency (name);
+    }
+}
+
+/* Start writing the OmniBOR Document files of the compilation, once the
+   front end has read everything.  Unless -frecord-omnibor-jobs=0, libcpp
+   hashes the dependencies and writes the files on a thread of its own,
+   while the compiler goes on with optimization and code generation, and
+   while the assembler consumes the output written so far.  */
+
+void
+omnibor_start (void)
+{
+  const char *dir = omnibor_record_dir ();
+  if (dir == NULL || omnibor_deps_buffer != NULL)
+    return;
+
+  /* The LTO IR does not tell which files it was compiled from; collect2
+     records the inputs of the link instead.  */
+  if (in_lto_p)
+    return;
+
+  class mkdeps *d = NULL;
+  if (lang_hooks.omnibor_deps)
+    d = lang_hooks.omnibor_deps ();
+
+  omnibor_own_deps = d == NULL;
+  if (omnibor_own_deps)
+    {
+      d = deps_init ();
+      omnibor_add_line_table_files ();
+    }
+
+  for (unsigned ix = 0; ix != omnibor_dependencies.length (); ix++)
+    deps_add_dep (d, omnibor_dependencies[ix]);
+  for (unsigned ix = 0; ix != omnibor_fd_dependencies.length (); ix++)
+    deps_record_omnibor_input (d, omnibor_fd_dependencies[ix].name,
+			       omnibor_fd_dependencies[ix].gitoids, NULL);
+
+  /* If the compiler exits before omnibor_finish, after an error, the
+     writing thread is stopped before anything else is torn down.  */
+  static bool atexit_registered;
+  if (!atexit_registered)
+    {
+      atexit (deps_cancel_omnibor);
+      atexit_registered = true;
+    }
+
+  /* The dependencies read while parsing may have been hashed already,
+     by the worker threads or as they were read.  Without a thread of its
+     own, libcpp hashes the others here.  */
+  timevar_push (TV_OMNIBOR_HASH);
+  deps_start_omnibor (d, dir);
+  timevar_pop (TV_OMNIBOR_HASH);
+  omnibor_deps_buffer = d;
+}
+
+/* Finish writing the OmniBOR Document files of the compilation, and
+   record their gitoids in the .note.omnibor section of the output file.
+   This is the only part of the OmniBOR information which the assembler
+   has to wait for.  */
+
+void
+omnibor_finish (void)
+{
+  if (omnibor_record_dir () == NULL || in_lto_p)
+    return;
+
+  /* The front end may have stopped before code generation.  */
+  omnibor_start ();
+
+  std::string gitoid_sha1, gitoid_sha256;
+  timevar_push (TV_OMNIBOR_STORE);
+  deps_finish_omnibor (&gitoid_sha1, &gitoid_sha256);
+  timevar_pop (TV_OMNIBOR_STORE);
+  if (omnibor_own_deps)
+    deps_free (omnibor_deps_buffer);
+  omnibor_deps_buffer = NULL;
+
+  if (!gitoid_sha1.empty () && !gitoid_sha256.empty ())
+    elf_record_omnibor_write_gitoid (gitoid_sha1, gitoid_sha256);
+  else
+    fatal_error (input_location,
+		 "Error in creation of OmniBOR Document files");
+
+  if (time_report)
+    {
+      struct cpp_omnibor_stats stats;
+      cpp_omnibor_get_stats (&stats);
+      fprintf (stderr, "OmniBOR gitoid cache: %u hits, %u misses\n",
+	       stats.cache_hits, stats.cache_misses);
+      if (stats.server_hits)
+	fprintf (stderr, "OmniBOR gitoid server: %u hits\n",
+		 stats.server_hits);
+      fprintf (stderr, "OmniBOR files hashed: %u (%llu bytes)\n",
+	       stats.files_hashed, stats.bytes_hashed);
+      fprintf (stderr, "OmniBOR store writes: %u (%llu bytes)\n",
+	       stats.store_writes, stats.store_bytes);
+    }
+}
@@ -6,4 +6,13 @@
 /* An example implementation for ELF targets.  Defined in varasm.c  */
 extern void elf_record_omnibor_write_gitoid (std::string, std::string);
 
+/* The language-independent recording of the OmniBOR information.  Defined
+   in omnibor.c  */
+extern const char *omnibor_record_dir (void);
+extern void omnibor_init (void);
+extern void omnibor_add_dependency (const char *);
+extern void omnibor_add_dependency_fd (int);
+extern void omnibor_start (void);
+extern void omnibor_finish (void);
+
 #endif /* ! GCC_OMNIBOR_H */
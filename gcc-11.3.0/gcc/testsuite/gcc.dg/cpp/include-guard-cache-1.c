@@ -0,0 +1,26 @@
+/* Test that -finclude-guard-cache gives the results of reading a
+   guarded header found under another name, whether or not its guard is
+   defined.  gcc.misc-tests/include-cache.exp tests that the header is
+   not read while its guard is defined.  */
+
+/* { dg-do preprocess } */
+/* { dg-options "-finclude-guard-cache=include-guard-cache-1.cache" } */
+
+#include "include-guard-cache-1.h"
+#ifndef INCLUDE_GUARD_CACHE_1_READ
+# error include-guard-cache-1.h not read
+#endif
+
+#undef INCLUDE_GUARD_CACHE_1_READ
+#include "../cpp/include-guard-cache-1.h"
+#ifdef INCLUDE_GUARD_CACHE_1_READ
+# error include-guard-cache-1.h read with its guard defined
+#endif
+
+#undef INCLUDE_GUARD_CACHE_1_H
+#include "./include-guard-cache-1.h"
+#ifndef INCLUDE_GUARD_CACHE_1_READ
+# error include-guard-cache-1.h not read after its guard was undefined
+#endif
+
+/* { dg-final { remove-build-file "include-guard-cache-1.cache" } } */
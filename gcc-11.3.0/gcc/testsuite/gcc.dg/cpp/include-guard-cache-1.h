@@ -0,0 +1,8 @@
+/* Header for include-guard-cache-1.c.  */
+
+#ifndef INCLUDE_GUARD_CACHE_1_H
+#define INCLUDE_GUARD_CACHE_1_H
+
+#define INCLUDE_GUARD_CACHE_1_READ 1
+
+#endif
@@ -0,0 +1,15 @@
+/* Test whether a program is linked without diagnostics when collect2
+   records the inputs of the link in the OmniBOR Document files of the
+   output file.  What those Document files list is checked by
+   gcc.misc-tests/omnibor.exp.  */
+
+/* { dg-do link } */
+/* { dg-options "-frecord-omnibor=omnibordir" } */
+
+#include "omnibor.h"
+
+int main()
+{
+  int var = 0;
+  return var;
+}
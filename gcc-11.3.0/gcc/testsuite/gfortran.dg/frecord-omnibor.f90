@@ -0,0 +1,13 @@
+! { dg-do compile }
+! { dg-options "-frecord-omnibor=omnibordir" }
+!
+! Test whether the gitoids of the OmniBOR Document files are recorded
+! in the .note.omnibor section for a language other than C.
+!
+function f()
+  integer :: f
+  f = 0
+end function f
+
+! { dg-final { scan-assembler "\t.section\t.note.omnibor" } }
+! { dg-final { scan-assembler "\t.string\t\"OMNIBOR\"" } }
@@ -97,6 +97,7 @@ along with GCC; see the file COPYING3.  If not see
 #endif
 
 #include "selftest.h"
+#include "omnibor.h"
 
 #ifdef HAVE_isl
 #include <isl/version.h>
@@ -459,6 +460,10 @@ compile_file (void)
   timevar_pop (TV_PARSE_GLOBAL);
   timevar_stop (TV_PHASE_PARSING);
 
+  /* The front end has read every file it depends on: let the OmniBOR
+     Document files be written while the compilation goes on.  */
+  omnibor_start ();
+
   if (flag_dump_locations)
     dump_location_info (stderr);
 
@@ -743,8 +748,7 @@ init_asm_output (const char *name)
 		    "the current target");
 	}
 
-      if (str_record_omnibor
-	  || (getenv ("OMNIBOR_DIR") && strlen (getenv ("OMNIBOR_DIR")) > 0))
+      if (omnibor_record_dir ())
 	{
 	  if (targetm.asm_out.record_omnibor)
 	    targetm.asm_out.record_omnibor ();
@@ -1247,6 +1251,10 @@ process_options (void)
 
   maximum_field_alignment = initial_max_fld_align * BITS_PER_UNIT;
 
+  /* Set up the OmniBOR recording before the front end reads its main
+     file.  */
+  omnibor_init ();
+
   /* Allow the front end to perform consistency checks and do further
      initialization based on the command line options.  This hook also
      sets the original filename if appropriate (e.g. foo.i -> foo.c)
@@ -2058,16 +2066,16 @@ finalize (bool no_backend)
 	unlink (aux_info_file_name);
     }
 
+  /* Finish recording the files which the front end read in the OmniBOR
+     Document files, whatever the language, and record their gitoids in
+     the .note.omnibor section of the assembler output file.  */
+  omnibor_finish ();
+
   /* Close non-debugging input and output files.  Take special care to note
      whether fclose returns an error, since the pages might still be on the
-     buffer chain while the file is open.  If the calculation of the OmniBOR
-     information is enabled, do not close the asm_out_file because the gitoid
-     of the resulting OmniBOR file is to be written in the .note.omnibor section
-     later, when calculating dependencies for the object file.  */
-
-  if (asm_out_file
-      && !(str_record_omnibor
-	   || (getenv ("OMNIBOR_DIR") && strlen (getenv ("OMNIBOR_DIR")) > 0)))
+     buffer chain while the file is open.  */
+
+  if (asm_out_file)
     {
       if (ferror (asm_out_file) != 0)
 	fatal_error (input_location, "error writing to %s: %m", asm_file_name);
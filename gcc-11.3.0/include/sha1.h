@@ -101,6 +101,13 @@ extern void sha1_init_ctx (struct sha1_ctx *ctx);
 extern void sha1_process_block (const void *buffer, size_t len,
 				struct sha1_ctx *ctx);
 
+/* Select the implementation used by sha1_process_block.  If ENABLE is
+   zero, the portable C implementation is always used; otherwise the
+   x86 SHA extensions are used when the CPU supports them, which is the
+   default.  Return nonzero if the x86 SHA extensions are used from now
+   on.  */
+extern int sha1_select_hw (int enable);
+
 /* Starting with the result of former calls of this function (or the
    initialization function update the context for the next LEN bytes
    starting at BUFFER.
@@ -62,6 +62,13 @@ extern void sha224_init_ctx (struct sha256_ctx *ctx);
 extern void sha256_process_block (const void *buffer, size_t len,
                                   struct sha256_ctx *ctx);
 
+/* Select the implementation used by sha256_process_block.  If ENABLE is
+   zero, the portable C implementation is always used; otherwise the
+   x86 SHA extensions are used when the CPU supports them, which is the
+   default.  Return nonzero if the x86 SHA extensions are used from now
+   on.  */
+extern int sha256_select_hw (int enable);
+
 /* Starting with the result of former calls of this function (or the
    initialization function update the context for the next LEN bytes
    starting at BUFFER.
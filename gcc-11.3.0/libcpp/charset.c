@@ -2135,7 +2135,9 @@ _cpp_interpret_identifier (cpp_reader *pfile, const uchar *id, size_t len)
    INPUT is expected to have been allocated with xmalloc.  This
    function will either set *BUFFER_START to INPUT, or free it and set
    *BUFFER_START to a pointer to another xmalloc-allocated block of
-   memory.  */
+   memory.  If _cpp_input_needs_conversion is false for INPUT_CHARSET
+   and SIZE is LEN + 16, INPUT is used as it is, so it may also be
+   memory that was not allocated with xmalloc.  */
 uchar * 
 _cpp_convert_input (cpp_reader *pfile, const char *input_charset,
 		    uchar *input, size_t size, size_t len,
@@ -2210,6 +2212,14 @@ _cpp_convert_input (cpp_reader *pfile, const char *input_charset,
   return buffer;
 }
 
+/* Return true if _cpp_convert_input converts input in INPUT_CHARSET
+   into a new buffer, rather than using the buffer it is given.  */
+bool
+_cpp_input_needs_conversion (const char *input_charset)
+{
+  return strcasecmp (SOURCE_CHARSET, input_charset) != 0;
+}
+
 /* Decide on the default encoding to assume for input files.  */
 const char *
 _cpp_default_encoding (void)
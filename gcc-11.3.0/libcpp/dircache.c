@@ -0,0 +1,599 @@
+/* Persistent cache of the names in the include directories.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include "config.h"
+#include "system.h"
+#include "cpplib.h"
+#include "internal.h"
+#include "hashtab.h"
+#include "obstack.h"
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+#include <dirent.h>
+
+/* Every #include is looked for by opening the file in each directory
+   of the search path in turn, so a build with many -I directories
+   spends much of its time in failed opens.  With -finclude-dir-cache,
+   the names in each directory are listed once and remembered in a cache
+   file shared by all the compilations of the build; a name which is not
+   in the listing of a directory is not looked for there.
+
+   A directory is identified by its device, inode and modification and
+   change times, rather than its path, which may be relative to a
+   different working directory.  Creating, removing or renaming a file
+   in the directory changes its modification time, so its old listing is
+   never used again.  Directories modified within the last second are
+   not listed, for the same reason as in the gitoid cache of omnibor.c.
+   The listings of directories modified within the last
+   DIR_CACHE_SETTLE_TIME seconds are only used by the compilation which
+   made them: a directory into which the build is writing would
+   otherwise add a listing to the cache file for every compilation.
+
+   The cache file starts with a cache_file_header and is followed by
+   _cpp_dir_listing records, each padded to a multiple of 8 bytes.  Like
+   the gitoid cache it is only ever appended to: readers map it and
+   never take a lock, while writers append whole records with a single
+   write under an exclusive flock.  A record with a bad checksum is
+   skipped, and the records are read up to the first one which does not
+   fit in the file.
+
+   A listing holds an open-addressed hash table of the names, so that it
+   can be used straight from the mapped file.  Names are hashed and
+   compared without regard to the case of ASCII letters, and names with
+   other bytes are always looked for on disk, so that a file system
+   which folds case or normalizes names never has a file hidden from
+   it.  */
+
+#define DIR_CACHE_MAGIC "GCCDIRS1"
+#define DIR_CACHE_VERSION 1
+#define DIR_CACHE_SETTLE_TIME 60
+
+
+struct _cpp_dir_listing
+{
+  /* The checksum of the rest of the record.  */
+  uint32_t check;
+
+  /* The size of the record, including the slots and the names.  */
+  uint32_t size;
+
+  /* The identity of the directory.  */
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime;
+  int64_t ctime;
+
+  /* The number of slots of the hash table, a power of two or zero, and
+     of names in the directory.  The slots follow the record, and hold
+     the offsets of the NUL-terminated names from the start of the
+     record, or zero for an empty slot.  The names follow the slots.  */
+  uint32_t num_slots;
+  uint32_t num_names;
+};
+
+/* The listing of a directory which does not exist, in which every name
+   is missing, and the marker of a directory whose listing is unknown,
+   where every name has to be looked for.  */
+
+static const struct _cpp_dir_listing dir_cache_missing = { 0, 0, 0, 0, 0, 0,
+							   0, 0 };
+static const struct _cpp_dir_listing dir_cache_unknown = { 0, 0, 0, 0, 0, 0,
+							   0, 0 };
+
+/* The state of the cache of a cpp_reader.  */
+
+struct _cpp_dir_cache
+{
+  /* True if the cache file has an unexpected format, or cannot be
+     appended to; it is then neither read nor written, and the listings
+     are only used by this process.  */
+  bool disabled;
+
+  /* The mapping of the cache file as it was when it was first used.  */
+  void *map;
+  size_t map_size;
+
+  /* The valid listings of the mapped cache file and of this process,
+     hashed by directory identity.  */
+  htab_t table;
+
+  /* The listings made by this process, of which the first WRITTEN have
+     been written to the cache file.  */
+  struct _cpp_dir_listing **made;
+  unsigned made_num, made_alloc, written;
+};
+
+/* Return the slots of the hash table of listing L.  */
+
+static inline const uint32_t *
+dir_cache_slots (const struct _cpp_dir_listing *l)
+{
+  return (const uint32_t *) (l + 1);
+}
+
+/* Return the checksum of listing L, excluding the checksum itself.  */
+
+static uint32_t
+dir_cache_checksum (const struct _cpp_dir_listing *l)
+{
+  const unsigned char *p = (const unsigned char *) l;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = sizeof (l->check); i != l->size; i++)
+    h = (h ^ p[i]) * 16777619u;
+
+  return h;
+}
+
+/* Return the hash of the LEN bytes of NAME, ignoring the case of ASCII
+   letters.  The hash is stored in the cache file, so it must not
+   change without a change of DIR_CACHE_VERSION.  */
+
+static uint32_t
+dir_cache_name_hash (const char *name, size_t len)
+{
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i != len; i++)
+    h = (h ^ TOLOWER (name[i])) * 16777619u;
+
+  return h;
+}
+
+static hashval_t
+dir_cache_hash (const void *p)
+{
+  const struct _cpp_dir_listing *l = (const struct _cpp_dir_listing *) p;
+
+  return (hashval_t) (l->ino ^ (l->ino >> 32) ^ l->dev ^ l->mtime);
+}
+
+static int
+dir_cache_eq (const void *p, const void *q)
+{
+  const struct _cpp_dir_listing *a = (const struct _cpp_dir_listing *) p;
+  const struct _cpp_dir_listing *b = (const struct _cpp_dir_listing *) q;
+
+  return (a->dev == b->dev && a->ino == b->ino
+	  && a->mtime == b->mtime && a->ctime == b->ctime);
+}
+
+/* Return true if listing L, of at most AVAIL bytes, is complete and
+   consistent, so that it can be looked up without further checks.  */
+
+static bool
+dir_cache_valid_p (const struct _cpp_dir_listing *l, size_t avail)
+{
+  if (l->size < sizeof (*l) || l->size % 8 != 0 || l->size > avail
+      || l->check != dir_cache_checksum (l))
+    return false;
+
+  if (l->num_slots & (l->num_slots - 1)
+      || l->num_names >= l->num_slots + (l->num_slots == 0)
+      || (l->size - sizeof (*l)) / sizeof (uint32_t) < l->num_slots)
+    return false;
+
+  const char *start = (const char *) l;
+  const uint32_t *slots = dir_cache_slots (l);
+  size_t names = sizeof (*l) + l->num_slots * sizeof (uint32_t);
+  uint32_t used = 0;
+  for (uint32_t i = 0; i != l->num_slots; i++)
+    if (slots[i])
+      {
+	if (slots[i] < names || slots[i] >= l->size
+	    || !memchr (start + slots[i], '\0', l->size - slots[i]))
+	  return false;
+	used++;
+      }
+
+  /* The table must have an empty slot for lookups to stop.  */
+  return used == l->num_names;
+}
+
+/* Map the cache file PATH, which must start with MAGIC and VERSION,
+   and set *SIZE to the size of the mapping.  Return NULL if the file
+   does not exist or cannot be mapped, and set *BAD as well if it has an
+   unexpected format.  */
+
+void *
+_cpp_cache_file_map (const char *path, const char *magic, uint32_t version,
+		     size_t *size, bool *bad)
+{
+#ifdef HAVE_SYS_MMAN_H
+  int fd = open (path, O_RDONLY | O_BINARY);
+  if (fd == -1)
+    return NULL;
+
+  void *map = NULL;
+  struct stat st;
+  const size_t header_size = sizeof (struct cache_file_header);
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size >= header_size)
+    {
+      map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED)
+	map = NULL;
+      else
+	{
+	  const struct cache_file_header *header
+	    = (const struct cache_file_header *) map;
+
+	  if (memcmp (header->magic, magic, 8) != 0
+	      || header->version != version)
+	    {
+	      munmap (map, st.st_size);
+	      map = NULL;
+	      *bad = true;
+	    }
+	  else
+	    *size = st.st_size;
+	}
+    }
+  close (fd);
+  return map;
+#else
+  *bad = true;
+  return NULL;
+#endif
+}
+
+/* Return the record at OFFSET of the cache file mapped at MAP, of SIZE
+   bytes, or NULL if it does not fit in the file; it may still be being
+   appended.  */
+
+const void *
+_cpp_cache_file_record (const void *map, size_t size, size_t offset)
+{
+  if (size - offset < sizeof (struct cache_file_record))
+    return NULL;
+
+  const struct cache_file_record *r
+    = (const struct cache_file_record *) ((const char *) map + offset);
+  if (r->size < sizeof (*r) || r->size % 8 != 0 || r->size > size - offset)
+    return NULL;
+
+  return r;
+}
+
+/* Append the LEN bytes of whole records at BUF to the cache file PATH,
+   creating it with MAGIC and VERSION if need be.  Return true if they
+   were written, and set *BAD if the file cannot be appended to.  */
+
+bool
+_cpp_cache_file_append (const char *path, const char *magic,
+			uint32_t version, const void *buf, size_t len,
+			bool *bad)
+{
+  int fd = open (path, O_RDWR | O_CREAT | O_APPEND | O_BINARY, 0666);
+  if (fd == -1)
+    return false;
+
+#ifdef LOCK_EX
+  flock (fd, LOCK_EX);
+#endif
+
+  const size_t header_size = sizeof (struct cache_file_header);
+  struct stat st;
+  bool ok = fstat (fd, &st) == 0;
+
+  if (ok && st.st_size == 0)
+    {
+      struct cache_file_header header;
+      memset (&header, 0, sizeof (header));
+      memcpy (header.magic, magic, 8);
+      header.version = version;
+      ok = write (fd, &header, header_size) == (ssize_t) header_size;
+    }
+  else if (ok && (size_t) st.st_size < header_size)
+    ok = false;
+  else if (ok)
+    {
+      /* Find the end of the last whole record.  A writer may have died
+	 in the middle of one; readers could have the file mapped, so pad
+	 the damaged record (its checksum will not match) rather than
+	 truncating the file.  If even its size was not written, the file
+	 cannot be appended to any more.  */
+      off_t offset = header_size;
+      struct cache_file_record r;
+      while (offset != st.st_size)
+	{
+	  if (lseek (fd, offset, SEEK_SET) != offset
+	      || read (fd, &r, sizeof (r)) != (ssize_t) sizeof (r)
+	      || r.size < sizeof (r) || r.size % 8 != 0)
+	    {
+	      ok = false;
+	      break;
+	    }
+	  if (r.size > st.st_size - offset)
+	    {
+	      size_t pad = r.size - (st.st_size - offset);
+	      char *zeros = XCNEWVEC (char, pad);
+	      ok = write (fd, zeros, pad) == (ssize_t) pad;
+	      free (zeros);
+	      break;
+	    }
+	  offset += r.size;
+	}
+      if (!ok)
+	*bad = true;
+    }
+
+  /* O_APPEND writes at the end whatever the offset.  */
+  if (ok)
+    ok = write (fd, buf, len) == (ssize_t) len;
+
+#ifdef LOCK_EX
+  flock (fd, LOCK_UN);
+#endif
+  close (fd);
+  return ok;
+}
+
+/* Read the listings of the cache file PATH into the table of CACHE.  */
+
+static void
+dir_cache_read (struct _cpp_dir_cache *cache, const char *path)
+{
+  cache->map = _cpp_cache_file_map (path, DIR_CACHE_MAGIC, DIR_CACHE_VERSION,
+				    &cache->map_size, &cache->disabled);
+  if (!cache->map)
+    return;
+
+  size_t offset = sizeof (struct cache_file_header);
+  const void *r;
+  while ((r = _cpp_cache_file_record (cache->map, cache->map_size, offset)))
+    {
+      const struct _cpp_dir_listing *l = (const struct _cpp_dir_listing *) r;
+      if (dir_cache_valid_p (l, cache->map_size - offset))
+	*htab_find_slot (cache->table, l, INSERT) = (void *) l;
+      offset += l->size;
+    }
+}
+
+/* Return the cache of PFILE, opening and mapping its file the first
+   time.  */
+
+static struct _cpp_dir_cache *
+dir_cache_init (cpp_reader *pfile)
+{
+  if (pfile->dir_cache)
+    return pfile->dir_cache;
+
+  struct _cpp_dir_cache *cache = XCNEW (struct _cpp_dir_cache);
+  cache->table = htab_create_alloc (64, dir_cache_hash, dir_cache_eq, NULL,
+				    xcalloc, free);
+  dir_cache_read (cache, CPP_OPTION (pfile, include_dir_cache));
+  pfile->dir_cache = cache;
+
+  return cache;
+}
+
+/* List the directory NAME, which has the identity given by KEY, and
+   return a new listing of it, or NULL if it cannot be read or changes
+   while it is read.  */
+
+static struct _cpp_dir_listing *
+dir_cache_list (const char *name, const struct _cpp_dir_listing *key)
+{
+  DIR *dir = opendir (name);
+  if (!dir)
+    return NULL;
+
+  /* Gather the names first, as the size of the table depends on their
+     number.  */
+  struct obstack names;
+  obstack_specify_allocation (&names, 0, 0, xmalloc, free);
+  uint32_t num_names = 0;
+  struct dirent *ent;
+  while ((ent = readdir (dir)) != NULL)
+    {
+      const char *n = ent->d_name;
+      if (n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0')))
+	continue;
+      obstack_grow0 (&names, n, strlen (n));
+      num_names++;
+    }
+  closedir (dir);
+
+  size_t names_size = obstack_object_size (&names);
+  const char *p = (const char *) obstack_finish (&names);
+
+  uint32_t num_slots = 0;
+  if (num_names)
+    for (num_slots = 2; num_slots < 2 * num_names; num_slots *= 2)
+      ;
+
+  size_t names_offset = sizeof (struct _cpp_dir_listing)
+			+ num_slots * sizeof (uint32_t);
+  size_t size = (names_offset + names_size + 7) & -8;
+  struct _cpp_dir_listing *l = NULL;
+
+  /* The directory must not have changed while it was read, and the
+     offsets of the names must fit in a slot.  */
+  struct stat st;
+  if (size <= UINT32_MAX
+      && stat (name, &st) == 0
+      && (uint64_t) st.st_dev == key->dev
+      && (uint64_t) st.st_ino == key->ino
+      && st.st_mtime == key->mtime
+      && st.st_ctime == key->ctime)
+    {
+      l = (struct _cpp_dir_listing *) xcalloc (1, size);
+      *l = *key;
+      l->size = size;
+      l->num_slots = num_slots;
+      l->num_names = num_names;
+      memcpy ((char *) l + names_offset, p, names_size);
+
+      uint32_t *slots = (uint32_t *) (l + 1);
+      for (size_t offset = names_offset;
+	   offset != names_offset + names_size;
+	   offset += strlen ((char *) l + offset) + 1)
+	{
+	  const char *n = (const char *) l + offset;
+	  uint32_t i = dir_cache_name_hash (n, strlen (n));
+	  while (slots[i & (num_slots - 1)])
+	    i++;
+	  slots[i & (num_slots - 1)] = offset;
+	}
+      l->check = dir_cache_checksum (l);
+    }
+
+  obstack_free (&names, NULL);
+  return l;
+}
+
+/* Return the listing of directory DIR, making it if it is not in the
+   cache.  */
+
+static const struct _cpp_dir_listing *
+dir_cache_lookup (cpp_reader *pfile, cpp_dir *dir)
+{
+  struct _cpp_dir_cache *cache = dir_cache_init (pfile);
+  const char *name = dir->len ? dir->name : ".";
+  struct stat st;
+
+  if (stat (name, &st) != 0)
+    return (errno == ENOENT || errno == ENOTDIR
+	    ? &dir_cache_missing : &dir_cache_unknown);
+  if (!S_ISDIR (st.st_mode))
+    return &dir_cache_missing;
+
+  struct _cpp_dir_listing key;
+  memset (&key, 0, sizeof (key));
+  key.dev = st.st_dev;
+  key.ino = st.st_ino;
+  key.mtime = st.st_mtime;
+  key.ctime = st.st_ctime;
+
+  struct _cpp_dir_listing *l
+    = (struct _cpp_dir_listing *) htab_find (cache->table, &key);
+  if (l)
+    return l;
+
+  /* A directory modified within the last second could be modified again
+     without its identity changing.  */
+  time_t now = time (NULL);
+  if (st.st_mtime < now - 1 && st.st_ctime < now - 1)
+    l = dir_cache_list (name, &key);
+  if (!l)
+    return &dir_cache_unknown;
+
+  *htab_find_slot (cache->table, l, INSERT) = l;
+  if (cache->made_num == cache->made_alloc)
+    {
+      cache->made_alloc = cache->made_alloc * 2 + 16;
+      cache->made = XRESIZEVEC (struct _cpp_dir_listing *, cache->made,
+				cache->made_alloc);
+    }
+  cache->made[cache->made_num++] = l;
+
+  return l;
+}
+
+/* Return false if the file FNAME, relative to the include directory DIR,
+   is known not to exist because the first component of FNAME is not in
+   the listing of DIR.  Return true if it has to be looked for.  */
+
+bool
+_cpp_dir_cache_may_exist (cpp_reader *pfile, cpp_dir *dir, const char *fname)
+{
+  if (!CPP_OPTION (pfile, include_dir_cache) || IS_ABSOLUTE_PATH (fname))
+    return true;
+
+  size_t len = 0;
+  for (; fname[len] && !IS_DIR_SEPARATOR (fname[len]); len++)
+    if (fname[len] & 0x80)
+      return true;
+  if (len == 0
+      || (fname[0] == '.' && (len == 1 || (len == 2 && fname[1] == '.'))))
+    return true;
+
+  if (!dir->listing)
+    dir->listing = dir_cache_lookup (pfile, dir);
+
+  const struct _cpp_dir_listing *l = dir->listing;
+  if (l == &dir_cache_unknown)
+    return true;
+  if (l->num_slots == 0)
+    return false;
+
+  const char *start = (const char *) l;
+  const uint32_t *slots = dir_cache_slots (l);
+  uint32_t mask = l->num_slots - 1;
+  for (uint32_t i = dir_cache_name_hash (fname, len); slots[i & mask]; i++)
+    {
+      const char *n = start + slots[i & mask];
+      if (!strncasecmp (n, fname, len) && n[len] == '\0')
+	return true;
+    }
+
+  return false;
+}
+
+/* Append the listings made by PFILE to the cache file.  */
+
+void
+_cpp_dir_cache_flush (cpp_reader *pfile)
+{
+  struct _cpp_dir_cache *cache = pfile->dir_cache;
+  if (!cache || cache->written == cache->made_num || cache->disabled)
+    return;
+
+  time_t settled = time (NULL) - DIR_CACHE_SETTLE_TIME;
+  size_t len = 0;
+  for (unsigned i = cache->written; i != cache->made_num; i++)
+    if (cache->made[i]->mtime < settled && cache->made[i]->ctime < settled)
+      len += cache->made[i]->size;
+
+  char *buf = XNEWVEC (char, len), *p = buf;
+  for (unsigned i = cache->written; i != cache->made_num; i++)
+    if (cache->made[i]->mtime < settled && cache->made[i]->ctime < settled)
+      {
+	memcpy (p, cache->made[i], cache->made[i]->size);
+	p += cache->made[i]->size;
+      }
+  if (_cpp_cache_file_append (CPP_OPTION (pfile, include_dir_cache),
+			      DIR_CACHE_MAGIC, DIR_CACHE_VERSION, buf, len,
+			      &cache->disabled))
+    cache->written = cache->made_num;
+  free (buf);
+}
+
+/* Release the cache of PFILE.  */
+
+void
+_cpp_dir_cache_free (cpp_reader *pfile)
+{
+  struct _cpp_dir_cache *cache = pfile->dir_cache;
+  if (!cache)
+    return;
+
+  htab_delete (cache->table);
+  for (unsigned i = 0; i != cache->made_num; i++)
+    free (cache->made[i]);
+  free (cache->made);
+#ifdef HAVE_SYS_MMAN_H
+  if (cache->map)
+    munmap (cache->map, cache->map_size);
+#endif
+  free (cache);
+  pfile->dir_cache = NULL;
+}
@@ -1838,7 +1838,7 @@ destringize_and_run (cpp_reader *pfile, const cpp_string *in,
 {
   const unsigned char *src, *limit;
   char *dest, *result;
-  cpp_context *saved_context;
+  cpp_context *saved_context, *context, *contextn;
   cpp_token *saved_cur_token;
   tokenrun *saved_cur_run;
   cpp_token *toks;
@@ -1942,6 +1942,13 @@ destringize_and_run (cpp_reader *pfile, const cpp_string *in,
   _cpp_pop_buffer (pfile);
 
   /* Reset the old macro state before ...  */
+  for (context = pfile->context->next; context; context = contextn)
+    {
+      /* Macros expanded while reading the pragma left their contexts
+	 on the chain for reuse; see _cpp_pop_context.  */
+      contextn = context->next;
+      free (context);
+    }
   XDELETE (pfile->context);
   pfile->context = saved_context;
   pfile->cur_token = saved_cur_token;
@@ -2650,6 +2657,7 @@ _cpp_pop_buffer (cpp_reader *pfile)
   struct _cpp_file *inc = buffer->file;
   struct if_stack *ifs;
   const unsigned char *to_free;
+  size_t to_free_mapped;
 
   /* Walk back up the conditional stack till we reach its level at
      entry to this file, issuing error messages.  */
@@ -2664,6 +2672,7 @@ _cpp_pop_buffer (cpp_reader *pfile)
   pfile->buffer = buffer->prev;
 
   to_free = buffer->to_free;
+  to_free_mapped = buffer->to_free_mapped;
   free (buffer->notes);
 
   /* Free the buffer object now; we may want to push a new buffer
@@ -2672,7 +2681,7 @@ _cpp_pop_buffer (cpp_reader *pfile)
 
   if (inc)
     {
-      _cpp_pop_file_buffer (pfile, inc, to_free);
+      _cpp_pop_file_buffer (pfile, inc, to_free, to_free_mapped);
 
       _cpp_do_file_change (pfile, LC_LEAVE, 0, 0, 0);
     }
@@ -39,6 +39,32 @@ along with this program; see the file COPYING3.  If not see
 # define STAT_SIZE_RELIABLE(ST) true
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#ifndef MAP_FAILED
+# define MAP_FAILED ((void *)-1)
+#endif
+#if !defined (MAP_ANONYMOUS) && defined (MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined (MAP_ANONYMOUS) && defined (_SC_PAGESIZE)
+# define HAVE_MMAP_FILE_CONTENTS 1
+#endif
+#endif
+
+/* Regular files of at least this many bytes which need no charset
+   conversion are mapped into memory rather than read.  Setting up and
+   tearing down a mapping costs more than copying a smaller file out of
+   the page cache.
+
+   A mapped file that is truncated while it is being lexed, as when a
+   generated header is rewritten in the middle of a build, makes the
+   lexer die of SIGBUS where read would have given it a consistent copy.
+   The lexer touches the buffer from too many places for a signal
+   handler to recover, so only headers found in system include
+   directories, which the build does not write, are mapped.  */
+#define MMAP_THRESHOLD (512 * 1024)
+
 #ifdef __DJGPP__
 #include <io.h>
   /* For DJGPP redirected input is opened in text mode.  */
@@ -76,9 +102,18 @@ struct _cpp_file
      BUFFER; when freeing, this this pointer must be used instead.  */
   const uchar *buffer_start;
 
+  /* If nonzero, BUFFER_START is a private mapping of the file of this
+     many bytes, which must be released with munmap rather than free.  */
+  size_t buffer_mapped;
+
   /* The macro, if any, preventing re-inclusion.  */
   const cpp_hashnode *cmacro;
 
+  /* The macro which the include guard cache says prevents re-inclusion,
+     if the file was found without being opened because it was
+     defined.  */
+  const cpp_hashnode *cached_cmacro;
+
   /* The directory in the search path where FILE was found.  Used for
      #include_next and determining whether a header is a system
      header.  */
@@ -111,6 +146,11 @@ struct _cpp_file
 
   /* > 0: Known C++ Module header unit, <0: known not.  ==0, unknown  */
   int header_unit : 2;
+
+  /* The OmniBOR gitoids of the contents as read from disk, before any
+     charset conversion.  NULL unless OmniBOR recording is enabled.  They
+     may still be being calculated; see _cpp_omnibor_hash.  */
+  const struct omnibor_gitoids *omnibor_gitoids;
 };
 
 /* A singly-linked list for all searches for a given file name, with
@@ -199,6 +239,7 @@ static bool validate_pch (cpp_reader *, _cpp_file *file, const char *pchname);
 static int pchf_save_compare (const void *e1, const void *e2);
 static int pchf_compare (const void *d_p, const void *e_p);
 static bool check_file_against_entries (cpp_reader *, _cpp_file *, bool);
+static bool guard_cache_skip_p (cpp_reader *, _cpp_file *);
 
 /* Given a filename in FILE->PATH, with the empty string interpreted
    as <stdin>, open it.
@@ -378,6 +419,7 @@ find_file_in_dir (cpp_reader *pfile, _cpp_file *file, bool *invalid_pch,
 		  location_t loc)
 {
   char *path;
+  bool path_in_dir = false;
 
   if (CPP_OPTION (pfile, remap) && (path = remap_filename (pfile, file)))
     ;
@@ -385,7 +427,10 @@ find_file_in_dir (cpp_reader *pfile, _cpp_file *file, bool *invalid_pch,
     if (file->dir->construct)
       path = file->dir->construct (file->name, file->dir);
     else
-      path = append_file_to_dir (file->name, file->dir);
+      {
+	path = append_file_to_dir (file->name, file->dir);
+	path_in_dir = true;
+      }
 
   if (path)
     {
@@ -423,8 +468,29 @@ find_file_in_dir (cpp_reader *pfile, _cpp_file *file, bool *invalid_pch,
       if (pch_open_file (pfile, file, invalid_pch))
 	return true;
 
-      if (open_file (file))
-	return true;
+      /* Do not look for a file which the listing of its directory says
+	 does not exist.  The path of a remapped or constructed file need
+	 not be in the directory.  */
+      if (path_in_dir
+	  && !_cpp_dir_cache_may_exist (pfile, file->dir, file->name))
+	{
+	  file->err_no = ENOENT;
+	  pfile->include_cache_stats.dir_lookups_avoided++;
+	}
+      else
+	{
+	  /* Nor open a header whose remembered include guard is defined;
+	     _cpp_stack_file may not need its contents.  */
+	  file->cached_cmacro = _cpp_guard_cache_lookup (pfile, path,
+							 &file->st);
+	  if (file->cached_cmacro)
+	    {
+	      file->err_no = 0;
+	      return true;
+	    }
+	  if (open_file (file))
+	    return true;
+	}
 
       if (file->err_no != ENOENT)
 	{
@@ -662,6 +728,78 @@ _cpp_find_file (cpp_reader *pfile, const char *fname, cpp_dir *start_dir,
   return file;
 }
 
+/* Map the SIZE bytes of the regular file FILE privately into memory,
+   followed by the 16 bytes of zeros that read_file_guts pads its
+   buffers with, and return the contents.  Set *MAPPED to the length of
+   the mapping.  Return NULL if the file cannot be mapped, or changed
+   size since it was opened, so that it is read instead.
+
+   The lexer only writes to the buffer where it cleans a line, so the
+   pages of the file are copied only where they need to be.  */
+
+#ifdef HAVE_MMAP_FILE_CONTENTS
+static uchar *
+map_file_contents (_cpp_file *file, size_t size, size_t *mapped)
+{
+  size_t pagesize = sysconf (_SC_PAGESIZE);
+  size_t len = (size + 16 + pagesize - 1) & -pagesize;
+  struct stat st;
+  void *p;
+
+  /* The bytes of the last page of the file past its end read as zeros
+     and are writable, but the pages wholly past its end raise SIGBUS.
+     If the padding does not fit in the last page, reserve zero pages
+     for the whole length first and map the file over their start.  */
+  if (len - size < pagesize)
+    p = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, file->fd, 0);
+  else
+    {
+      p = mmap (NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED
+	  && mmap (p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		   file->fd, 0) == MAP_FAILED)
+	{
+	  munmap (p, len);
+	  p = MAP_FAILED;
+	}
+    }
+
+  if (p == MAP_FAILED)
+    return NULL;
+
+  /* A file truncated while it is mapped would make the lexer fault, so
+     make sure it has not been changed since it was opened.  This does
+     not cover later changes; see MMAP_THRESHOLD.  */
+  if (fstat (file->fd, &st) != 0
+      || st.st_size != file->st.st_size
+      || st.st_mtime != file->st.st_mtime)
+    {
+      munmap (p, len);
+      return NULL;
+    }
+
+  *mapped = len;
+  return (uchar *) p;
+}
+#endif
+
+/* Release the contents of a file read by read_file_guts, which start at
+   START and are a mapping of MAPPED bytes if that is nonzero.  */
+
+static void
+free_file_contents (const uchar *start, size_t mapped ATTRIBUTE_UNUSED)
+{
+#ifdef HAVE_MMAP_FILE_CONTENTS
+  if (mapped)
+    {
+      munmap ((void *) start, mapped);
+      return;
+    }
+#endif
+  free ((void *) start);
+}
+
 /* Read a file into FILE->buffer, returning true on success.
 
    If FILE->fd is something weird, like a block device, we don't want
@@ -712,22 +850,40 @@ read_file_guts (cpp_reader *pfile, _cpp_file *file, location_t loc)
        the majority of C source files.  */
     size = 8 * 1024;
 
-  /* The + 16 here is space for the final '\n' and 15 bytes of padding,
-     used to quiet warnings from valgrind or Address Sanitizer, when the
-     optimized lexer accesses aligned 16-byte memory chunks, including
-     the bytes after the malloced, area, and stops lexing on '\n'.  */
-  buf = XNEWVEC (uchar, size + 16);
-  total = 0;
-  while ((count = read (file->fd, buf + total, size - total)) > 0)
-    {
-      total += count;
+  buf = NULL;
+  file->buffer_mapped = 0;
+#ifdef HAVE_MMAP_FILE_CONTENTS
+  if (regular
+      && size >= MMAP_THRESHOLD
+      && file->path[0] != '\0'
+      && file->dir != NULL
+      && file->dir->sysp
+      && !_cpp_input_needs_conversion (CPP_OPTION (pfile, input_charset)))
+    buf = map_file_contents (file, size, &file->buffer_mapped);
+#endif
 
-      if (total == size)
+  if (buf)
+    total = count = size;
+  else
+    {
+      /* The + 16 here is space for the final '\n' and 15 bytes of
+	 padding, used to quiet warnings from valgrind or Address
+	 Sanitizer, when the optimized lexer accesses aligned 16-byte
+	 memory chunks, including the bytes after the malloced, area,
+	 and stops lexing on '\n'.  */
+      buf = XNEWVEC (uchar, size + 16);
+      total = 0;
+      while ((count = read (file->fd, buf + total, size - total)) > 0)
 	{
-	  if (regular)
-	    break;
-	  size *= 2;
-	  buf = XRESIZEVEC (uchar, buf, size + 16);
+	  total += count;
+
+	  if (total == size)
+	    {
+	      if (regular)
+		break;
+	      size *= 2;
+	      buf = XRESIZEVEC (uchar, buf, size + 16);
+	    }
 	}
     }
 
@@ -742,6 +898,20 @@ read_file_guts (cpp_reader *pfile, _cpp_file *file, location_t loc)
     cpp_error_at (pfile, CPP_DL_WARNING, loc,
 	       "%s is shorter than expected", file->path);
 
+  /* Hash the raw contents for OmniBOR now, while they are in memory, so
+     the dependency does not have to be read again later.  Files whose
+     gitoids are already in the persistent cache, or known to the gitoid
+     server, need not be hashed.  */
+  if (omnibor_enabled && !file->omnibor_gitoids)
+    {
+      bool complete = regular && total == size;
+      if (complete)
+	file->omnibor_gitoids = _cpp_omnibor_lookup (&file->st, file->fd);
+      if (!file->omnibor_gitoids)
+	file->omnibor_gitoids = _cpp_omnibor_hash (complete ? &file->st : NULL,
+						   buf, total);
+    }
+
   file->buffer = _cpp_convert_input (pfile,
 				     CPP_OPTION (pfile, input_charset),
 				     buf, size + 16, total,
@@ -939,11 +1109,22 @@ _cpp_stack_file (cpp_reader *pfile, _cpp_file *file, include_type type,
       /* Not a header unit, and we know it.  */
       file->header_unit = -1;
 
-      if (!read_file (pfile, file, loc))
-	return false;
+      /* A header whose include guard is defined is entered with no
+	 contents, as reading it would give nothing else.  */
+      bool skip = guard_cache_skip_p (pfile, file);
+      if (skip)
+	{
+	  file->cmacro = file->cached_cmacro;
+	  pfile->include_cache_stats.headers_not_read++;
+	}
+      else
+	{
+	  if (!read_file (pfile, file, loc))
+	    return false;
 
-      if (!has_unique_contents (pfile, file, type == IT_IMPORT, loc))
-	return false;
+	  if (!has_unique_contents (pfile, file, type == IT_IMPORT, loc))
+	    return false;
+	}
 
       if (pfile->buffer && file->dir)
 	sysp = MAX (pfile->buffer->sysp, file->dir->sysp);
@@ -958,7 +1139,8 @@ _cpp_stack_file (cpp_reader *pfile, _cpp_file *file, include_type type,
         {
 	  if (!pfile->deps)
             pfile->deps = deps_init ();
-	  deps_add_dep (pfile->deps, file->path);
+	  deps_add_dep_with_gitoids (pfile->deps, file->path,
+				     file->omnibor_gitoids);
 	}
 
       /* Clear buffer_valid since _cpp_clean_line messes it up.  */
@@ -966,13 +1148,19 @@ _cpp_stack_file (cpp_reader *pfile, _cpp_file *file, include_type type,
       file->stack_count++;
 
       /* Stack the buffer.  */
+      static const uchar no_contents[] = "\n";
       cpp_buffer *buffer
-	= cpp_push_buffer (pfile, file->buffer, file->st.st_size,
+	= cpp_push_buffer (pfile, skip ? no_contents : file->buffer,
+			   skip ? 0 : file->st.st_size,
 			   CPP_OPTION (pfile, preprocessed)
 			   && !CPP_OPTION (pfile, directives_only));
       buffer->file = file;
       buffer->sysp = sysp;
-      buffer->to_free = file->buffer_start;
+      if (!skip)
+	{
+	  buffer->to_free = file->buffer_start;
+	  buffer->to_free_mapped = file->buffer_mapped;
+	}
 
       /* Initialize controlling macro state.  */
       pfile->mi_valid = true;
@@ -1262,7 +1450,7 @@ make_cpp_file (cpp_dir *dir, const char *fname)
 static void
 destroy_cpp_file (_cpp_file *file)
 {
-  free ((void *) file->buffer_start);
+  free_file_contents (file->buffer_start, file->buffer_mapped);
   free ((void *) file->name);
   free ((void *) file->path);
   free (file);
@@ -1633,15 +1821,20 @@ cpp_push_default_include (cpp_reader *pfile, const char *fname)
 }
 
 /* Do appropriate cleanup when a file INC's buffer is popped off the
-   input stack.  */
+   input stack.  TO_FREE is a mapping of TO_FREE_MAPPED bytes if that is
+   nonzero.  */
 void
 _cpp_pop_file_buffer (cpp_reader *pfile, _cpp_file *file,
-		      const unsigned char *to_free)
+		      const unsigned char *to_free, size_t to_free_mapped)
 {
   /* Record the inclusion-preventing macro, which could be NULL
      meaning no controlling macro.  */
   if (pfile->mi_valid && file->cmacro == NULL)
-    file->cmacro = pfile->mi_cmacro;
+    {
+      file->cmacro = pfile->mi_cmacro;
+      if (file->cmacro)
+	_cpp_guard_cache_add (pfile, file->path, &file->st, file->cmacro);
+    }
 
   /* Invalidate control macros in the #including file.  */
   pfile->mi_valid = false;
@@ -1653,8 +1846,9 @@ _cpp_pop_file_buffer (cpp_reader *pfile, _cpp_file *file,
 	  file->buffer_start = NULL;
 	  file->buffer = NULL;
 	  file->buffer_valid = false;
+	  file->buffer_mapped = 0;
 	}
-      free ((void *) to_free);
+      free_file_contents (to_free, to_free_mapped);
     }
 }
 
@@ -1688,6 +1882,7 @@ cpp_set_include_chains (cpp_reader *pfile, cpp_dir *quote, cpp_dir *bracket,
   for (; quote; quote = quote->next)
     {
       quote->name_map = NULL;
+      quote->listing = NULL;
       quote->len = strlen (quote->name);
       if (quote == bracket)
 	pfile->bracket_include = bracket;
@@ -2137,6 +2332,31 @@ check_file_against_entries (cpp_reader *pfile ATTRIBUTE_UNUSED,
 		  pchf_compare) != NULL;
 }
 
+/* Return true if FILE, found through the include guard cache, can be
+   stacked without being read: its guard must still be defined, its
+   contents must not be needed to compare it with once-only files, and
+   its OmniBOR gitoids must be known without hashing it.  */
+
+static bool
+guard_cache_skip_p (cpp_reader *pfile, _cpp_file *file)
+{
+  if (!file->cached_cmacro || file->buffer_valid
+      || !cpp_macro_p (file->cached_cmacro))
+    return false;
+
+  if (pfile->seen_once_only || (pchf && pchf->have_once_only))
+    return false;
+
+  if (omnibor_enabled && !file->omnibor_gitoids)
+    {
+      file->omnibor_gitoids = _cpp_omnibor_lookup (&file->st, -1);
+      if (!file->omnibor_gitoids)
+	return false;
+    }
+
+  return true;
+}
+
 /* Return true if the file FNAME is found in the appropriate include file path
    as indicated by ANGLE_BRACKETS.  */
 
@@ -2150,3 +2370,37 @@ _cpp_has_header (cpp_reader *pfile, const char *fname, int angle_brackets,
   return file->err_no != ENOENT;
 }
 
+/* Fill in *STATS with what the include caches of PFILE have saved.  */
+
+void
+cpp_get_include_cache_stats (cpp_reader *pfile,
+			     struct cpp_include_cache_stats *stats)
+{
+  *stats = pfile->include_cache_stats;
+}
+
+/* Write the path P, which was looked for and did not exist, to the
+   stream STREAM_P; for htab_traverse.  */
+
+static int
+write_include_probe (void **p, void *stream_p)
+{
+  fprintf ((FILE *) stream_p, "absent %s\n", (const char *) *p);
+  return 1;
+}
+
+/* Write to STREAM what the output of PFILE depends on besides the
+   contents of the files it read, one line each: "time" if it used the
+   current date or time or the modification time of a file, and "absent
+   PATH" for each PATH at which it looked for a file in vain.  A file
+   created at one of those paths, such as a header which shadows one
+   later in the search path, may change the output.  */
+
+void
+cpp_write_include_probes (cpp_reader *pfile, FILE *stream)
+{
+  if (pfile->time_dependent)
+    fputs ("time\n", stream);
+  htab_traverse_noresize (pfile->nonexistent_file_hash, write_include_probe,
+			  stream);
+}
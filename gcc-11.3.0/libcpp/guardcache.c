@@ -0,0 +1,425 @@
+/* Persistent cache of the include guards of headers.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include "config.h"
+#include "system.h"
+#include "cpplib.h"
+#include "internal.h"
+#include "hashtab.h"
+#include "obstack.h"
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/* A header whose contents are all inside #ifndef MACRO ... #endif is
+   only read once by a compilation: _cpp_pop_file_buffer remembers MACRO
+   in the _cpp_file, and the header is skipped while MACRO is defined.
+   The same header found under another name, or in another compilation
+   of the build, is still opened, read and lexed, only for its contents
+   to be skipped.  That is typical after a precompiled header has been
+   restored, or when a project includes its headers both as "foo.h" and
+   as <project/foo.h>.
+
+   With -finclude-guard-cache, the guards found are remembered in a
+   cache file shared by all the compilations of the build.  A header is
+   identified by its device, inode, size and modification and change
+   times, like in the gitoid cache of omnibor.c, so headers changed
+   within the last second are not remembered.  The guard also depends
+   on the options which decide what is a comment or a directive, which
+   are remembered with it.
+
+   When a header is looked for in a directory, and a header of the same
+   name has a remembered guard which is defined, the file is stat-ed
+   rather than opened.  If it is that header, it is entered with no
+   contents, as reading it would have given nothing but the skipped
+   conditional block: the line maps, the dependencies, -H and the
+   linemarkers of -E are the same as if it had been read.  Its OmniBOR
+   gitoids are those of the gitoid cache, which has them under the same
+   identity; a header which is not in it is read after all.
+
+   The cache file starts with a cache_file_header and is followed by
+   guard_cache_record records, written like those of dircache.c.  */
+
+#define GUARD_CACHE_MAGIC "GCCGUARD"
+#define GUARD_CACHE_VERSION 1
+
+struct guard_cache_record
+{
+  /* The checksum of the rest of the record.  */
+  uint32_t check;
+
+  /* The size of the record, including the names, a multiple of 8.  */
+  uint32_t size;
+
+  /* The identity of the header.  */
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t fsize;
+  int64_t mtime;
+  int64_t ctime;
+
+  /* The lexing options the guard was found with; see guard_cache_mode.  */
+  uint32_t mode;
+
+  /* The lengths of the guard macro and of the base name of the header,
+     which follow the record, each NUL-terminated.  */
+  uint16_t guard_len;
+  uint16_t base_len;
+};
+
+/* The records with the same base name, chained.  */
+
+struct guard_cache_entry
+{
+  const struct guard_cache_record *record;
+  struct guard_cache_entry *next;
+};
+
+/* The state of the cache of a cpp_reader.  */
+
+struct _cpp_guard_cache
+{
+  /* True if the cache file has an unexpected format, or cannot be
+     appended to; it is then neither read nor written, and the guards
+     found are only used by this process.  */
+  bool disabled;
+
+  /* The lexing options of this reader; see guard_cache_mode.  */
+  uint32_t mode;
+
+  /* The mapping of the cache file as it was when it was first used.  */
+  void *map;
+  size_t map_size;
+
+  /* The chains of the valid records of the mapped cache file and of this
+     process, hashed by base name.  */
+  htab_t table;
+  struct obstack entries;
+
+  /* The records made by this process, of which the first WRITTEN have
+     been written to the cache file.  */
+  struct guard_cache_record **made;
+  unsigned made_num, made_alloc, written;
+};
+
+/* Return the guard macro and the base name of record R.  */
+
+static inline const char *
+guard_cache_guard (const struct guard_cache_record *r)
+{
+  return (const char *) (r + 1);
+}
+
+static inline const char *
+guard_cache_base (const struct guard_cache_record *r)
+{
+  return guard_cache_guard (r) + r->guard_len + 1;
+}
+
+/* Return the checksum of record R, excluding the checksum itself.  */
+
+static uint32_t
+guard_cache_checksum (const struct guard_cache_record *r)
+{
+  const unsigned char *p = (const unsigned char *) r;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = sizeof (r->check); i != r->size; i++)
+    h = (h ^ p[i]) * 16777619u;
+
+  return h;
+}
+
+static hashval_t
+guard_cache_hash (const void *p)
+{
+  const struct guard_cache_entry *e = (const struct guard_cache_entry *) p;
+
+  return htab_hash_string (guard_cache_base (e->record));
+}
+
+static int
+guard_cache_eq (const void *p, const void *q)
+{
+  const struct guard_cache_entry *e = (const struct guard_cache_entry *) p;
+
+  return strcmp (guard_cache_base (e->record), (const char *) q) == 0;
+}
+
+/* Return the options of PFILE which decide whether a header is guarded:
+   what counts as a comment, a directive, an identifier or a raw string
+   literal, which may hide a directive.  */
+
+static uint32_t
+guard_cache_mode (cpp_reader *pfile)
+{
+  return ((CPP_OPTION (pfile, cplusplus_comments) ? 1 : 0)
+	  | (CPP_OPTION (pfile, digraphs) ? 2 : 0)
+	  | (CPP_OPTION (pfile, trigraphs) ? 4 : 0)
+	  | (CPP_OPTION (pfile, dollars_in_ident) ? 8 : 0)
+	  | (CPP_OPTION (pfile, extended_identifiers) ? 16 : 0)
+	  | (CPP_OPTION (pfile, traditional) ? 32 : 0)
+	  | (CPP_OPTION (pfile, directives_only) ? 64 : 0)
+	  | (CPP_OPTION (pfile, rliterals) ? 128 : 0));
+}
+
+/* Return true if record R, of at most AVAIL bytes, is complete and
+   consistent.  */
+
+static bool
+guard_cache_valid_p (const struct guard_cache_record *r, size_t avail)
+{
+  if (r->size < sizeof (*r) || r->size % 8 != 0 || r->size > avail
+      || r->check != guard_cache_checksum (r))
+    return false;
+
+  const char *guard = guard_cache_guard (r);
+  return (sizeof (*r) + r->guard_len + r->base_len + 2 <= r->size
+	  && r->guard_len != 0
+	  && r->base_len != 0
+	  && guard[r->guard_len] == '\0'
+	  && guard_cache_base (r)[r->base_len] == '\0');
+}
+
+/* Add record R to the table of CACHE and return true, unless a record of
+   the same header and guard is already there.  */
+
+static bool
+guard_cache_enter (struct _cpp_guard_cache *cache,
+		   const struct guard_cache_record *r)
+{
+  const char *base = guard_cache_base (r);
+  void **slot = htab_find_slot_with_hash (cache->table, base,
+					  htab_hash_string (base), INSERT);
+  struct guard_cache_entry *head = (struct guard_cache_entry *) *slot;
+
+  for (struct guard_cache_entry *e = head; e; e = e->next)
+    if (e->record->dev == r->dev && e->record->ino == r->ino
+	&& e->record->fsize == r->fsize && e->record->mtime == r->mtime
+	&& e->record->ctime == r->ctime && e->record->mode == r->mode
+	&& e->record->guard_len == r->guard_len
+	&& !memcmp (guard_cache_guard (e->record), guard_cache_guard (r),
+		    r->guard_len))
+      return false;
+
+  struct guard_cache_entry *e = XOBNEW (&cache->entries,
+					struct guard_cache_entry);
+  e->record = r;
+  e->next = head;
+  *slot = e;
+  return true;
+}
+
+/* Return the cache of PFILE, opening and mapping its file the first
+   time.  */
+
+static struct _cpp_guard_cache *
+guard_cache_init (cpp_reader *pfile)
+{
+  if (pfile->guard_cache)
+    return pfile->guard_cache;
+
+  struct _cpp_guard_cache *cache = XCNEW (struct _cpp_guard_cache);
+  cache->mode = guard_cache_mode (pfile);
+  cache->table = htab_create_alloc (64, guard_cache_hash, guard_cache_eq,
+				    NULL, xcalloc, free);
+  obstack_specify_allocation (&cache->entries, 0, 0, xmalloc, free);
+  pfile->guard_cache = cache;
+
+  cache->map = _cpp_cache_file_map (CPP_OPTION (pfile, include_guard_cache),
+				    GUARD_CACHE_MAGIC, GUARD_CACHE_VERSION,
+				    &cache->map_size, &cache->disabled);
+  if (!cache->map)
+    return cache;
+
+  size_t offset = sizeof (struct cache_file_header);
+  const void *p;
+  while ((p = _cpp_cache_file_record (cache->map, cache->map_size, offset)))
+    {
+      const struct guard_cache_record *r
+	= (const struct guard_cache_record *) p;
+      if (guard_cache_valid_p (r, cache->map_size - offset)
+	  && r->mode == cache->mode)
+	guard_cache_enter (cache, r);
+      offset += r->size;
+    }
+
+  return cache;
+}
+
+/* Return true if PFILE can use the cache at all: the guards are those of
+   the contents as lexed, after any charset conversion.  */
+
+static bool
+guard_cache_usable_p (cpp_reader *pfile)
+{
+  return (CPP_OPTION (pfile, include_guard_cache)
+	  && !_cpp_input_needs_conversion (CPP_OPTION (pfile,
+						       input_charset)));
+}
+
+/* Return true if the guard macro of record R is defined in PFILE.  */
+
+static inline bool
+guard_cache_defined_p (cpp_reader *pfile, const struct guard_cache_record *r)
+{
+  return cpp_defined (pfile, (const unsigned char *) guard_cache_guard (r),
+		      r->guard_len);
+}
+
+/* Return the guard macro of the header at PATH if it is remembered and
+   currently defined, filling in *ST with the header's stat, or NULL.
+   PATH is only stat-ed if a header of the same base name has a guard
+   which is defined.  */
+
+const cpp_hashnode *
+_cpp_guard_cache_lookup (cpp_reader *pfile, const char *path, struct stat *st)
+{
+  if (!guard_cache_usable_p (pfile))
+    return NULL;
+
+  struct _cpp_guard_cache *cache = guard_cache_init (pfile);
+  const char *base = lbasename (path);
+  const struct guard_cache_entry *head
+    = (const struct guard_cache_entry *)
+      htab_find_with_hash (cache->table, base, htab_hash_string (base));
+
+  const struct guard_cache_entry *e;
+  for (e = head; e; e = e->next)
+    if (guard_cache_defined_p (pfile, e->record))
+      break;
+  if (!e || stat (path, st) != 0 || !S_ISREG (st->st_mode))
+    return NULL;
+
+  for (e = head; e; e = e->next)
+    {
+      const struct guard_cache_record *r = e->record;
+      if (r->dev == (uint64_t) st->st_dev
+	  && r->ino == (uint64_t) st->st_ino
+	  && r->fsize == (uint64_t) st->st_size
+	  && r->mtime == st->st_mtime
+	  && r->ctime == st->st_ctime
+	  && guard_cache_defined_p (pfile, r))
+	return cpp_lookup (pfile, (const unsigned char *) guard_cache_guard (r),
+			   r->guard_len);
+    }
+
+  return NULL;
+}
+
+/* Remember that the header at PATH, described by ST, is guarded by the
+   macro GUARD.  */
+
+void
+_cpp_guard_cache_add (cpp_reader *pfile, const char *path,
+		      const struct stat *st, const cpp_hashnode *guard)
+{
+  if (!guard_cache_usable_p (pfile) || !S_ISREG (st->st_mode))
+    return;
+
+  /* A header modified within the last second could be modified again
+     without its identity changing.  */
+  time_t now = time (NULL);
+  if (st->st_mtime >= now - 1 || st->st_ctime >= now - 1)
+    return;
+
+  const char *base = lbasename (path);
+  size_t guard_len = NODE_LEN (guard);
+  size_t base_len = strlen (base);
+  if (base_len == 0 || guard_len > UINT16_MAX || base_len > UINT16_MAX)
+    return;
+
+  struct _cpp_guard_cache *cache = guard_cache_init (pfile);
+  size_t size = (sizeof (struct guard_cache_record) + guard_len + base_len
+		 + 2 + 7) & -8;
+  struct guard_cache_record *r
+    = (struct guard_cache_record *) xcalloc (1, size);
+  r->size = size;
+  r->dev = st->st_dev;
+  r->ino = st->st_ino;
+  r->fsize = st->st_size;
+  r->mtime = st->st_mtime;
+  r->ctime = st->st_ctime;
+  r->mode = cache->mode;
+  r->guard_len = guard_len;
+  r->base_len = base_len;
+  memcpy ((char *) (r + 1), NODE_NAME (guard), guard_len);
+  memcpy ((char *) (r + 1) + guard_len + 1, base, base_len);
+  r->check = guard_cache_checksum (r);
+
+  if (!guard_cache_enter (cache, r))
+    {
+      free (r);
+      return;
+    }
+
+  if (cache->made_num == cache->made_alloc)
+    {
+      cache->made_alloc = cache->made_alloc * 2 + 16;
+      cache->made = XRESIZEVEC (struct guard_cache_record *, cache->made,
+				cache->made_alloc);
+    }
+  cache->made[cache->made_num++] = r;
+}
+
+/* Append the records made by PFILE to the cache file.  */
+
+void
+_cpp_guard_cache_flush (cpp_reader *pfile)
+{
+  struct _cpp_guard_cache *cache = pfile->guard_cache;
+  if (!cache || cache->written == cache->made_num || cache->disabled)
+    return;
+
+  size_t len = 0;
+  for (unsigned i = cache->written; i != cache->made_num; i++)
+    len += cache->made[i]->size;
+
+  char *buf = XNEWVEC (char, len), *p = buf;
+  for (unsigned i = cache->written; i != cache->made_num; i++)
+    {
+      memcpy (p, cache->made[i], cache->made[i]->size);
+      p += cache->made[i]->size;
+    }
+  if (_cpp_cache_file_append (CPP_OPTION (pfile, include_guard_cache),
+			      GUARD_CACHE_MAGIC, GUARD_CACHE_VERSION, buf, len,
+			      &cache->disabled))
+    cache->written = cache->made_num;
+  free (buf);
+}
+
+/* Release the cache of PFILE.  */
+
+void
+_cpp_guard_cache_free (cpp_reader *pfile)
+{
+  struct _cpp_guard_cache *cache = pfile->guard_cache;
+  if (!cache)
+    return;
+
+  htab_delete (cache->table);
+  obstack_free (&cache->entries, NULL);
+  for (unsigned i = 0; i != cache->made_num; i++)
+    free (cache->made[i]);
+  free (cache->made);
+#ifdef HAVE_SYS_MMAN_H
+  if (cache->map)
+    munmap (cache->map, cache->map_size);
+#endif
+  free (cache);
+  pfile->guard_cache = NULL;
+}
@@ -44,6 +44,75 @@ extern bool omnibor_enabled;
 
 extern void set_omnibor_enabled (bool);
 
+/* The directory in which the OmniBOR information is stored, or NULL if it
+   is not known.  It also holds the persistent cache of gitoids.  */
+extern const char *omnibor_dir;
+
+extern void set_omnibor_dir (const char *);
+
+/* The number of threads which calculate the OmniBOR gitoids of the
+   dependencies while the front end is parsing.  If zero, they are
+   calculated when the dependencies are read.  */
+extern int omnibor_jobs;
+
+extern void set_omnibor_jobs (int);
+
+/* Flag which indicates whether the OmniBOR Document and metadata files
+   are flushed to disk before they are renamed into place.  */
+extern bool omnibor_fsync;
+
+extern void set_omnibor_fsync (bool);
+
+/* Flag which indicates whether the OmniBOR Document files are appended to
+   the incoming pack file of the OmniBOR directory rather than written as
+   separate files.  */
+extern bool omnibor_pack;
+
+extern void set_omnibor_pack (bool);
+
+/* The path of the file which the compilation finally produces, as
+   resolved by the driver, or NULL if it is not known or the output goes
+   to stdout.  It is recorded in the OmniBOR metadata files.  */
+extern const char *omnibor_outfile;
+
+extern void set_omnibor_outfile (const char *);
+
+/* Statistics of the OmniBOR work of libcpp, for -ftime-report.  */
+struct cpp_omnibor_stats
+{
+  /* The number of files whose gitoids were calculated, rather than found
+     in the persistent gitoid cache, and their total size.  */
+  unsigned files_hashed;
+  unsigned long long bytes_hashed;
+
+  /* The number of lookups in the persistent gitoid cache which found the
+     gitoids of the file, and which did not.  */
+  unsigned cache_hits, cache_misses;
+
+  /* The number of cache misses whose gitoids the gitoid server of the
+     OmniBOR directory supplied.  */
+  unsigned server_hits;
+
+  /* The number of files and pack records written to the OmniBOR
+     directory, and their total size.  */
+  unsigned store_writes;
+  unsigned long long store_bytes;
+};
+
+extern void cpp_omnibor_get_stats (struct cpp_omnibor_stats *);
+
+/* Statistics of the include caches of a cpp_reader, for -ftime-report.  */
+struct cpp_include_cache_stats
+{
+  /* The number of include path lookups which the directory cache showed
+     could not find the file, so that it was not looked for.  */
+  unsigned dir_lookups_avoided;
+
+  /* The number of headers which were not read because the guard cache
+     remembered their include guard, and it was defined.  */
+  unsigned headers_not_read;
+};
+
 /* The first three groups, apart from '=', can appear in preprocessor
    expressions (+= and -= are used to indicate unary + and - resp.).
    This allows a lookup table to be implemented in _cpp_parse_expr.
@@ -518,6 +587,14 @@ struct cpp_options
   /* Holds the name of the input character set.  */
   const char *input_charset;
 
+  /* If nonzero, the file in which the names in the include directories
+     are remembered across compilations.  */
+  const char *include_dir_cache;
+
+  /* If nonzero, the file in which the include guards of headers are
+     remembered across compilations.  */
+  const char *include_guard_cache;
+
   /* The minimum permitted level of normalization before a warning
      is generated.  See enum cpp_normalize_level.  */
   int warn_normalize;
@@ -773,6 +850,10 @@ struct cpp_dir
      constructed by append_file_to_dir.  */
   char *(*construct) (const char *header, cpp_dir *dir);
 
+  /* The names in the directory, as found by -finclude-dir-cache, or
+     NULL if they have not been looked up yet.  */
+  const struct _cpp_dir_listing *listing;
+
   /* The C front end uses these to recognize duplicated
      directories in the search path.  */
   INO_T_CPP;
@@ -1018,6 +1099,14 @@ extern cpp_callbacks *cpp_get_callbacks (cpp_reader *) ATTRIBUTE_PURE;
 extern void cpp_set_callbacks (cpp_reader *, cpp_callbacks *);
 extern class mkdeps *cpp_get_deps (cpp_reader *) ATTRIBUTE_PURE;
 
+/* Fill in what the include caches of a reader have saved so far.  */
+extern void cpp_get_include_cache_stats (cpp_reader *,
+					 struct cpp_include_cache_stats *);
+
+/* Write what the output of a reader depends on besides the contents of
+   the files it read.  */
+extern void cpp_write_include_probes (cpp_reader *, FILE *);
+
 extern const char *cpp_probe_header_unit (cpp_reader *, const char *file,
 					  bool angle_p,  location_t);
 
@@ -26,6 +26,15 @@ along with this program; see the file COPYING3.  If not see
 #include "cpplib.h"
 #include <string>
 
+/* The SHA1 and SHA256 gitoids of a single dependency, as used by the
+   OmniBOR Document files.  */
+
+struct omnibor_gitoids
+{
+  unsigned char sha1[20];
+  unsigned char sha256[32];
+};
+
 /* This is the data structure used by all the functions in mkdeps.c.
    It's quite straightforward, but should be treated as opaque.  */
 
@@ -65,29 +74,97 @@ extern void deps_add_module_dep (struct mkdeps *, const char *module);
    dependency entered should be the primary source file.  */
 extern void deps_add_dep (class mkdeps *, const char *);
 
+/* Like deps_add_dep, but also record the OmniBOR gitoids of the
+   dependency's contents.  They are not copied, and need only have been
+   calculated by the time the OmniBOR Document files are written.  The
+   gitoids may be NULL, in which case the dependency is read back from
+   disk at that point.  */
+extern void deps_add_dep_with_gitoids (class mkdeps *, const char *,
+				       const struct omnibor_gitoids *);
+
+/* Record an input, such as an imported C++ module, in the OmniBOR
+   Document files only, with its gitoids and, unless NULL, the gitoids of
+   its own OmniBOR Document files.  The name and the gitoids are
+   copied.  */
+extern void deps_add_omnibor_input (cpp_reader *, const char *,
+				    const struct omnibor_gitoids *,
+				    const struct omnibor_gitoids *);
+
+/* Likewise, directly in a deps buffer.  */
+extern void deps_record_omnibor_input (class mkdeps *, const char *,
+				       const struct omnibor_gitoids *,
+				       const struct omnibor_gitoids *);
+
+/* Compute the SHA1 and SHA256 OmniBOR gitoids of the buffer of the given
+   length in a single pass over its contents.  */
+extern void deps_omnibor_hash_buffer (const unsigned char *, size_t,
+				      struct omnibor_gitoids *);
+
+/* Likewise for the contents of the given file descriptor, which must be
+   of the given length.  The file is read in chunks of fixed size.
+   Returns false if it cannot be read or its length differs.  */
+extern bool deps_omnibor_hash_fd (int, size_t, struct omnibor_gitoids *);
+
+/* Return the SHA1 and SHA256 OmniBOR gitoids of the regular file open on
+   the given file descriptor, taken from the persistent cache in the
+   OmniBOR directory if they are there, and added to it otherwise.
+   Returns NULL if the file cannot be read.  The gitoids remain valid
+   until the end of the process.  */
+extern const struct omnibor_gitoids *deps_omnibor_file_gitoids (int);
+
 /* Write out a deps buffer to a specified file.  The last argument
    is the number of columns to word-wrap at (0 means don't wrap).  */
 extern void deps_write (const cpp_reader *, FILE *, unsigned int);
 
-/* Write out a deps buffer to the SHA1 OmniBOR Document file in a required
-   format.  Second argument holds the path to a directory in which
-   the SHA1 OmniBOR Document file is to be stored.  */
-extern std::string deps_write_sha1_omnibor (const cpp_reader *, const char *);
-
-/* Write out a deps buffer to the SHA256 OmniBOR Document file in a required
-   format.  Second argument holds the path to a directory in which
-   the SHA256 OmniBOR Document file is to be stored.  */
-extern std::string deps_write_sha256_omnibor (const cpp_reader *, const char *);
+/* Calculate the SHA1 and SHA256 OmniBOR gitoids of every dependency in a
+   deps buffer which were not calculated when it was read, and wait for
+   those being calculated by worker threads.  deps_write_omnibor does it
+   too; calling it first only separates the hashing from the writing.  */
+extern void deps_omnibor_hash (class mkdeps *);
+
+/* Write out a deps buffer to both the SHA1 and the SHA256 OmniBOR Document
+   files in a required format, reading every dependency only once.  Second
+   argument holds the path to a directory in which the OmniBOR Document
+   files are to be stored.  The gitoids of the SHA1 and SHA256 OmniBOR
+   Document files are stored in the last two arguments; an empty string
+   means that the corresponding file could not be created.  */
+extern void deps_write_omnibor (class mkdeps *, const char *,
+				std::string *, std::string *);
+
+/* Split deps_write_omnibor in two, so that the caller can go on with its
+   own work meanwhile: deps_start_omnibor hands the deps buffer over and
+   may write the files on a thread of its own, and deps_finish_omnibor
+   waits for them and returns the gitoids of the OmniBOR Document files.  */
+extern void deps_start_omnibor (class mkdeps *, const char *);
+extern void deps_finish_omnibor (std::string *, std::string *);
+
+/* Stop the writing started by deps_start_omnibor and wait for it, leaving
+   no partly written file behind, when the process exits before
+   deps_finish_omnibor has been called.  */
+extern void deps_cancel_omnibor (void);
+
+/* Compute the gitoids of the SHA1 and SHA256 OmniBOR Document files which
+   deps_write_omnibor would write, without writing them.  All the
+   dependencies have to have been read.  */
+extern void deps_omnibor_document_gitoids (const cpp_reader *,
+					   struct omnibor_gitoids *);
 
 /* Write out a deps buffer to a file, in a form that can be read back
-   with deps_restore.  Returns nonzero on error, in which case the
-   error number will be in errno.  */
+   with deps_restore, together with the OmniBOR gitoids of the
+   dependencies which are known.  Returns nonzero on error, in which
+   case the error number will be in errno.  */
 extern int deps_save (class mkdeps *, FILE *);
 
 /* Read back dependency information written with deps_save into
    the deps buffer.  The third argument may be NULL, in which case
    the dependency information is just skipped, or it may be a filename,
-   in which case that filename is skipped.  */
-extern int deps_restore (class mkdeps *, FILE *, const char *);
+   in which case that filename is skipped.  The OmniBOR gitoids of the
+   dependencies, where they were known when they were saved, are read
+   back with them.  If the information is skipped while OmniBOR is
+   enabled, the dependencies are recorded with deps_record_omnibor_input
+   instead, and the cpp_reader is warned about those which cannot be
+   read.  */
+extern int deps_restore (class mkdeps *, FILE *, const char *,
+			 cpp_reader *);
 
 #endif /* ! LIBCPP_MKDEPS_H */
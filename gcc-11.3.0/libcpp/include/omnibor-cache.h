@@ -0,0 +1,32 @@
+/* The persistent cache of OmniBOR gitoids, for the programs which do not
+   otherwise use libcpp.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef LIBCPP_OMNIBOR_CACHE_H
+#define LIBCPP_OMNIBOR_CACHE_H
+
+/* This header does not need cpplib.h, so that the driver can use it.  */
+
+/* Store the SHA1 gitoid of the file PATH (20 bytes) in SHA1, taking it
+   from the persistent gitoid cache of the OmniBOR directory DIR if the
+   file has not changed since it was added there, and adding it there
+   otherwise.  DIR becomes the OmniBOR directory of libcpp if it has none
+   yet.  Returns false if the file cannot be read.  */
+extern bool omnibor_file_sha1_gitoid (const char *dir, const char *path,
+				      unsigned char *sha1);
+
+#endif /* ! LIBCPP_OMNIBOR_CACHE_H */
@@ -0,0 +1,80 @@
+/* OmniBOR pack files.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef LIBCPP_OMNIBOR_PACK_H
+#define LIBCPP_OMNIBOR_PACK_H
+
+/* Instead of one file per object, the OmniBOR information can be kept
+   in pack files in the objects/pack directory of the OmniBOR directory.
+   The compilers append their Document files to
+   objects/pack/incoming.pack, and the driver appends the metadata files
+   there once it has finished them.  The contrib/omnibor-pack script
+   compacts it, together with any loose files, into pack-<name>.pack
+   files, each with a pack-<name>.idx index sorted by gitoid.  Every
+   integer in these files is stored in big-endian byte order.
+
+   A pack file starts with the 16-byte header
+     "OBPACK01", version (4 bytes), zero (4 bytes)
+   followed by records made of the 56-byte header
+     "OBPR", kind (4 bytes), size (8 bytes), gitoid (32 bytes, a SHA1
+     gitoid is padded with zeros), checksum (4 bytes), zero (4 bytes)
+   and SIZE bytes of contents.  The checksum is the 32-bit FNV-1a hash of
+   the record header up to the checksum, followed by the contents; a
+   record whose checksum does not match is skipped by searching for the
+   next "OBPR".
+
+   An index file starts with the 16-byte header
+     "OBPKIDX1", version (4 bytes), number of entries (4 bytes)
+   followed by a fan-out table of 256 4-byte counts, the Ith being the
+   number of entries whose gitoid starts with a byte of at most I, and by
+   the 48-byte entries
+     gitoid (32 bytes), kind (4 bytes), zero (4 bytes), offset of the
+     record in the pack file (8 bytes)
+   sorted by gitoid and then kind.  */
+
+#define OMNIBOR_PACK_DIR "objects/pack"
+#define OMNIBOR_PACK_INCOMING "incoming.pack"
+
+/* The kinds of the objects in a pack.  */
+
+enum omnibor_pack_kind
+{
+  OMNIBOR_PACK_DOCUMENT_SHA1,
+  OMNIBOR_PACK_DOCUMENT_SHA256,
+  OMNIBOR_PACK_METADATA_SHA1,
+  OMNIBOR_PACK_METADATA_SHA256
+};
+
+/* Append an object of the given kind, with the given binary gitoid (of
+   20 or 32 bytes, according to the kind) and the given contents, to the
+   incoming pack file of the OmniBOR directory DIR.  Concurrent appenders
+   are serialized with an exclusive lock.  Returns false on error.  */
+extern bool omnibor_pack_append (const char *dir, enum omnibor_pack_kind,
+				 const unsigned char *, const void *, size_t);
+
+/* Return true if an object of the given kind and binary gitoid is in one
+   of the indexed pack files of the OmniBOR directory DIR, which takes a
+   binary search in each index, or in the records which start within the
+   last bytes of its incoming pack file given by the last argument, which
+   are scanned: none if it is 0, all of them if it is
+   OMNIBOR_PACK_INCOMING_ALL.  */
+extern bool omnibor_pack_find (const char *dir, enum omnibor_pack_kind,
+			       const unsigned char *, size_t);
+
+#define OMNIBOR_PACK_INCOMING_ALL ((size_t) -1)
+
+#endif /* ! LIBCPP_OMNIBOR_PACK_H */
@@ -0,0 +1,97 @@
+/* The protocol of the OmniBOR gitoid server.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef LIBCPP_OMNIBOR_SERVER_H
+#define LIBCPP_OMNIBOR_SERVER_H
+
+/* When a parallel build starts, every compilation finds the persistent
+   gitoid cache empty and hashes the same headers again.  The
+   omnibor-gitoid-server program from c++tools can be run for the
+   duration of the build instead: it listens on the local socket
+   OMNIBOR_SERVER_SOCKET of the OmniBOR directory and keeps the gitoids
+   of the files read by the compilations in memory.  A compilation which
+   finds no server there hashes the files itself.
+
+   The server and its clients run on the same machine, so the messages
+   are in host byte order.  A client asks for the gitoids of a file with
+   an OMNIBOR_SERVER_LOOKUP request, sending the descriptor of the file
+   open for reading as SCM_RIGHTS ancillary data, rather than its path,
+   which could be relative to a different working directory.  The server
+   answers at once from what it knows, with an omnibor_server_reply; it
+   never hashes while a client waits.  When it does not know the file, it
+   answers OMNIBOR_SERVER_UNKNOWN and hashes the file on a thread of its
+   own, reading it with pread to leave its offset alone, so that the
+   next compilation to ask finds it.  The client hashes the file itself
+   meanwhile.  The server only answers with the gitoids it calculated
+   itself, so that a client cannot make it give wrong ones to the
+   others.  A client keeps the connection open for its next request,
+   and drops it when the server is slow to answer or does not take a
+   whole request at once; the server likewise drops a client which does
+   not take its whole reply at once.
+
+   Only files which have not changed for a second are asked for, as only
+   their identity can be trusted; see omnibor_cache_insert.  The socket
+   is only accessible to the user who runs the server.  */
+
+#define OMNIBOR_SERVER_SOCKET "gitoid-server.sock"
+
+/* The first field of every message; it changes with their layout.  */
+#define OMNIBOR_SERVER_MAGIC 0x4f424733	/* "OBG3" */
+
+enum omnibor_server_kind
+{
+  OMNIBOR_SERVER_LOOKUP
+};
+
+/* The identity of the file, as given by fstat.  */
+
+struct omnibor_server_request
+{
+  uint32_t magic;
+  uint32_t kind;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime;
+  int64_t ctime;
+};
+
+enum omnibor_server_status
+{
+  OMNIBOR_SERVER_OK,
+
+  /* The file does not have the identity given in the request, or has
+     changed within the last second.  */
+  OMNIBOR_SERVER_CHANGED,
+
+  /* The file could not be read, or no descriptor came with the
+     request.  */
+  OMNIBOR_SERVER_ERROR,
+
+  /* The server has not hashed the file yet.  */
+  OMNIBOR_SERVER_UNKNOWN
+};
+
+struct omnibor_server_reply
+{
+  uint32_t magic;
+  uint32_t status;
+  unsigned char sha1[20];
+  unsigned char sha256[32];
+};
+
+#endif /* ! LIBCPP_OMNIBOR_SERVER_H */
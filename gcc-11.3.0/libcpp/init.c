@@ -184,6 +184,46 @@ set_omnibor_enabled (bool omnibor_flag)
   omnibor_enabled = omnibor_flag;
 }
 
+const char *omnibor_dir = NULL;
+
+void
+set_omnibor_dir (const char *dir)
+{
+  omnibor_dir = dir;
+}
+
+int omnibor_jobs = 0;
+
+void
+set_omnibor_jobs (int jobs)
+{
+  omnibor_jobs = jobs;
+}
+
+bool omnibor_fsync = false;
+
+void
+set_omnibor_fsync (bool fsync_flag)
+{
+  omnibor_fsync = fsync_flag;
+}
+
+bool omnibor_pack = false;
+
+void
+set_omnibor_pack (bool pack_flag)
+{
+  omnibor_pack = pack_flag;
+}
+
+const char *omnibor_outfile = NULL;
+
+void
+set_omnibor_outfile (const char *outfile)
+{
+  omnibor_outfile = outfile;
+}
+
 /* Initialize a cpp_reader structure.  */
 cpp_reader *
 cpp_create_reader (enum c_lang lang, cpp_hash_table *table,
@@ -340,6 +380,8 @@ cpp_destroy (cpp_reader *pfile)
 
   _cpp_destroy_hashtable (pfile);
   _cpp_cleanup_files (pfile);
+  _cpp_dir_cache_free (pfile);
+  _cpp_guard_cache_free (pfile);
   _cpp_destroy_iconv (pfile);
 
   _cpp_free_buff (pfile->a_buff);
@@ -863,6 +905,9 @@ cpp_finish (cpp_reader *pfile, FILE *deps_stream)
   if (deps_stream)
     deps_write (pfile, deps_stream, 72);
 
+  _cpp_dir_cache_flush (pfile);
+  _cpp_guard_cache_flush (pfile);
+
   /* Report on headers that could use multiple include guards.  */
   if (CPP_OPTION (pfile, print_include_names))
     _cpp_report_missing_guards (pfile);
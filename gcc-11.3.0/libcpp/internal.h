@@ -104,6 +104,7 @@ struct _cpp_buff
 
 extern _cpp_buff *_cpp_get_buff (cpp_reader *, size_t);
 extern void _cpp_release_buff (cpp_reader *, _cpp_buff *);
+extern void _cpp_recycle_buff (cpp_reader *, _cpp_buff *);
 extern void _cpp_extend_buff (cpp_reader *, _cpp_buff **, size_t);
 extern _cpp_buff *_cpp_append_extend_buff (cpp_reader *, _cpp_buff *, size_t);
 extern void _cpp_free_buff (_cpp_buff *);
@@ -222,10 +223,8 @@ struct cpp_context
      we are in a macro context, this is a pointer to an instance of
      cpp_hashnode, representing the name of the macro this context is
      for.  If we are not in a macro context, then this is just NULL.
-     Note that when tokens_kind is TOKEN_KIND_EXTENDED, the memory
-     used by the instance of macro_context pointed to by this member
-     is de-allocated upon de-allocation of the instance of struct
-     cpp_context.  */
+     Note that when tokens_kind is TOKEN_KIND_EXTENDED, the instance
+     of macro_context pointed to by this member is MC_STORAGE below.  */
   union
   {
     macro_context *mc;
@@ -234,6 +233,11 @@ struct cpp_context
 
   /* This determines the type of tokens held by this context.  */
   enum context_tokens_kind tokens_kind;
+
+  /* The macro_context of an extended context.  Contexts are kept on
+     the NEXT chain for reuse once popped, so this saves allocating
+     one for every macro expansion.  */
+  macro_context mc_storage;
 };
 
 struct lexer_state
@@ -329,6 +333,8 @@ struct cpp_buffer
   const unsigned char *rlimit;     /* Writable byte at end of file.  */
   const unsigned char *to_free;	   /* Pointer that should be freed when
 				      popping the buffer.  */
+  size_t to_free_mapped;	   /* If nonzero, TO_FREE is a mapping of
+				      this many bytes, to be unmapped.  */
 
   _cpp_line_note *notes;           /* Array of notes.  */
   unsigned int cur_note;           /* Next note to process.  */
@@ -474,6 +480,17 @@ struct cpp_reader
   struct htab *nonexistent_file_hash;
   struct obstack nonexistent_file_ob;
 
+  /* The cache of the names in the include directories, or NULL if it
+     has not been used.  See dircache.c.  */
+  struct _cpp_dir_cache *dir_cache;
+
+  /* The cache of the include guards of headers, or NULL if it has not
+     been used.  See guardcache.c.  */
+  struct _cpp_guard_cache *guard_cache;
+
+  /* What the two caches above have saved.  */
+  struct cpp_include_cache_stats include_cache_stats;
+
   /* Nonzero means don't look for #include "foo" the source-file
      directory.  */
   bool quote_ignores_source_dir;
@@ -527,6 +544,10 @@ struct cpp_reader
   time_t time_stamp;
   int time_stamp_kind; /* Or errno.  */
 
+  /* True if the output depends on the current date or time, or on the
+     modification time of a file.  See cpp_write_include_probes.  */
+  bool time_dependent;
+
   /* A token forcing paste avoidance, and one demarking macro arguments.  */
   cpp_token avoid_paste;
   cpp_token endarg;
@@ -714,7 +735,7 @@ extern void _cpp_report_missing_guards (cpp_reader *);
 extern void _cpp_init_files (cpp_reader *);
 extern void _cpp_cleanup_files (cpp_reader *);
 extern void _cpp_pop_file_buffer (cpp_reader *, struct _cpp_file *,
-				  const unsigned char *);
+				  const unsigned char *, size_t);
 extern bool _cpp_save_file_entries (cpp_reader *pfile, FILE *f);
 extern bool _cpp_read_file_entries (cpp_reader *, FILE *);
 extern const char *_cpp_get_file_name (_cpp_file *);
@@ -722,6 +743,59 @@ extern struct stat *_cpp_get_file_stat (_cpp_file *);
 extern bool _cpp_has_header (cpp_reader *, const char *, int,
 			     enum include_type);
 
+/* The cache files of dircache.c and guardcache.c start with a
+   cache_file_header, followed by records which start with a checksum
+   and their size, a multiple of 8.  */
+struct cache_file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t zero;
+};
+
+struct cache_file_record
+{
+  uint32_t check;
+  uint32_t size;
+};
+
+/* In dircache.c */
+extern void *_cpp_cache_file_map (const char *, const char *, uint32_t,
+				  size_t *, bool *);
+extern const void *_cpp_cache_file_record (const void *, size_t, size_t);
+extern bool _cpp_cache_file_append (const char *, const char *, uint32_t,
+				    const void *, size_t, bool *);
+extern bool _cpp_dir_cache_may_exist (cpp_reader *, cpp_dir *, const char *);
+extern void _cpp_dir_cache_flush (cpp_reader *);
+extern void _cpp_dir_cache_free (cpp_reader *);
+
+/* In guardcache.c */
+extern const cpp_hashnode *_cpp_guard_cache_lookup (cpp_reader *,
+						    const char *,
+						    struct stat *);
+extern void _cpp_guard_cache_add (cpp_reader *, const char *,
+				  const struct stat *, const cpp_hashnode *);
+extern void _cpp_guard_cache_flush (cpp_reader *);
+extern void _cpp_guard_cache_free (cpp_reader *);
+
+/* In omnibor.c */
+extern const struct omnibor_gitoids *_cpp_omnibor_lookup (const struct stat *,
+							  int);
+extern const struct omnibor_gitoids *_cpp_omnibor_hash (const struct stat *,
+							const unsigned char *,
+							size_t);
+extern const struct omnibor_gitoids *_cpp_omnibor_hash_fd (const struct stat *,
+							   int);
+extern void _cpp_omnibor_finish_hashing (void);
+extern void _cpp_omnibor_mkdirs (const char *);
+extern void _cpp_omnibor_cache_flush (void);
+extern bool _cpp_omnibor_store_write (const char *, const char *,
+				      const char *, const void *, size_t,
+				      bool);
+extern void _cpp_omnibor_count_store (size_t);
+extern void _cpp_omnibor_cancel (void);
+extern bool _cpp_omnibor_cancelled (void);
+
 /* In expr.c */
 extern bool _cpp_parse_expr (cpp_reader *, bool);
 extern struct op *_cpp_expand_op_stack (cpp_reader *);
@@ -824,6 +898,7 @@ extern void _cpp_destroy_iconv (cpp_reader *);
 extern unsigned char *_cpp_convert_input (cpp_reader *, const char *,
 					  unsigned char *, size_t, size_t,
 					  const unsigned char **, off_t *);
+extern bool _cpp_input_needs_conversion (const char *);
 extern const char *_cpp_default_encoding (void);
 extern cpp_hashnode * _cpp_interpret_identifier (cpp_reader *pfile,
 						 const unsigned char *id,
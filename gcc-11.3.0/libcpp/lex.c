@@ -487,6 +487,129 @@ search_line_sse42 (const uchar *s, const uchar *end)
 #define search_line_sse42 search_line_sse2
 #endif
 
+#if defined (HAVE_AVX2) && (GCC_VERSION >= 4008)
+/* A version of the fast scanner using AVX2 vectorized byte compare insns,
+   processing 32 bytes at a time.  The buffers are only padded for the
+   16-byte blocks of the SSE2 version, so only the 16-byte blocks from
+   the one holding S to the one holding END are read: the first 32 bytes
+   with an unaligned load, then aligned 32-byte blocks, and a last
+   16-byte block by the SSE2 version.  */
+
+static const uchar *
+#ifndef __AVX2__
+__attribute__((__target__("avx2")))
+#endif
+search_line_avx2 (const uchar *s, const uchar *end)
+{
+  typedef char v32qi __attribute__ ((__vector_size__ (32)));
+  typedef char v32qi_u __attribute__ ((__vector_size__ (32),
+				       __aligned__ (1)));
+
+  const v32qi zero = { 0 };
+  const v32qi repl_nl = zero + '\n';
+  const v32qi repl_cr = zero + '\r';
+  const v32qi repl_bs = zero + '\\';
+  const v32qi repl_qm = zero + '?';
+
+  const uchar *p = (const uchar *)((uintptr_t)s & -16);
+  const uchar *limit = (const uchar *)(((uintptr_t)end & -16) + 16);
+  unsigned int found, mask;
+  v32qi data, t;
+
+  if (limit - p < 32)
+    return search_line_sse2 (s, end);
+
+  /* Create a mask for the bytes that are valid within the first
+     32 bytes.  */
+  data = *(const v32qi_u *)p;
+  mask = -1u << (s - p);
+
+  for (;;)
+    {
+      t  = data == repl_nl;
+      t |= data == repl_cr;
+      t |= data == repl_bs;
+      t |= data == repl_qm;
+      found = __builtin_ia32_pmovmskb256 (t);
+      found &= mask;
+      if (found)
+	break;
+
+      /* Go on with the next aligned block.  After the first one, it may
+	 overlap bytes already found not to match.  */
+      p = (const uchar *)(((uintptr_t)p + 32) & -32);
+      if (limit - p < 32)
+	return search_line_sse2 (p, end);
+      data = *(const v32qi *)p;
+      mask = -1;
+    }
+
+  /* FOUND contains 1 in bits for which we matched a relevant
+     character.  Conversion to the byte index is trivial.  */
+  found = __builtin_ctz (found);
+  return p + found;
+}
+#else
+#define search_line_avx2 search_line_sse42
+#endif
+
+#if defined (HAVE_AVX512BW) && (GCC_VERSION >= 5000)
+/* A version of the fast scanner using AVX-512BW byte compares into mask
+   registers, processing 64 bytes at a time.  It reads the same 16-byte
+   blocks as the AVX2 version, and leaves the last ones to it.  */
+
+static const uchar *
+#ifndef __AVX512BW__
+__attribute__((__target__("avx512bw")))
+#endif
+search_line_avx512bw (const uchar *s, const uchar *end)
+{
+  typedef char v64qi __attribute__ ((__vector_size__ (64)));
+  typedef char v64qi_u __attribute__ ((__vector_size__ (64),
+				       __aligned__ (1)));
+
+  const v64qi zero = { 0 };
+  const v64qi repl_nl = zero + '\n';
+  const v64qi repl_cr = zero + '\r';
+  const v64qi repl_bs = zero + '\\';
+  const v64qi repl_qm = zero + '?';
+
+  const uchar *p = (const uchar *)((uintptr_t)s & -16);
+  const uchar *limit = (const uchar *)(((uintptr_t)end & -16) + 16);
+  unsigned long long found, mask;
+  v64qi data;
+
+  if (limit - p < 64)
+    return search_line_avx2 (s, end);
+
+  /* Create a mask for the bytes that are valid within the first
+     64 bytes.  Each compare is masked with it.  */
+  data = *(const v64qi_u *)p;
+  mask = -1ull << (s - p);
+
+  for (;;)
+    {
+      found  = __builtin_ia32_pcmpeqb512_mask (data, repl_nl, mask);
+      found |= __builtin_ia32_pcmpeqb512_mask (data, repl_cr, mask);
+      found |= __builtin_ia32_pcmpeqb512_mask (data, repl_bs, mask);
+      found |= __builtin_ia32_pcmpeqb512_mask (data, repl_qm, mask);
+      if (found)
+	break;
+
+      p = (const uchar *)(((uintptr_t)p + 64) & -64);
+      if (limit - p < 64)
+	return search_line_avx2 (p, end);
+      data = *(const v64qi *)p;
+      mask = -1;
+    }
+
+  found = __builtin_ctzll (found);
+  return p + found;
+}
+#else
+#define search_line_avx512bw search_line_avx2
+#endif
+
 /* Check the CPU capabilities.  */
 
 #include "../gcc/config/i386/cpuid.h"
@@ -528,6 +651,24 @@ init_vectorized_lexer (void)
 	impl = search_line_mmx;
     }
 
+#if (defined (HAVE_AVX2) && (GCC_VERSION >= 4008)) \
+    || (defined (HAVE_AVX512BW) && (GCC_VERSION >= 5000))
+  /* The wider scanners also need the OS to save the YMM (and for
+     AVX-512, the ZMM and mask) registers, as told by XCR0.  */
+  unsigned ebx = 0;
+  if (__get_cpuid (1, &dummy, &dummy, &ecx, &edx)
+      && (ecx & bit_OSXSAVE)
+      && __get_cpuid_count (7, 0, &dummy, &ebx, &dummy, &dummy))
+    {
+      unsigned xcr0, xcr0_hi;
+      __asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+      if ((ebx & bit_AVX512BW) && (xcr0 & 0xe6) == 0xe6)
+	impl = search_line_avx512bw;
+      else if ((ebx & bit_AVX2) && (xcr0 & 0x6) == 0x6)
+	impl = search_line_avx2;
+    }
+#endif
+
   search_line_fast = impl;
 }
 
@@ -1067,7 +1208,10 @@ _cpp_clean_line (cpp_reader *pfile)
     }
 
  done:
-  *d = '\n';
+  /* Leave the buffer alone if the line already ends in '\n', so that a
+     mapped file is not copied page by page.  */
+  if (*d != '\n')
+    *d = '\n';
   /* A sentinel note that should never be processed.  */
   add_line_note (buffer, d + 1, '\n');
   buffer->next_line = s + 1;
@@ -3832,6 +3976,10 @@ cpp_output_line_to_string (cpp_reader *pfile, const unsigned char *dir_name)
   #error BUFF_SIZE_UPPER_BOUND must be at least as large as MIN_BUFF_SIZE!
 #endif
 
+/* _cpp_recycle_buff frees buffers larger than this rather than keep
+   them on the free list.  */
+#define MAX_RECYCLED_BUFF_SIZE (8 * MIN_BUFF_SIZE)
+
 /* Create a new allocation buffer.  Place the control block at the end
    of the buffer, so that buffer overflows will cause immediate chaos.  */
 static _cpp_buff *
@@ -3874,6 +4022,28 @@ _cpp_release_buff (cpp_reader *pfile, _cpp_buff *buff)
   pfile->free_buffs = buff;
 }
 
+/* Place the buffers of the chain BUFF on the free list, except for the
+   large ones, which are freed.  This is for the buffers of macro
+   expansions, which come and go all the time: handing them back to
+   malloc costs more than the expansion itself, but the odd buffer for
+   a huge expansion is seldom reused and should not stay around for
+   the rest of the compilation.  */
+void
+_cpp_recycle_buff (cpp_reader *pfile, _cpp_buff *buff)
+{
+  _cpp_buff *next;
+
+  for (; buff; buff = next)
+    {
+      next = buff->next;
+      buff->next = NULL;
+      if ((size_t) (buff->limit - buff->base) > MAX_RECYCLED_BUFF_SIZE)
+	_cpp_free_buff (buff);
+      else
+	_cpp_release_buff (pfile, buff);
+    }
+}
+
 /* Return a free buffer of size at least MIN_SIZE.  */
 _cpp_buff *
 _cpp_get_buff (cpp_reader *pfile, size_t min_size)
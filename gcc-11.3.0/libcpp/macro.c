@@ -44,6 +44,8 @@ struct macro_arg
   location_t *expanded_virt_locs; /* Where virtual locations for
 					  expanded tokens are
 					  stored.  */
+  _cpp_buff *expanded_buff;	/* Holds EXPANDED and
+				   EXPANDED_VIRT_LOCS.  */
 };
 
 /* The kind of macro tokens which the instance of
@@ -288,9 +290,10 @@ static const cpp_token *stringify_arg (cpp_reader *, macro_arg *);
 static void paste_all_tokens (cpp_reader *, const cpp_token *);
 static bool paste_tokens (cpp_reader *, location_t,
 			  const cpp_token **, const cpp_token *);
-static void alloc_expanded_arg_mem (cpp_reader *, macro_arg *, size_t);
+static size_t alloc_expanded_arg_mem (cpp_reader *, macro_arg *, size_t);
 static void ensure_expanded_arg_room (cpp_reader *, macro_arg *, size_t, size_t *);
-static void delete_macro_args (_cpp_buff*, unsigned num_args);
+static void delete_macro_args (cpp_reader *, _cpp_buff*,
+			       unsigned num_args);
 static void set_arg_token (macro_arg *, const cpp_token *,
 			   location_t, size_t,
 			   enum macro_arg_token_kind,
@@ -494,6 +497,7 @@ _cpp_builtin_macro_text (cpp_reader *pfile, cpp_hashnode *node,
 	  cpp_warning (pfile, CPP_W_DATE_TIME, "macro \"%s\" might prevent "
 		       "reproducible builds", NODE_NAME (node));
 
+	pfile->time_dependent = true;
 	cpp_buffer *pbuffer = cpp_get_buffer (pfile);
 	if (pbuffer->timestamp == NULL)
 	  {
@@ -708,6 +712,8 @@ cpp_get_date (cpp_reader *pfile, time_t *result)
     }
 
   *result = pfile->time_stamp;
+  if (pfile->time_stamp_kind != int (CPP_time_kind::FIXED))
+    pfile->time_dependent = true;
   if (pfile->time_stamp_kind >= 0)
     {
       errno = pfile->time_stamp_kind;
@@ -1125,7 +1131,7 @@ static _cpp_buff *
 collect_args (cpp_reader *pfile, const cpp_hashnode *node,
 	      _cpp_buff **pragma_buff, unsigned *num_args)
 {
-  _cpp_buff *buff, *base_buff;
+  _cpp_buff *buff, *base_buff, *locs_buff = NULL, *locs_base_buff = NULL;
   cpp_macro *macro;
   macro_arg *args, *arg;
   const cpp_token *token;
@@ -1147,6 +1153,19 @@ collect_args (cpp_reader *pfile, const cpp_hashnode *node,
 				       * sizeof (cpp_token *)
 				       + sizeof (macro_arg)));
   base_buff = buff;
+
+  /* The virtual locations of the tokens of the arguments go into a
+     second chain of buffers, laid out like the first.  It is hung off
+     the end of the first before returning, so that the two are
+     released together.  */
+  if (track_macro_expansion_p)
+    {
+      locs_buff = _cpp_get_buff (pfile,
+				 argc * DEFAULT_NUM_TOKENS_PER_MACRO_ARG
+				 * sizeof (location_t));
+      locs_base_buff = locs_buff;
+    }
+
   args = (macro_arg *) buff->base;
   memset (args, 0, argc * sizeof (macro_arg));
   buff->cur = (unsigned char *) &args[argc];
@@ -1159,17 +1178,12 @@ collect_args (cpp_reader *pfile, const cpp_hashnode *node,
     {
       unsigned int paren_depth = 0;
       unsigned int ntokens = 0;
-      unsigned virt_locs_capacity = DEFAULT_NUM_TOKENS_PER_MACRO_ARG;
       num_args_alloced++;
 
       argc++;
       arg->first = (const cpp_token **) buff->cur;
       if (track_macro_expansion_p)
-	{
-	  virt_locs_capacity = DEFAULT_NUM_TOKENS_PER_MACRO_ARG;
-	  arg->virt_locs = XNEWVEC (location_t,
-				    virt_locs_capacity);
-	}
+	arg->virt_locs = (location_t *) locs_buff->cur;
 
       for (;;)
 	{
@@ -1182,12 +1196,13 @@ collect_args (cpp_reader *pfile, const cpp_hashnode *node,
 	      arg->first = (const cpp_token **) buff->cur;
 	    }
 	  if (track_macro_expansion_p
-	      && (ntokens + 2 > virt_locs_capacity))
+	      && (unsigned char *) &arg->virt_locs[ntokens + 2]
+		 > locs_buff->limit)
 	    {
-	      virt_locs_capacity += ARG_TOKENS_EXTENT;
-	      arg->virt_locs = XRESIZEVEC (location_t,
-					   arg->virt_locs,
-					   virt_locs_capacity);
+	      locs_buff = _cpp_append_extend_buff (pfile, locs_buff,
+						   ARG_TOKENS_EXTENT
+						   * sizeof (location_t));
+	      arg->virt_locs = (location_t *) locs_buff->cur;
 	    }
 
 	  token = cpp_get_token_1 (pfile, &virt_loc);
@@ -1282,12 +1297,16 @@ collect_args (cpp_reader *pfile, const cpp_hashnode *node,
       if (argc <= macro->paramc)
 	{
 	  buff->cur = (unsigned char *) &arg->first[ntokens + 1];
+	  if (track_macro_expansion_p)
+	    locs_buff->cur = (unsigned char *) &arg->virt_locs[ntokens + 1];
 	  if (argc != macro->paramc)
 	    arg++;
 	}
     }
   while (token->type != CPP_CLOSE_PAREN && token->type != CPP_EOF);
 
+  buff->next = locs_base_buff;
+
   if (token->type == CPP_EOF)
     {
       /* Unless the EOF is marking the end of an argument, it's a fake
@@ -1459,7 +1478,7 @@ enter_macro_context (cpp_reader *pfile, cpp_hashnode *node,
 	  /* Free the memory used by the arguments of this
 	     function-like macro.  This memory has been allocated by
 	     funlike_invocation_p and by replace_args.  */
-	  delete_macro_args (buff, num_args);
+	  delete_macro_args (pfile, buff, num_args);
 	}
 
       /* Disable the macro within its expansion.  */
@@ -1564,9 +1583,10 @@ enter_macro_context (cpp_reader *pfile, cpp_hashnode *node,
 
 /* De-allocate the memory used by BUFF which is an array of instances
    of macro_arg.  NUM_ARGS is the number of instances of macro_arg
-   present in BUFF.  */
+   present in BUFF.  BUFF itself goes back to the free list of
+   PFILE.  */
 static void
-delete_macro_args (_cpp_buff *buff, unsigned num_args)
+delete_macro_args (cpp_reader *pfile, _cpp_buff *buff, unsigned num_args)
 {
   macro_arg *macro_args;
   unsigned i;
@@ -1576,27 +1596,15 @@ delete_macro_args (_cpp_buff *buff, unsigned num_args)
 
   macro_args = (macro_arg *) buff->base;
 
-  /* Walk instances of macro_arg to free their expanded tokens as well
-     as their macro_arg::virt_locs members.  */
+  /* Walk instances of macro_arg to release their expanded tokens.
+     Their macro_arg::virt_locs members live in the chain of BUFF.  */
   for (i = 0; i < num_args; ++i)
-    {
-      if (macro_args[i].expanded)
-	{
-	  free (macro_args[i].expanded);
-	  macro_args[i].expanded = NULL;
-	}
-      if (macro_args[i].virt_locs)
-	{
-	  free (macro_args[i].virt_locs);
-	  macro_args[i].virt_locs = NULL;
-	}
-      if (macro_args[i].expanded_virt_locs)
-	{
-	  free (macro_args[i].expanded_virt_locs);
-	  macro_args[i].expanded_virt_locs = NULL;
-	}
-    }
-  _cpp_free_buff (buff);
+    if (macro_args[i].expanded_buff)
+      {
+	_cpp_recycle_buff (pfile, macro_args[i].expanded_buff);
+	macro_args[i].expanded_buff = NULL;
+      }
+  _cpp_recycle_buff (pfile, buff);
 }
 
 /* Set the INDEXth token of the macro argument ARG. TOKEN is the token
@@ -1931,16 +1939,16 @@ replace_args (cpp_reader *pfile, cpp_hashnode *node, cpp_macro *macro,
      So the buffer BUFF holds a set of cpp_token*, and the buffer
      VIRT_LOCS holds the virtual locations of the tokens held by BUFF.
 
-     Both of these two buffers are going to be hung off of the macro
-     context, when the latter is pushed.  The memory allocated to
-     store the tokens and their locations is going to be freed once
-     the context of macro expansion is popped.
+     Both of these two arrays live in one buffer that is going to be
+     hung off of the macro context, when the latter is pushed.  That
+     buffer goes back to the free list once the context of macro
+     expansion is popped.
      
      As far as tokens are concerned, the memory overhead of
      -ftrack-macro-expansion is proportional to the number of
      macros that get expanded multiplied by sizeof (location_t).
-     The good news is that extra memory gets freed when the macro
-     context is freed, i.e shortly after the macro got expanded.  */
+     The good news is that extra memory gets released when the macro
+     context is popped, i.e shortly after the macro got expanded.  */
 
   /* Is the -ftrack-macro-expansion flag in effect?  */
   track_macro_exp = CPP_OPTION (pfile, track_macro_expansion);
@@ -2350,8 +2358,8 @@ _cpp_push_token_context (cpp_reader *pfile, cpp_hashnode *macro,
    virtual locations and push it.  TOKENS_BUFF is the buffer that
    contains the tokens pointed to by FIRST.  If TOKENS_BUFF is
    non-NULL, it means that the context owns it, meaning that
-   _cpp_pop_context will free it as well as VIRT_LOCS_BUFF that
-   contains the virtual locations.
+   _cpp_pop_context will release it, together with the virtual
+   locations VIRT_LOCS that tokens_buff_new put in it.
 
    A NULL macro means that we should continue the current macro
    expansion, in essence.  That means that if we are currently in a
@@ -2375,7 +2383,7 @@ push_extended_tokens_context (cpp_reader *pfile,
   context->tokens_kind = TOKENS_KIND_EXTENDED;
   context->buff = token_buff;
 
-  m = XNEW (macro_context);
+  m = &context->mc_storage;
   m->macro_node = macro;
   m->virt_locs = virt_locs;
   m->cur_virt_loc = virt_locs;
@@ -2402,19 +2410,25 @@ _cpp_push_text_context (cpp_reader *pfile, cpp_hashnode *macro,
 /* Creates a buffer that holds tokens a.k.a "token buffer", usually
    for the purpose of storing them on a cpp_context. If VIRT_LOCS is
    non-null (which means that -ftrack-macro-expansion is on),
-   *VIRT_LOCS is set to a newly allocated buffer that is supposed to
-   hold the virtual locations of the tokens resulting from macro
-   expansion.  */
+   *VIRT_LOCS is set to an array that is supposed to hold the virtual
+   locations of the tokens resulting from macro expansion.  That array
+   lives in the returned buffer, after room for LEN tokens, so that
+   both go back to the free list in one go when the context is
+   popped.  */
 static _cpp_buff*
 tokens_buff_new (cpp_reader *pfile, size_t len,
 		 location_t **virt_locs)
 {
   size_t tokens_size = len * sizeof (cpp_token *);
   size_t locs_size = len * sizeof (location_t);
+  _cpp_buff *buff;
 
-  if (virt_locs != NULL)
-    *virt_locs = XNEWVEC (location_t, locs_size);
-  return _cpp_get_buff (pfile, tokens_size);
+  if (virt_locs == NULL)
+    return _cpp_get_buff (pfile, tokens_size);
+
+  buff = _cpp_get_buff (pfile, tokens_size + locs_size);
+  *virt_locs = (location_t *) (buff->base + tokens_size);
+  return buff;
 }
 
 /* Returns the number of tokens contained in a token buffer.  The
@@ -2527,8 +2541,11 @@ tokens_buff_add_token (_cpp_buff *buffer,
   unsigned token_index = 
     (BUFF_FRONT (buffer) - buffer->base) / sizeof (cpp_token *);
 
-  /* Abort if we pass the end the buffer.  */
-  if (BUFF_FRONT (buffer) > BUFF_LIMIT (buffer))
+  /* Abort if we pass the end the buffer, or the end of the room for
+     tokens that tokens_buff_new left in front of VIRT_LOCS.  */
+  if (BUFF_FRONT (buffer) >= (virt_locs != NULL
+			      ? (unsigned char *) virt_locs
+			      : BUFF_LIMIT (buffer)))
     abort ();
 
   if (virt_locs != NULL)
@@ -2544,19 +2561,42 @@ tokens_buff_add_token (_cpp_buff *buffer,
 }
 
 /* Allocate space for the function-like macro argument ARG to store
-   the tokens resulting from the macro-expansion of the tokens that
-   make up ARG itself. That space is allocated in ARG->expanded and
-   needs to be freed using free.  */
-static void
+   at least CAPACITY tokens resulting from the macro-expansion of the
+   tokens that make up ARG itself, and their virtual locations.  That
+   space is a buffer from the free list, ARG->expanded_buff, which
+   delete_macro_args releases; the tokens ARG already holds are moved
+   over to it.  Return the number of tokens the space can hold.  */
+static size_t
 alloc_expanded_arg_mem (cpp_reader *pfile, macro_arg *arg, size_t capacity)
 {
-  gcc_checking_assert (arg->expanded == NULL
-		       && arg->expanded_virt_locs == NULL);
+  size_t token_size = sizeof (cpp_token *);
+  const cpp_token **expanded;
+  location_t *virt_locs = NULL;
+  _cpp_buff *buff;
 
-  arg->expanded = XNEWVEC (const cpp_token *, capacity);
   if (CPP_OPTION (pfile, track_macro_expansion))
-    arg->expanded_virt_locs = XNEWVEC (location_t, capacity);
+    token_size += sizeof (location_t);
+  buff = _cpp_get_buff (pfile, capacity * token_size);
+  /* The buffer can be larger than asked for; use all of it.  */
+  capacity = (buff->limit - buff->base) / token_size;
+  expanded = (const cpp_token **) buff->base;
+  if (CPP_OPTION (pfile, track_macro_expansion))
+    virt_locs = (location_t *) &expanded[capacity];
+
+  if (arg->expanded_buff)
+    {
+      memcpy (expanded, arg->expanded,
+	      arg->expanded_count * sizeof (cpp_token *));
+      if (virt_locs)
+	memcpy (virt_locs, arg->expanded_virt_locs,
+		arg->expanded_count * sizeof (location_t));
+      _cpp_recycle_buff (pfile, arg->expanded_buff);
+    }
 
+  arg->expanded_buff = buff;
+  arg->expanded = expanded;
+  arg->expanded_virt_locs = virt_locs;
+  return capacity;
 }
 
 /* If necessary, enlarge ARG->expanded to so that it can contain SIZE
@@ -2568,21 +2608,7 @@ ensure_expanded_arg_room (cpp_reader *pfile, macro_arg *arg,
   if (size <= *expanded_capacity)
     return;
 
-  size *= 2;
-
-  arg->expanded =
-    XRESIZEVEC (const cpp_token *, arg->expanded, size);
-  *expanded_capacity = size;
-
-  if (CPP_OPTION (pfile, track_macro_expansion))
-    {
-      if (arg->expanded_virt_locs == NULL)
-	arg->expanded_virt_locs = XNEWVEC (location_t, size);
-      else
-	arg->expanded_virt_locs = XRESIZEVEC (location_t,
-					      arg->expanded_virt_locs,
-					      size);
-    }
+  *expanded_capacity = alloc_expanded_arg_mem (pfile, arg, size * 2);
 }
 
 /* Expand an argument ARG before replacing parameters in a
@@ -2607,8 +2633,7 @@ expand_arg (cpp_reader *pfile, macro_arg *arg)
   CPP_WTRADITIONAL (pfile) = 0;
 
   /* Loop, reading in the tokens of the argument.  */
-  capacity = 256;
-  alloc_expanded_arg_mem (pfile, arg, capacity);
+  capacity = alloc_expanded_arg_mem (pfile, arg, 256);
 
   if (track_macro_exp_p)
     push_extended_tokens_context (pfile, NULL, NULL,
@@ -2671,9 +2696,10 @@ in_macro_expansion_p (cpp_reader *pfile)
 }
 
 /* Pop the current context off the stack, re-enabling the macro if the
-   context represented a macro's replacement list.  Initially the
-   context structure was not freed so that we can re-use it later, but
-   now we do free it to reduce peak memory consumption.  */
+   context represented a macro's replacement list.  The context
+   structure stays on the chain to be reused by next_context, and its
+   buffer goes back to the free list, so that expanding a macro does
+   not have to go through malloc once the reader has warmed up.  */
 void
 _cpp_pop_context (cpp_reader *pfile)
 {
@@ -2687,18 +2713,9 @@ _cpp_pop_context (cpp_reader *pfile)
       cpp_hashnode *macro;
       if (context->tokens_kind == TOKENS_KIND_EXTENDED)
 	{
-	  macro_context *mc = context->c.mc;
-	  macro = mc->macro_node;
-	  /* If context->buff is set, it means the life time of tokens
-	     is bound to the life time of this context; so we must
-	     free the tokens; that means we must free the virtual
-	     locations of these tokens too.  */
-	  if (context->buff && mc->virt_locs)
-	    {
-	      free (mc->virt_locs);
-	      mc->virt_locs = NULL;
-	    }
-	  free (mc);
+	  /* If context->buff is set, the virtual locations of the
+	     tokens live in it and are released along with it below.  */
+	  macro = context->c.mc->macro_node;
 	  context->c.mc = NULL;
 	}
       else
@@ -2726,15 +2743,11 @@ _cpp_pop_context (cpp_reader *pfile)
 
   if (context->buff)
     {
-      /* Decrease memory peak consumption by freeing the memory used
-	 by the context.  */
-      _cpp_free_buff (context->buff);
+      _cpp_recycle_buff (pfile, context->buff);
+      context->buff = NULL;
     }
 
   pfile->context = context->prev;
-  /* decrease peak memory consumption by feeing the context.  */
-  pfile->context->next = NULL;
-  free (context);
 }
 
 /* Return TRUE if we reached the end of the set of tokens stored in
@@ -24,11 +24,12 @@ along with this program; see the file COPYING3.  If not see
 #include "system.h"
 #include "mkdeps.h"
 #include "internal.h"
-#include <algorithm>
-#include <vector>
+#include "omnibor-pack.h"
 #include "../../include/sha1.h"
 #include "sha256.h"
-#include <dirent.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #define GITOID_LENGTH_SHA1 20
 #define GITOID_LENGTH_SHA256 32
@@ -101,6 +102,14 @@ public:
       free (const_cast <char *> (targets[i]));
     for (i = deps.size (); i--;)
       free (const_cast <char *> (deps[i]));
+    for (i = pch_gitoids.size (); i--;)
+      XDELETE (pch_gitoids[i]);
+    for (i = omnibor_inputs.size (); i--;)
+      {
+	free (const_cast <char *> (omnibor_inputs[i]));
+	XDELETE (omnibor_input_gitoids[i]);
+	XDELETE (omnibor_input_boms[i]);
+      }
     for (i = vpath.size (); i--;)
       XDELETEVEC (vpath[i].str);
     for (i = modules.size (); i--;)
@@ -112,6 +121,19 @@ public:
 public:
   vec<const char *> targets;
   vec<const char *> deps;
+  /* The OmniBOR gitoids of DEPS, or NULL where they are not known yet.
+     They are not owned by this structure.  */
+  vec<const omnibor_gitoids *> dep_gitoids;
+  /* The OmniBOR gitoids restored from a precompiled header, which are
+     owned by this structure.  */
+  vec<omnibor_gitoids *> pch_gitoids;
+  /* The inputs which are recorded in the OmniBOR Document files only,
+     with their gitoids and the gitoids of their own OmniBOR Document
+     files, or NULL if those are not known.  All are owned by this
+     structure.  */
+  vec<const char *> omnibor_inputs;
+  vec<omnibor_gitoids *> omnibor_input_gitoids;
+  vec<omnibor_gitoids *> omnibor_input_boms;
   vec<velt> vpath;
   vec<const char *> modules;
 
@@ -299,12 +321,49 @@ deps_add_default_target (class mkdeps *d, const char *tgt)
 
 void
 deps_add_dep (class mkdeps *d, const char *t)
+{
+  deps_add_dep_with_gitoids (d, t, NULL);
+}
+
+void
+deps_add_dep_with_gitoids (class mkdeps *d, const char *t,
+			   const struct omnibor_gitoids *gitoids)
 {
   gcc_assert (*t);
 
   t = apply_vpath (d, t);
 
   d->deps.push (xstrdup (t));
+  d->dep_gitoids.push (gitoids);
+}
+
+void
+deps_add_omnibor_input (cpp_reader *pfile, const char *t,
+			const struct omnibor_gitoids *gitoids,
+			const struct omnibor_gitoids *bom)
+{
+  if (!pfile->deps)
+    pfile->deps = deps_init ();
+
+  deps_record_omnibor_input (pfile->deps, t, gitoids, bom);
+}
+
+void
+deps_record_omnibor_input (class mkdeps *d, const char *t,
+			   const struct omnibor_gitoids *gitoids,
+			   const struct omnibor_gitoids *bom)
+{
+  d->omnibor_inputs.push (xstrdup (t));
+  struct omnibor_gitoids *copy = XNEW (struct omnibor_gitoids);
+  *copy = *gitoids;
+  d->omnibor_input_gitoids.push (copy);
+  copy = NULL;
+  if (bom)
+    {
+      copy = XNEW (struct omnibor_gitoids);
+      *copy = *bom;
+    }
+  d->omnibor_input_boms.push (copy);
 }
 
 void
@@ -473,502 +532,388 @@ make_write (const cpp_reader *pfile, FILE *fp, unsigned int colmax)
     }
 }
 
-/* Open all the directories from the path specified in the result_dir
-   parameter and put them in the vector pointed to by dirs parameter.
-   Also create the directories which do not already exist.  */
+/* Start calculating the SHA1 and SHA256 gitoids of contents of SIZE
+   bytes: feed the "blob <SIZE>" header, with its terminating NUL, to both
+   hash contexts.  */
 
-static DIR *
-open_all_directories_in_path (const char *result_dir, std::vector<DIR *> *dirs)
+static void
+omnibor_hash_start (size_t size, struct sha1_ctx *ctx_sha1,
+		    struct sha256_ctx *ctx_sha256)
 {
-  std::string res_dir = result_dir;
-  std::string path = "";
-  std::string dir_name = "";
-  size_t p = res_dir.find ('/');
-  int dfd, absolute = 0;
-  DIR *dir = NULL;
-
-  if (p == std::string::npos)
-    return NULL;
-  /* If the res_dir is an absolute path.  */
-  else if (p == 0)
-    {
-      absolute = 1;
-      path += "/";
-      /* Opening a root directory because an absolute path is specified.  */
-      dir = opendir (path.c_str ());
-      dfd = dirfd (dir);
-
-      dirs->push_back (dir);
-      res_dir.erase (0, 1);
-
-      /* Path is of format "/<dir>" where dir does not exist. This point can be
-         reached only if <dir> could not be created in the root folder, so it is
-         considered as an illegal path.  */
-      if ((p = res_dir.find ('/')) == std::string::npos)
-        return NULL;
-
-      /* Process sequences of adjacent occurrences of character '/'.  */
-      while (p == 0)
-        {
-          res_dir.erase (0, 1);
-          p = res_dir.find ('/');
-        }
-
-      if (p == std::string::npos)
-        return NULL;
-    }
-
-  dir_name = res_dir.substr (0, p);
-  path += dir_name;
+  char init_data[MAX_FILE_SIZE_STRING_LENGTH];
+  int len = snprintf (init_data, sizeof (init_data), "blob %lu",
+		      (unsigned long) size);
 
-  if ((dir = opendir (path.c_str ())) == NULL)
-    {
-      if (absolute)
-        mkdirat (dfd, dir_name.c_str (), S_IRWXU);
-      else
-        mkdir (dir_name.c_str (), S_IRWXU);
-      dir = opendir (path.c_str ());
-    }
+  sha1_init_ctx (ctx_sha1);
+  sha256_init_ctx (ctx_sha256);
 
-  if (dir == NULL)
-    return NULL;
+  sha1_process_bytes (init_data, len + 1, ctx_sha1);
+  sha256_process_bytes (init_data, len + 1, ctx_sha256);
+}
 
-  dfd = dirfd (dir);
+/* Compute the SHA1 and SHA256 gitoids of the SIZE bytes at BUF, feeding
+   the same contents to both hash contexts.  */
 
-  dirs->push_back (dir);
-  res_dir.erase (0, p + 1);
+void
+deps_omnibor_hash_buffer (const unsigned char *buf, size_t size,
+			  struct omnibor_gitoids *gitoids)
+{
+  struct sha1_ctx ctx_sha1;
+  struct sha256_ctx ctx_sha256;
 
-  while ((p = res_dir.find ('/')) != std::string::npos)
-    {
-      /* Process sequences of adjacent occurrences of character '/'.  */
-      while (p == 0)
-        {
-          res_dir.erase (0, 1);
-          p = res_dir.find ('/');
-        }
+  omnibor_hash_start (size, &ctx_sha1, &ctx_sha256);
 
-      if (p == std::string::npos)
-        break;
+  sha1_process_bytes (buf, size, &ctx_sha1);
+  sha256_process_bytes (buf, size, &ctx_sha256);
 
-      dir_name = res_dir.substr (0, p);
-      path += "/" + dir_name;
+  sha1_finish_ctx (&ctx_sha1, gitoids->sha1);
+  sha256_finish_ctx (&ctx_sha256, gitoids->sha256);
+}
 
-      if ((dir = opendir (path.c_str ())) == NULL)
-        {
-          mkdirat (dfd, dir_name.c_str (), S_IRWXU);
-          dir = opendir (path.c_str ());
-        }
+/* The size of the chunks in which deps_omnibor_hash_fd reads a file.  */
+#define OMNIBOR_READ_CHUNK (64 * 1024)
 
-      if (dir == NULL)
-        return NULL;
+/* Compute the SHA1 and SHA256 gitoids of the SIZE bytes which can be read
+   from FD, reading them in chunks of fixed size so that the memory used
+   does not depend on the size of the file.  Return false if FD does not
+   hold exactly SIZE bytes, or cannot be read.  */
 
-      dfd = dirfd (dir);
+bool
+deps_omnibor_hash_fd (int fd, size_t size, struct omnibor_gitoids *gitoids)
+{
+  struct sha1_ctx ctx_sha1;
+  struct sha256_ctx ctx_sha256;
+  unsigned char *chunk = XNEWVEC (unsigned char, OMNIBOR_READ_CHUNK);
+  size_t total = 0;
+  ssize_t count;
 
-      dirs->push_back (dir);
-      res_dir.erase (0, p + 1);
-    }
+  omnibor_hash_start (size, &ctx_sha1, &ctx_sha256);
 
-  if (res_dir.length () > 0)
+  /* Read one byte beyond SIZE, to notice a file which has grown.  */
+  while (total <= size)
     {
-      path += "/" + res_dir;
-
-      if ((dir = opendir (path.c_str ())) == NULL)
-        {
-          mkdirat (dfd, res_dir.c_str (), S_IRWXU);
-          dir = opendir (path.c_str ());
-        }
-
-      dirs->push_back (dir);
+      size_t want = size - total + 1;
+      count = read (fd, chunk,
+		    want < OMNIBOR_READ_CHUNK ? want : OMNIBOR_READ_CHUNK);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	break;
+      total += count;
+      if (total > size)
+	break;
+      sha1_process_bytes (chunk, count, &ctx_sha1);
+      sha256_process_bytes (chunk, count, &ctx_sha256);
     }
 
-  return dir;
-}
-
-/* Close all the directories from the vector pointed to by dirs parameter.
-   Should be called after calling the function open_all_directories_in_path.  */
+  XDELETEVEC (chunk);
+  if (count < 0 || total != size)
+    return false;
 
-static void
-close_all_directories_in_path (std::vector<DIR *> dirs)
-{
-  for (unsigned i = 0; i != dirs.size(); i++)
-    closedir (dirs[i]);
+  sha1_finish_ctx (&ctx_sha1, gitoids->sha1);
+  sha256_finish_ctx (&ctx_sha256, gitoids->sha256);
+  return true;
 }
 
-/* Calculate the SHA1 gitoid using the contents of the given file.  */
+/* Calculate both the SHA1 and the SHA256 gitoids of the file open on FD,
+   as _cpp_omnibor_hash does.  The file is streamed through both hash
+   functions rather than read into memory, and not read at all if its
+   gitoids are in the persistent cache.  This is used for the dependencies
+   whose contents were not hashed when libcpp read them (for example,
+   those restored from a precompiled header), and for the inputs of a
+   link.  Return NULL if the file cannot be read.  */
 
-static void
-calculate_sha1_omnibor (FILE* dep_file, unsigned char resblock[])
+const struct omnibor_gitoids *
+deps_omnibor_file_gitoids (int fd)
 {
-  fseek (dep_file, 0L, SEEK_END);
-  long file_size = ftell (dep_file);
-  fseek (dep_file, 0L, SEEK_SET);
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
-
-  std::string init_data = "blob " + std::to_string (file_size) + '\0';
-  char *init_data_char_array = new char [init_data.length () + 1];
-  memcpy (init_data_char_array, init_data.c_str (), init_data.length ());
-  init_data_char_array[init_data.length()] = '\0';
-
-  char *file_contents = new char [file_size];
-  fread (file_contents, 1, file_size, dep_file);
-
-  /* Calculate the hash.  */
-  struct sha1_ctx ctx;
-
-  sha1_init_ctx (&ctx);
+  struct stat st;
 
-  sha1_process_bytes (init_data_char_array, init_data.length (), &ctx);
-  sha1_process_bytes (file_contents, file_size, &ctx);
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode))
+    return NULL;
 
-  sha1_finish_ctx (&ctx, resblock);
+  if (const struct omnibor_gitoids *cached = _cpp_omnibor_lookup (&st, fd))
+    return cached;
 
-  delete [] file_contents;
-  delete [] init_data_char_array;
+  return _cpp_omnibor_hash_fd (&st, fd);
 }
 
-/* Calculate the SHA1 gitoid using the given contents.  */
+/* Calculate the SHA1 gitoid of the LEN bytes at CONTENTS.  */
 
 static void
-calculate_sha1_omnibor_with_contents (std::string contents,
+calculate_sha1_omnibor_with_contents (const char *contents, size_t len,
 				      unsigned char resblock[])
 {
-  long file_size = contents.length ();
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
-
-  std::string init_data = "blob " + std::to_string (file_size) + '\0';
-  char *init_data_char_array = new char [init_data.length () + 1];
-  memcpy (init_data_char_array, init_data.c_str (), init_data.length ());
-  init_data_char_array[init_data.length()] = '\0';
-
-  char *file_contents = new char [contents.length () + 1];
-  memcpy (file_contents, contents.c_str (), contents.length ());
-  file_contents[contents.length()] = '\0';
+  char init_data[MAX_FILE_SIZE_STRING_LENGTH];
+  int init_len = snprintf (init_data, sizeof (init_data), "blob %lu",
+			   (unsigned long) len);
 
   /* Calculate the hash.  */
   struct sha1_ctx ctx;
 
   sha1_init_ctx (&ctx);
 
-  sha1_process_bytes (init_data_char_array, init_data.length(), &ctx);
-  sha1_process_bytes (file_contents, file_size, &ctx);
+  sha1_process_bytes (init_data, init_len + 1, &ctx);
+  sha1_process_bytes (contents, len, &ctx);
 
   sha1_finish_ctx (&ctx, resblock);
-
-  delete [] file_contents;
-  delete [] init_data_char_array;
 }
 
-/* Calculate the SHA256 gitoid using the contents of the given file.  */
+/* Calculate the SHA256 gitoid of the LEN bytes at CONTENTS.  */
 
 static void
-calculate_sha256_omnibor (FILE* dep_file, unsigned char resblock[])
+calculate_sha256_omnibor_with_contents (const char *contents, size_t len,
+					unsigned char resblock[])
 {
-  fseek (dep_file, 0L, SEEK_END);
-  long file_size = ftell (dep_file);
-  fseek (dep_file, 0L, SEEK_SET);
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
-
-  std::string init_data = "blob " + std::to_string (file_size) + '\0';
-  char *init_data_char_array = new char [init_data.length () + 1];
-  memcpy (init_data_char_array, init_data.c_str (), init_data.length ());
-  init_data_char_array[init_data.length()] = '\0';
-
-  char *file_contents = new char [file_size];
-  fread (file_contents, 1, file_size, dep_file);
+  char init_data[MAX_FILE_SIZE_STRING_LENGTH];
+  int init_len = snprintf (init_data, sizeof (init_data), "blob %lu",
+			   (unsigned long) len);
 
   /* Calculate the hash.  */
   struct sha256_ctx ctx;
 
   sha256_init_ctx (&ctx);
 
-  sha256_process_bytes (init_data_char_array, init_data.length (), &ctx);
-  sha256_process_bytes (file_contents, file_size, &ctx);
+  sha256_process_bytes (init_data, init_len + 1, &ctx);
+  sha256_process_bytes (contents, len, &ctx);
 
   sha256_finish_ctx (&ctx, resblock);
-
-  delete [] file_contents;
-  delete [] init_data_char_array;
 }
 
-/* Calculate the SHA256 gitoid using the given contents.  */
+/* A dependency listed in the OmniBOR Document files.  Nothing is copied:
+   the name belongs to the deps buffer, and the gitoids remain valid until
+   the end of the process.  */
 
-static void
-calculate_sha256_omnibor_with_contents (std::string contents,
-					unsigned char resblock[])
+struct omnibor_dep
 {
-  long file_size = contents.length ();
-  char buff_for_file_size[MAX_FILE_SIZE_STRING_LENGTH];
-  sprintf (buff_for_file_size, "%ld", file_size);
-
-  std::string init_data = "blob " + std::to_string (file_size) + '\0';
-  char *init_data_char_array = new char [init_data.length () + 1];
-  memcpy (init_data_char_array, init_data.c_str (), init_data.length ());
-  init_data_char_array[init_data.length()] = '\0';
-
-  char *file_contents = new char [contents.length () + 1];
-  memcpy (file_contents, contents.c_str (), contents.length ());
-  file_contents[contents.length()] = '\0';
-
-  /* Calculate the hash.  */
-  struct sha256_ctx ctx;
+  const char *name;
 
-  sha256_init_ctx (&ctx);
+  /* The gitoids of the dependency, and those of its own OmniBOR Document
+     file if it has one.  */
+  const struct omnibor_gitoids *gitoids;
+  const struct omnibor_gitoids *bom;
 
-  sha256_process_bytes (init_data_char_array, init_data.length(), &ctx);
-  sha256_process_bytes (file_contents, file_size, &ctx);
+  /* The gitoid of GITOIDS for the hash function of the OmniBOR Document
+     file being written, by which the dependencies are sorted.  */
+  const unsigned char *key;
+};
 
-  sha256_finish_ctx (&ctx, resblock);
+/* Return the gitoid of GITOIDS for the hash function HASH_FUNC_TYPE, 0
+   (SHA1) or 1 (SHA256).  */
 
-  delete [] file_contents;
-  delete [] init_data_char_array;
+static inline const unsigned char *
+omnibor_gitoid (const struct omnibor_gitoids *gitoids,
+		unsigned hash_func_type)
+{
+  return hash_func_type == 0 ? gitoids->sha1 : gitoids->sha256;
 }
 
-/* OmniBOR structure which represents a pair of a dependency filename and
-   its gitoid.  */
+/* Below this number of dependencies, omnibor_sort_deps sorts by
+   insertion.  */
+#define OMNIBOR_SORT_CUTOFF 16
+
+/* Sort the N dependencies at DEPS by their keys, which are HASH_SIZE bytes
+   long and known to be equal before byte BYTE.  This is a most
+   significant byte first radix sort: as the gitoids are evenly
+   distributed, a single pass usually leaves buckets small enough to be
+   sorted by insertion.  TMP has room for N dependencies.  The sort is
+   stable, so that the OmniBOR Document files do not depend on the
+   implementation of a library sort when two dependencies have the same
+   gitoid.  */
 
-class omnibor_dep
+static void
+omnibor_sort_deps (struct omnibor_dep *deps, struct omnibor_dep *tmp,
+		   size_t n, unsigned hash_size, unsigned byte)
 {
-public:
+  if (n < OMNIBOR_SORT_CUTOFF || byte == hash_size)
+    {
+      for (size_t i = 1; i < n; i++)
+	{
+	  struct omnibor_dep dep = deps[i];
+	  size_t j = i;
+	  for (; j > 0 && memcmp (deps[j - 1].key + byte, dep.key + byte,
+				  hash_size - byte) > 0; j--)
+	    deps[j] = deps[j - 1];
+	  deps[j] = dep;
+	}
+      return;
+    }
 
-  omnibor_dep (std::string name1, std::string gitoid1)
-    : name (name1), gitoid (gitoid1)
-  {}
-  ~omnibor_dep ()
-  {}
+  /* START[B] is the index of the first dependency whose byte BYTE is B;
+     START[256] is N.  */
+  size_t start[257], next[256];
+  memset (start, 0, sizeof (start));
+  for (size_t i = 0; i != n; i++)
+    start[deps[i].key[byte] + 1]++;
+  for (unsigned b = 0; b != 256; b++)
+    {
+      start[b + 1] += start[b];
+      next[b] = start[b];
+    }
 
-  std::string name;
-  std::string gitoid;
-};
+  for (size_t i = 0; i != n; i++)
+    tmp[next[deps[i].key[byte]]++] = deps[i];
+  memcpy (deps, tmp, n * sizeof (struct omnibor_dep));
 
-static bool
-omnibor_cmp (const class omnibor_dep *first, const class omnibor_dep *second)
-{
-  return first->gitoid < second->gitoid;
+  for (unsigned b = 0; b != 256; b++)
+    if (start[b + 1] - start[b] > 1)
+      omnibor_sort_deps (deps + start[b], tmp, start[b + 1] - start[b],
+			 hash_size, byte + 1);
 }
 
-/* Get the path of the directory where the resulting output file will be
-   stored.  Also, fill the memory pointed to by is_E_or_S_or_c with 3 if
-   -E option is specified, 2 if -S option is specified, 1 if -c option
-   is specified, or 0 otherwise (if the linking is done as well).  */
+/* Write the LEN bytes of the binary digest RESBLOCK in lowercase hex to
+   BUF, which has room for 2 * LEN characters, and return the end of what
+   was written.  */
 
-static std::string
-omnibor_get_outfile_name (const char *gcc_opts, int *is_E_or_S_or_c)
+static char *
+omnibor_hex_write (char *buf, const unsigned char resblock[], unsigned len)
 {
-  std::string gcc_opts_str = gcc_opts;
-  std::string temp = "", path = "";
-  *is_E_or_S_or_c = 0;
+  static const char *const lut = "0123456789abcdef";
 
-  size_t old_i = 0, i = 0;
-  while ((i = gcc_opts_str.find_first_of (' ')) != std::string::npos)
+  for (unsigned i = 0; i != len; i++)
     {
-      temp = gcc_opts_str.substr (old_i, i - old_i);
-
-      if (temp.compare (std::string ("'-o'")) == 0)
-	{
-	  gcc_opts_str = gcc_opts_str.substr (i + 1, std::string::npos);
-	  i = old_i = 0;
-
-	  if ((i = gcc_opts_str.find_first_of (' ')) != std::string::npos)
-	    {
-	      path = gcc_opts_str.substr (old_i + 1, i - old_i - 2);
-
-	      gcc_opts_str = gcc_opts_str.substr (i + 1, std::string::npos);
-	      i = old_i = 0;
-	    }
-	  /* Case when -o option is the last option specified.  */
-	  else
-	    {
-	      path = gcc_opts_str.substr (old_i + 1,
-					  gcc_opts_str.length () - old_i - 2);
+      *buf++ = lut[resblock[i] >> 4];
+      *buf++ = lut[resblock[i] & 15];
+    }
 
-	      break;
-	    }
-	  continue;
-	}
+  return buf;
+}
 
-      if (temp.compare (std::string ("'-E'")) == 0)
-	*is_E_or_S_or_c = 3;
-      else if (temp.compare (std::string ("'-S'")) == 0)
-	*is_E_or_S_or_c = 2;
-      else if (temp.compare (std::string ("'-c'")) == 0)
-	*is_E_or_S_or_c = 1;
+/* Append the LEN bytes of the binary digest RESBLOCK in lowercase hex to
+   STR.  */
 
-      gcc_opts_str = gcc_opts_str.substr (i + 1, std::string::npos);
-      i = old_i = 0;
-    }
-
-  return path;
+static void
+omnibor_hex_append (std::string *str, const unsigned char resblock[],
+		    unsigned len)
+{
+  size_t size = str->length ();
+  str->resize (size + 2 * len);
+  omnibor_hex_write (&(*str)[size], resblock, len);
 }
 
 /* Create a file containing the metadata for the process started by the GCC
-   command, in the OmniBOR context.  Currently, supported hash functions are
-   SHA1 and SHA256, so hash_func_type has to be either 0 (SHA1) or 1 (SHA256).  */
+   command, in the OmniBOR context, in the OmniBOR directory RESULT_DIR.
+   Currently, supported hash functions are SHA1 and SHA256, so
+   hash_func_type has to be either 0 (SHA1) or 1 (SHA256).  */
 
 static bool
-create_omnibor_metadata_file (const cpp_reader *pfile,
-			      int dfd,
-			      std::string res_dir,
-			      std::vector<class omnibor_dep *> vect_file_contents,
+create_omnibor_metadata_file (const char *result_dir,
+			      const struct omnibor_dep *deps, size_t num_deps,
 			      unsigned hash_func_type)
 {
   if (hash_func_type != 0 && hash_func_type != 1)
     return false;
 
-  mkdirat (dfd, "metadata", S_IRWXU);
+  /* The driver passes the path of the output file explicitly; it is not
+     known when the output goes to stdout or the compiler proper is run
+     directly.  */
+  std::string outfile_name = omnibor_outfile ? omnibor_outfile
+						   : "not_available";
 
-  std::string path_metadata = res_dir + "/metadata";
-
-  DIR *dir_metadata = opendir (path_metadata.c_str ());
-  if (dir_metadata == NULL)
-    return false;
-
-  int dfd_metadata = dirfd (dir_metadata);
+  std::string outfile_name_strip =
+	outfile_name.substr (outfile_name.find_last_of ('/') + 1,
+			     std::string::npos);
 
-  mkdirat (dfd_metadata, "gnu", S_IRWXU);
+  /* Leave a slot for the gitoid of the output file, which the driver
+     fills in in place once the output file has been written.  */
+  std::string contents = "outfile: ";
+  contents.append (hash_func_type == 0
+		   ? 2 * GITOID_LENGTH_SHA1 : 2 * GITOID_LENGTH_SHA256, ' ');
+  contents += " path: ";
 
-  std::string path_gnu = path_metadata + "/gnu";
-  DIR *dir_gnu = opendir (path_gnu.c_str ());
-  if (dir_gnu == NULL)
+  if (outfile_name.compare ("not_available") != 0)
     {
-      closedir (dir_metadata);
-      return false;
+      char outfile_name_abs[PATH_MAX];
+      realpath (outfile_name.c_str (), outfile_name_abs);
+      contents += outfile_name_abs;
     }
+  else
+    contents += "not available";
 
-  int dfd_gnu = dirfd (dir_gnu);
+  contents += "\n";
 
-  std::string path_sha = "";
-  DIR *dir_sha = NULL;
-  if (hash_func_type == 0)
+  unsigned hash_size = (hash_func_type == 0
+			? GITOID_LENGTH_SHA1 : GITOID_LENGTH_SHA256);
+  for (size_t ix = 0; ix != num_deps; ix++)
     {
-      mkdirat (dfd_gnu, "gitoid_blob_sha1", S_IRWXU);
-
-      path_sha = path_gnu + "/gitoid_blob_sha1";
-      dir_sha = opendir (path_sha.c_str ());
-      if (dir_sha == NULL)
-	{
-	  closedir (dir_gnu);
-	  closedir (dir_metadata);
-	  return false;
-	}
+      char infile_name_abs[PATH_MAX];
+      contents += "infile: ";
+      omnibor_hex_append (&contents, deps[ix].key, hash_size);
+      contents += " path: ";
+      /* An input may be gone by now, such as an LTRANS unit of a link.  */
+      contents += (realpath (deps[ix].name, infile_name_abs)
+		   ? infile_name_abs : deps[ix].name);
+      contents += "\n";
     }
-  else
-    {
-      mkdirat (dfd_gnu, "gitoid_blob_sha256", S_IRWXU);
 
-      path_sha = path_gnu + "/gitoid_blob_sha256";
-      dir_sha = opendir (path_sha.c_str ());
-      if (dir_sha == NULL)
-	{
-	  closedir (dir_gnu);
-	  closedir (dir_metadata);
-	  return false;
-	}
-    }
+  contents += "build_cmd: ";
 
-  int is_E_or_S_or_c = 0;
+  std::string file_name = outfile_name_strip + ".metadata";
+  return _cpp_omnibor_store_write (result_dir,
+				   hash_func_type == 0
+				   ? "metadata/gnu/gitoid_blob_sha1"
+				   : "metadata/gnu/gitoid_blob_sha256",
+				   file_name.c_str (), contents.data (),
+				   contents.length (), false);
+}
 
-  std::string outfile_name =
-		omnibor_get_outfile_name (getenv ("COLLECT_GCC_OPTIONS"),
-						  &is_E_or_S_or_c);
+/* Return the contents of the OmniBOR Document file which starts with
+   HEADER and lists the gitoids of the NUM_DEPS dependencies at DEPS, each
+   HASH_SIZE bytes long, in the order of DEPS.  The contents are sized
+   before they are written, so that they take a single allocation.  */
 
-  if (outfile_name == "")
+static std::string
+omnibor_document_contents (const char *header,
+			   const struct omnibor_dep *deps, size_t num_deps,
+			   unsigned hash_size)
+{
+  unsigned hash_func_type = hash_size == GITOID_LENGTH_SHA1 ? 0 : 1;
+  size_t header_len = strlen (header);
+  size_t size = header_len;
+  for (size_t ix = 0; ix != num_deps; ix++)
     {
-      /* Option -o is not specified, so the name of the output file has
-	 to be deducted from the input file or be a.out in the case when
-	 linking is done as well.  */
-      if (pfile->deps->deps.size () > 0)
-	{
-	  /* Case when linking is done as well.  */
-	  if (is_E_or_S_or_c == 0)
-	    outfile_name = "a.out";
-	  /* Case when -c option is used.  */
-	  else if (is_E_or_S_or_c == 1)
-	    {
-	      std::string infile_name = pfile->deps->deps[0];
-	      /* TODO: Apart from supporting input file extensions with one
-		 character, support also '.cpp' extension.  */
-	      size_t start = infile_name.find_last_of ('/') + 1;
-	      outfile_name = infile_name.substr (start,
-						 infile_name.length() - 2 - start);
-	      outfile_name = outfile_name + ".o";
-	    }
-	  /* Case when -S option is used.  */
-	  else if (is_E_or_S_or_c == 2)
-	    {
-	      std::string infile_name = pfile->deps->deps[0];
-	      /* TODO: Apart from supporting input file extensions with one
-		 character, support also '.cpp' extension.  */
-	      size_t start = infile_name.find_last_of ('/') + 1;
-	      outfile_name = infile_name.substr (start,
-						 infile_name.length() - 2 - start);
-	      outfile_name = outfile_name + ".s";
-	    }
-	  /* Case when -E option is used.  In this case, the output file
-	     does not exist, because the preprocessed file will be
-	     outputed to stdout or stderr.  */
-	  else
-	    outfile_name = "not_available";
-	}
-      else
-	outfile_name = "not_available";
+      size += strlen ("blob \n") + 2 * hash_size;
+      if (deps[ix].bom)
+	size += strlen (" bom ") + 2 * hash_size;
     }
 
-  std::string outfile_name_strip =
-	outfile_name.substr (outfile_name.find_last_of ('/') + 1,
-			     std::string::npos);
-
-  std::string full_filename = path_sha + "/" + outfile_name_strip + ".metadata";
-
-  FILE *metadata_file = fopen (full_filename.c_str (), "w");
-  if (metadata_file != NULL)
+  std::string contents (size, '\0');
+  char *p = &contents[0];
+  memcpy (p, header, header_len);
+  p += header_len;
+  for (size_t ix = 0; ix != num_deps; ix++)
     {
-      fwrite ("outfile:  path: ", sizeof (char), strlen ("outfile:  path: "),
-	      metadata_file);
-
-      if (outfile_name.compare ("not_available") != 0)
+      memcpy (p, "blob ", strlen ("blob "));
+      p = omnibor_hex_write (p + strlen ("blob "), deps[ix].key, hash_size);
+      if (deps[ix].bom)
 	{
-	  char outfile_name_abs[PATH_MAX];
-	  realpath (outfile_name.c_str (), outfile_name_abs);
-	  fwrite (outfile_name_abs, sizeof (char), strlen (outfile_name_abs),
-		  metadata_file);
+	  memcpy (p, " bom ", strlen (" bom "));
+	  p = omnibor_hex_write (p + strlen (" bom "),
+				 omnibor_gitoid (deps[ix].bom, hash_func_type),
+				 hash_size);
 	}
-      else
-	fwrite ("not available", sizeof (char), strlen ("not available"),
-		metadata_file);
-
-      fwrite ("\n", sizeof (char), strlen ("\n"), metadata_file);
+      *p++ = '\n';
+    }
 
-      for (unsigned ix = 0; ix != vect_file_contents.size (); ix++)
-	{
-	  std::string infile_name = vect_file_contents[ix]->name;
-	  char infile_name_abs[PATH_MAX];
-	  realpath (infile_name.c_str (), infile_name_abs);
-	  std::string in_line = "infile: " + vect_file_contents[ix]->gitoid +
-				" path: " + infile_name_abs + "\n";
-	  fwrite (in_line.c_str (), sizeof (char), in_line.length (),
-		  metadata_file);
-	}
+  return contents;
+}
 
-      fwrite ("build_cmd: ", sizeof (char), strlen ("build_cmd: "),
-	      metadata_file);
+/* Calculate the gitoid of the OmniBOR Document file with the contents
+   NEW_FILE_CONTENTS and store it in RESBLOCK.  Currently, supported hash
+   functions are SHA1 and SHA256, so hash_func_type has to be either
+   0 (SHA1) or 1 (SHA256).  */
 
-      fclose (metadata_file);
-    }
+static void
+omnibor_document_gitoid (const std::string &new_file_contents,
+			 unsigned hash_func_type, unsigned char *resblock)
+{
+  if (hash_func_type == 0)
+    calculate_sha1_omnibor_with_contents (new_file_contents.data (),
+					  new_file_contents.length (),
+					  resblock);
   else
-    {
-      closedir (dir_sha);
-      closedir (dir_gnu);
-      closedir (dir_metadata);
-      return false;
-    }
-
-  closedir (dir_sha);
-  closedir (dir_gnu);
-  closedir (dir_metadata);
-  return true;
+    calculate_sha256_omnibor_with_contents (new_file_contents.data (),
+					    new_file_contents.length (),
+					    resblock);
 }
 
 /* Create the OmniBOR Document file using the gitoids of the dependencies and
@@ -980,9 +925,8 @@ create_omnibor_metadata_file (const cpp_reader *pfile,
    file, an empty string is returned.  */
 
 static std::string
-create_omnibor_document_file (const cpp_reader *pfile,
-			      std::string new_file_contents,
-			      std::vector<class omnibor_dep *> vect_file_contents,
+create_omnibor_document_file (const char *header,
+			      const struct omnibor_dep *deps, size_t num_deps,
 			      unsigned hash_size,
 			      unsigned hash_func_type,
 			      const char *result_dir)
@@ -991,308 +935,324 @@ create_omnibor_document_file (const cpp_reader *pfile,
       (hash_func_type != 0 && hash_func_type != 1))
     return "";
 
-  static const char *const lut = "0123456789abcdef";
-  for (unsigned ix = 0; ix != vect_file_contents.size (); ix++)
-    {
-      new_file_contents += "blob ";
-      new_file_contents += vect_file_contents[ix]->gitoid;
-      new_file_contents += "\n";
-    }
-
-  unsigned char resblock[hash_size];
-  if (hash_func_type == 0)
-    calculate_sha1_omnibor_with_contents (new_file_contents, resblock);
-  else
-    calculate_sha256_omnibor_with_contents (new_file_contents, resblock);
-
-  std::string name = "";
-  for (unsigned i = 0; i != hash_size; i++)
-    {
-      name += lut[resblock[i] >> 4];
-      name += lut[resblock[i] & 15];
-    }
-
-  std::string new_file_path;
-  std::string path_objects = "objects";
-  DIR *dir_one = NULL;
-  int dfd1 = 0;
-  std::vector<DIR *> dirs;
-
-  if (result_dir)
-    {
-      if ((dir_one = opendir (result_dir)) == NULL)
-        {
-          mkdir (result_dir, S_IRWXU);
-	  dir_one = opendir (result_dir);
-	}
-
-      if (dir_one != NULL)
-        {
-          std::string res_dir = result_dir;
-	  path_objects = res_dir + "/" + path_objects;
-	  dfd1 = dirfd (dir_one);
-	  mkdirat (dfd1, "objects", S_IRWXU);
-        }
-      else if (strlen (result_dir) != 0)
-        {
-          DIR *final_dir = open_all_directories_in_path (result_dir, &dirs);
-	  /* If an error occurred, illegal path is detected and the OmniBOR
-	     information is not written.  */
-	  /* TODO: Maybe put a message here that a specified path, in which
-	     the OmniBOR information should be stored, is illegal.  */
-	  /* TODO: In case of an error, if any directories were created,
-	     remove them.  */
-          if (final_dir == NULL)
-            {
-              close_all_directories_in_path (dirs);
-              return "";
-            }
-          else
-            {
-              std::string res_dir = result_dir;
-	      path_objects = res_dir + "/" + path_objects;
-	      dfd1 = dirfd (final_dir);
-	      mkdirat (dfd1, "objects", S_IRWXU);
-            }
-        }
-      /* This point should not be reachable.  */
-      else
-	return "";
-    }
-  /* This point should not be reachable.  */
-  else
+  /* Without an OmniBOR directory, the OmniBOR information is not
+     written.  */
+  if (result_dir == NULL || *result_dir == '\0')
     return "";
 
-  DIR *dir_two = opendir (path_objects.c_str ());
-  if (dir_two == NULL)
-    {
-      close_all_directories_in_path (dirs);
-      if (result_dir && dir_one)
-	closedir (dir_one);
-      return "";
-    }
-
-  int dfd2 = dirfd (dir_two);
+  std::string new_file_contents
+    = omnibor_document_contents (header, deps, num_deps, hash_size);
+  unsigned char resblock[hash_size];
+  omnibor_document_gitoid (new_file_contents, hash_func_type, resblock);
+  std::string name;
+  omnibor_hex_append (&name, resblock, hash_size);
 
-  std::string path_sha = "";
-  DIR *dir_three = NULL;
-  if (hash_func_type == 0)
+  /* A Document file already in one of the indexed pack files is not
+     appended again; duplicates in the incoming pack file are dropped
+     when it is compacted.  */
+  if (omnibor_pack)
     {
-      mkdirat (dfd2, "gitoid_blob_sha1", S_IRWXU);
-
-      path_sha = path_objects + "/gitoid_blob_sha1";
-      dir_three = opendir (path_sha.c_str ());
-      if (dir_three == NULL)
-        {
-          closedir (dir_two);
-          close_all_directories_in_path (dirs);
-	  if (result_dir && dir_one)
-	    closedir (dir_one);
-          return "";
-        }
+      enum omnibor_pack_kind kind = (hash_func_type == 0
+				     ? OMNIBOR_PACK_DOCUMENT_SHA1
+				     : OMNIBOR_PACK_DOCUMENT_SHA256);
+      if (!omnibor_pack_find (result_dir, kind, resblock, 0)
+	  && !omnibor_pack_append (result_dir, kind, resblock,
+				   new_file_contents.data (),
+				   new_file_contents.length ()))
+	name = "";
     }
   else
     {
-      mkdirat (dfd2, "gitoid_blob_sha256", S_IRWXU);
-
-      path_sha = path_objects + "/gitoid_blob_sha256";
-      dir_three = opendir (path_sha.c_str ());
-      if (dir_three == NULL)
-        {
-          closedir (dir_two);
-          close_all_directories_in_path (dirs);
-	  if (result_dir && dir_one)
-	    closedir (dir_one);
-          return "";
-        }
+      std::string dir = (hash_func_type == 0
+			 ? "objects/gitoid_blob_sha1/"
+			 : "objects/gitoid_blob_sha256/") + name.substr (0, 2);
+      if (!_cpp_omnibor_store_write (result_dir, dir.c_str (),
+				     name.c_str () + 2,
+				     new_file_contents.data (),
+				     new_file_contents.length (), true))
+	name = "";
     }
 
-  int dfd3 = dirfd (dir_three);
-  mkdirat (dfd3, name.substr (0, 2).c_str (), S_IRWXU);
-
-  std::string path_dir = path_sha + "/" + name.substr (0, 2);
-  DIR *dir_four = opendir (path_dir.c_str ());
-  if (dir_four == NULL)
-    {
-      closedir (dir_three);
-      closedir (dir_two);
-      close_all_directories_in_path (dirs);
-      if (result_dir && dir_one)
-	closedir (dir_one);
-      return "";
-    }
-
-  new_file_path = path_dir + "/" + name.substr (2, std::string::npos);
-
-  FILE *new_file = fopen (new_file_path.c_str (), "w");
-  if (new_file != NULL)
-    {
-      fwrite (new_file_contents.c_str (), sizeof(char),
-	      new_file_contents.length (), new_file);
-      fclose (new_file);
-    }
-  else
-    name = "";
-
-  if (!create_omnibor_metadata_file (pfile,
-				     dfd1,
-				     std::string (result_dir),
-				     vect_file_contents,
+  if (!create_omnibor_metadata_file (result_dir, deps, num_deps,
 				     hash_func_type))
     name = "";
 
-  closedir (dir_four);
-  closedir (dir_three);
-  closedir (dir_two);
-  close_all_directories_in_path (dirs);
-  if (result_dir && dir_one)
-    closedir (dir_one);
-
   return name;
 }
 
-/* Calculate the gitoids of all the dependencies of the resulting object
-   file and create the OmniBOR Document file using them.  Then calculate the
-   gitoid of that file and name it with that gitoid in the format specified
-   by the OmniBOR specification.  Finally, return that gitoid.  Use SHA1
-   hashing algorithm for calculating all the gitoids.  */
+/* Calculate the SHA1 and SHA256 gitoids of the dependencies of D which
+   libcpp did not hash when it read them, and wait for the worker threads
+   to finish the others.  The gitoids recorded when libcpp read the
+   dependencies, or restored from a precompiled header, are used where
+   available; any other dependency is streamed from disk once, and the
+   same contents are fed to both hash functions.  Nothing more is hashed
+   once the writing has been cancelled.  */
 
-static std::string
-make_write_sha1_omnibor (const cpp_reader *pfile, const char *result_dir)
+void
+deps_omnibor_hash (class mkdeps *d)
 {
-  static const char *const lut = "0123456789abcdef";
-  std::string new_file_contents = "gitoid:blob:sha1\n";
-  std::vector<class omnibor_dep *> vect_file_contents;
-  std::string temp_file_contents;
-
-  for (unsigned ix = 0; ix != pfile->deps->deps.size (); ix++)
-    {
-      FILE *dep_file = fopen (pfile->deps->deps[ix], "rb");
-      if (dep_file == NULL)
-	continue;
-      unsigned char resblock[GITOID_LENGTH_SHA1];
+  for (unsigned ix = 0; ix != d->deps.size (); ix++)
+    if (d->dep_gitoids[ix] == NULL && !_cpp_omnibor_cancelled ())
+      {
+	int fd = open (d->deps[ix], O_RDONLY | O_BINARY);
+	if (fd != -1)
+	  {
+	    d->dep_gitoids[ix] = deps_omnibor_file_gitoids (fd);
+	    close (fd);
+	  }
+      }
 
-      calculate_sha1_omnibor (dep_file, resblock);
+  _cpp_omnibor_finish_hashing ();
+}
 
-      fclose (dep_file);
+/* Return the dependencies of the resulting object file listed in the
+   OmniBOR Document files, and store their number in NUM_DEPS.  The
+   dependencies have to have been hashed by deps_omnibor_hash; those which
+   could not be read are left out.  The inputs which are recorded for
+   OmniBOR only, such as the imported C++ modules, come with their
+   gitoids.  The array is a single allocation, with room for as many
+   dependencies again for omnibor_order_deps; it is freed with free.  */
 
-      temp_file_contents = "";
+static struct omnibor_dep *
+omnibor_collect_deps (const class mkdeps *d, size_t *num_deps)
+{
+  struct omnibor_dep *deps
+    = XNEWVEC (struct omnibor_dep,
+	       2 * (d->deps.size () + d->omnibor_inputs.size ()) + 1);
+  size_t n = 0;
 
-      unsigned char high, low;
-      for (unsigned i = 0; i != GITOID_LENGTH_SHA1; i++)
-        {
-          high = resblock[i] >> 4;
-          low = resblock[i] & 15;
-          temp_file_contents += lut[high];
-          temp_file_contents += lut[low];
-        }
+  for (unsigned ix = 0; ix != d->deps.size (); ix++)
+    if (d->dep_gitoids[ix] != NULL)
+      {
+	deps[n].name = d->deps[ix];
+	deps[n].gitoids = d->dep_gitoids[ix];
+	deps[n].bom = NULL;
+	n++;
+      }
 
-      class omnibor_dep *dep_pair =
-		new omnibor_dep (std::string (pfile->deps->deps[ix]),
-				 temp_file_contents);
-      vect_file_contents.push_back (dep_pair);
+  for (unsigned ix = 0; ix != d->omnibor_inputs.size (); ix++)
+    {
+      deps[n].name = d->omnibor_inputs[ix];
+      deps[n].gitoids = d->omnibor_input_gitoids[ix];
+      deps[n].bom = d->omnibor_input_boms[ix];
+      n++;
     }
 
-  std::sort (vect_file_contents.begin (), vect_file_contents.end (),
-	     omnibor_cmp);
+  *num_deps = n;
+  return deps;
+}
 
-  std::string gitoid = create_omnibor_document_file (pfile,
-						     new_file_contents,
-						     vect_file_contents,
-						     GITOID_LENGTH_SHA1,
-						     0,
-						     result_dir);
+/* Sort the NUM_DEPS dependencies at DEPS, returned by
+   omnibor_collect_deps, in the order in which they are listed in the
+   OmniBOR Document file for the hash function HASH_FUNC_TYPE.  */
 
-  for (unsigned ix = 0; ix != vect_file_contents.size (); ix++)
-    delete vect_file_contents[ix];
+static void
+omnibor_order_deps (struct omnibor_dep *deps, size_t num_deps,
+		    unsigned hash_func_type)
+{
+  for (size_t ix = 0; ix != num_deps; ix++)
+    deps[ix].key = omnibor_gitoid (deps[ix].gitoids, hash_func_type);
 
-  return gitoid;
+  omnibor_sort_deps (deps, deps + num_deps, num_deps,
+		     hash_func_type == 0
+		     ? GITOID_LENGTH_SHA1 : GITOID_LENGTH_SHA256, 0);
 }
 
-/* Calculate the gitoids of all the dependencies of the resulting object
-   file and create the OmniBOR Document file using them.  Then calculate the
-   gitoid of that file and name it with that gitoid in the format specified
-   by the OmniBOR specification.  Finally, return that gitoid.  Use SHA256
-   hashing algorithm for calculating all the gitoids.  */
+/* Calculate the SHA1 and SHA256 gitoids of all the dependencies of the
+   resulting object file and create both OmniBOR Document files using them.
+   Then calculate the gitoid of each OmniBOR Document file and name it with
+   that gitoid in the format specified by the OmniBOR specification.
+   Finally, store those gitoids in GITOID_SHA1 and GITOID_SHA256 (an empty
+   string means that an error occurred, or that the writing has been
+   cancelled).  */
 
-static std::string
-make_write_sha256_omnibor (const cpp_reader *pfile, const char *result_dir)
+static void
+make_write_omnibor (class mkdeps *d, const char *result_dir,
+		    std::string *gitoid_sha1, std::string *gitoid_sha256)
 {
-  static const char *const lut = "0123456789abcdef";
-  std::string new_file_contents = "gitoid:blob:sha256\n";
-  std::vector<class omnibor_dep *> vect_file_contents;
-  std::string temp_file_contents;
+  size_t num_deps;
 
-  for (unsigned ix = 0; ix != pfile->deps->deps.size (); ix++)
+  deps_omnibor_hash (d);
+
+  /* Some dependencies may not have been hashed.  */
+  if (_cpp_omnibor_cancelled ())
     {
-      FILE *dep_file = fopen (pfile->deps->deps[ix], "rb");
-      if (dep_file == NULL)
-	continue;
-      unsigned char resblock[GITOID_LENGTH_SHA256];
+      gitoid_sha1->clear ();
+      gitoid_sha256->clear ();
+      return;
+    }
 
-      calculate_sha256_omnibor (dep_file, resblock);
+  struct omnibor_dep *deps = omnibor_collect_deps (d, &num_deps);
+
+  omnibor_order_deps (deps, num_deps, 0);
+  *gitoid_sha1 = create_omnibor_document_file ("gitoid:blob:sha1\n",
+					       deps, num_deps,
+					       GITOID_LENGTH_SHA1,
+					       0,
+					       result_dir);
+  omnibor_order_deps (deps, num_deps, 1);
+  *gitoid_sha256 = create_omnibor_document_file ("gitoid:blob:sha256\n",
+						 deps, num_deps,
+						 GITOID_LENGTH_SHA256,
+						 1,
+						 result_dir);
+
+  free (deps);
+  _cpp_omnibor_cache_flush ();
+}
 
-      fclose (dep_file);
+/* Write out dependencies according to the selected format (which is
+   only Make at the moment).  */
+/* Really we should be opening fp here.  */
 
-      temp_file_contents = "";
+void
+deps_write (const cpp_reader *pfile, FILE *fp, unsigned int colmax)
+{
+  make_write (pfile, fp, colmax);
+}
 
-      unsigned char high, low;
-      for (unsigned i = 0; i != GITOID_LENGTH_SHA256; i++)
-        {
-          high = resblock[i] >> 4;
-          low = resblock[i] & 15;
-          temp_file_contents += lut[high];
-          temp_file_contents += lut[low];
-        }
+/* Calculate and write out the OmniBOR information of the deps buffer D
+   using both SHA1 and SHA256 hashing algorithms in a single pass over the
+   dependencies.  D need not be attached to a cpp_reader: it may list the
+   dependencies of any front end, or the inputs of a link.  */
 
-      class omnibor_dep *dep_pair =
-		new omnibor_dep (std::string (pfile->deps->deps[ix]),
-				 temp_file_contents);
-      vect_file_contents.push_back (dep_pair);
-    }
+void
+deps_write_omnibor (class mkdeps *d, const char *result_dir,
+		    std::string *gitoid_sha1, std::string *gitoid_sha256)
+{
+  make_write_omnibor (d, result_dir, gitoid_sha1, gitoid_sha256);
+}
 
-  std::sort (vect_file_contents.begin (), vect_file_contents.end (),
-	     omnibor_cmp);
+/* The OmniBOR Document files being written by deps_start_omnibor.  This
+   has no destructor, so that the process can exit while the thread is
+   still writing.  DEPS and RESULT_DIR are set before the thread starts,
+   and the thread owns DEPS until it is joined.  The thread writes the
+   gitoids, which are only read once it has been joined.  The OmniBOR
+   state of libcpp which the thread shares with the main thread is
+   protected by a lock of its own; see omnibor.c.  */
 
-  std::string gitoid = create_omnibor_document_file (pfile,
-						     new_file_contents,
-						     vect_file_contents,
-						     GITOID_LENGTH_SHA256,
-						     1,
-						     result_dir);
+static struct
+{
+  class mkdeps *deps;
+  const char *result_dir;
+
+  /* True if a thread of its own is writing the files, and its results
+     once it is done.  */
+  bool started;
+#ifdef HAVE_PTHREAD_H
+  pthread_t thread;
+#endif
+  char gitoid_sha1[2 * GITOID_LENGTH_SHA1 + 1];
+  char gitoid_sha256[2 * GITOID_LENGTH_SHA256 + 1];
+} omnibor_writer;
 
-  for (unsigned ix = 0; ix != vect_file_contents.size (); ix++)
-    delete vect_file_contents[ix];
+#ifdef HAVE_PTHREAD_H
+static void *
+omnibor_writer_main (void *)
+{
+  std::string gitoid_sha1, gitoid_sha256;
+  make_write_omnibor (omnibor_writer.deps, omnibor_writer.result_dir,
+		      &gitoid_sha1, &gitoid_sha256);
+  snprintf (omnibor_writer.gitoid_sha1, sizeof (omnibor_writer.gitoid_sha1),
+	    "%s", gitoid_sha1.c_str ());
+  snprintf (omnibor_writer.gitoid_sha256,
+	    sizeof (omnibor_writer.gitoid_sha256), "%s",
+	    gitoid_sha256.c_str ());
+  return NULL;
+}
+#endif
 
-  return gitoid;
+/* Start writing out the OmniBOR information of the deps buffer D, as
+   deps_write_omnibor does, and return without waiting for it if
+   possible.  Unless no worker threads are allowed, the dependencies are
+   hashed and the files written on a thread of its own; otherwise only the
+   hashing is done here.  Nothing may use D until deps_finish_omnibor
+   has been called.  */
+
+void
+deps_start_omnibor (class mkdeps *d, const char *result_dir)
+{
+  omnibor_writer.deps = d;
+  omnibor_writer.result_dir = result_dir;
+
+#ifdef HAVE_PTHREAD_H
+  if (omnibor_jobs > 0
+      && pthread_create (&omnibor_writer.thread, NULL, omnibor_writer_main,
+			 NULL) == 0)
+    {
+      omnibor_writer.started = true;
+      return;
+    }
+#endif
+
+  deps_omnibor_hash (d);
 }
 
-/* Write out dependencies according to the selected format (which is
-   only Make at the moment).  */
-/* Really we should be opening fp here.  */
+/* Wait for the OmniBOR information started by deps_start_omnibor to be
+   written out, or write it now, and store the gitoids of the OmniBOR
+   Document files in GITOID_SHA1 and GITOID_SHA256.  */
 
 void
-deps_write (const cpp_reader *pfile, FILE *fp, unsigned int colmax)
+deps_finish_omnibor (std::string *gitoid_sha1, std::string *gitoid_sha256)
 {
-  make_write (pfile, fp, colmax);
+#ifdef HAVE_PTHREAD_H
+  if (omnibor_writer.started)
+    {
+      pthread_join (omnibor_writer.thread, NULL);
+      omnibor_writer.started = false;
+      *gitoid_sha1 = omnibor_writer.gitoid_sha1;
+      *gitoid_sha256 = omnibor_writer.gitoid_sha256;
+      return;
+    }
+#endif
+
+  make_write_omnibor (omnibor_writer.deps, omnibor_writer.result_dir,
+		      gitoid_sha1, gitoid_sha256);
 }
 
-/* Calculate and write out the OmniBOR information using SHA1 hashing
-   algorithm.  */
+/* Stop the writing started by deps_start_omnibor as soon as possible and
+   wait for the thread doing it, for the exit paths of the process.  A
+   file being written is removed rather than renamed into place, and no
+   other file is written; the OmniBOR Document files are not written
+   then.  */
 
-std::string
-deps_write_sha1_omnibor (const cpp_reader *pfile, const char *result_dir)
+void
+deps_cancel_omnibor (void)
 {
-  return make_write_sha1_omnibor (pfile, result_dir);
+#ifdef HAVE_PTHREAD_H
+  if (omnibor_writer.started)
+    {
+      _cpp_omnibor_cancel ();
+      pthread_join (omnibor_writer.thread, NULL);
+      omnibor_writer.started = false;
+    }
+#endif
 }
 
-/* Calculate and write out the OmniBOR information using SHA256 hashing
-   algorithm.  */
+/* Calculate the SHA1 and SHA256 gitoids of the OmniBOR Document files
+   which deps_write_omnibor will write, without writing them.  */
 
-std::string
-deps_write_sha256_omnibor (const cpp_reader *pfile, const char *result_dir)
+void
+deps_omnibor_document_gitoids (const cpp_reader *pfile,
+			       struct omnibor_gitoids *gitoids)
 {
-  return make_write_sha256_omnibor (pfile, result_dir);
+  size_t num_deps;
+
+  deps_omnibor_hash (pfile->deps);
+  struct omnibor_dep *deps = omnibor_collect_deps (pfile->deps, &num_deps);
+
+  omnibor_order_deps (deps, num_deps, 0);
+  omnibor_document_gitoid (omnibor_document_contents ("gitoid:blob:sha1\n",
+						      deps, num_deps,
+						      GITOID_LENGTH_SHA1),
+			   0, gitoids->sha1);
+  omnibor_order_deps (deps, num_deps, 1);
+  omnibor_document_gitoid (omnibor_document_contents ("gitoid:blob:sha256\n",
+						      deps, num_deps,
+						      GITOID_LENGTH_SHA256),
+			   1, gitoids->sha256);
+
+  free (deps);
 }
 
 /* Write out a deps buffer to a file, in a form that can be read back
@@ -1313,7 +1273,18 @@ deps_save (class mkdeps *deps, FILE *f)
   if (fwrite (&size, sizeof (size), 1, f) != 1)
     return -1;
 
-  /* The length of each dependence followed by the string.  */
+  /* The OmniBOR gitoids of the dependences are saved as well, so that
+     the headers need not be hashed again by each user of the precompiled
+     header; wait for the worker threads to calculate them.  */
+  for (i = 0; i < deps->deps.size (); i++)
+    if (deps->dep_gitoids[i])
+      {
+	_cpp_omnibor_finish_hashing ();
+	break;
+      }
+
+  /* The length of each dependence followed by the string, and whether
+     its gitoids are known followed by the gitoids.  */
   for (i = 0; i < deps->deps.size (); i++)
     {
       size = strlen (deps->deps[i]);
@@ -1321,6 +1292,13 @@ deps_save (class mkdeps *deps, FILE *f)
 	return -1;
       if (fwrite (deps->deps[i], size, 1, f) != 1)
 	return -1;
+
+      const struct omnibor_gitoids *gitoids = deps->dep_gitoids[i];
+      char known = gitoids != NULL;
+      if (fwrite (&known, sizeof (known), 1, f) != 1)
+	return -1;
+      if (known && fwrite (gitoids, sizeof (*gitoids), 1, f) != 1)
+	return -1;
     }
 
   return 0;
@@ -1329,10 +1307,15 @@ deps_save (class mkdeps *deps, FILE *f)
 /* Read back dependency information written with deps_save into
    the deps sizefer.  The third argument may be NULL, in which case
    the dependency information is just skipped, or it may be a filename,
-   in which case that filename is skipped.  */
+   in which case that filename is skipped.  The OmniBOR gitoids saved
+   with the dependencies are restored with them.  If the dependencies
+   are skipped while OmniBOR is enabled, they are recorded as inputs of
+   the OmniBOR Document files instead, and PFILE warns about those which
+   cannot be hashed.  */
 
 int
-deps_restore (class mkdeps *deps, FILE *fd, const char *self)
+deps_restore (class mkdeps *deps, FILE *fd, const char *self,
+	      cpp_reader *pfile)
 {
   size_t size;
   char *buf = NULL;
@@ -1361,9 +1344,51 @@ deps_restore (class mkdeps *deps, FILE *fd, const char *self)
 	}
       buf[size] = 0;
 
+      char known;
+      struct omnibor_gitoids gitoids;
+      if (fread (&known, sizeof (known), 1, fd) != 1
+	  || (known && fread (&gitoids, sizeof (gitoids), 1, fd) != 1))
+	{
+	  XDELETEVEC (buf);
+	  return -1;
+	}
+
       /* Generate makefile dependencies from .pch if -nopch-deps.  */
       if (self != NULL && filename_cmp (buf, self) != 0)
-        deps_add_dep (deps, buf);
+	{
+	  struct omnibor_gitoids *copy = NULL;
+	  if (known)
+	    {
+	      copy = XNEW (struct omnibor_gitoids);
+	      *copy = gitoids;
+	      deps->pch_gitoids.push (copy);
+	    }
+	  deps_add_dep_with_gitoids (deps, buf, copy);
+	}
+      /* Otherwise the headers the precompiled header was made from are
+	 still inputs of the object file, so record them in the OmniBOR
+	 Document files only.  Their gitoids are unknown if the
+	 precompiled header was made without OmniBOR.  */
+      else if (self == NULL && omnibor_enabled)
+	{
+	  const struct omnibor_gitoids *input = known ? &gitoids : NULL;
+	  if (!known)
+	    {
+	      int file_fd = open (buf, O_RDONLY | O_BINARY);
+	      if (file_fd != -1)
+		{
+		  input = deps_omnibor_file_gitoids (file_fd);
+		  close (file_fd);
+		}
+	    }
+	  if (input)
+	    deps_record_omnibor_input (deps, buf, input, NULL);
+	  else
+	    cpp_error (pfile, CPP_DL_WARNING,
+		       "cannot calculate the OmniBOR gitoids of \"%s\", "
+		       "read by the precompiled header; it is left out of "
+		       "the OmniBOR Document files", buf);
+	}
     }
 
   XDELETEVEC (buf);
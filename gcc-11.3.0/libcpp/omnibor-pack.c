@@ -0,0 +1,413 @@
+/* OmniBOR pack files.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/* The format of the pack files is described in omnibor-pack.h.  The
+   compilations only ever append to the incoming pack file, and only look
+   objects up; the indexed pack files are written by contrib/omnibor-pack,
+   which moves the incoming pack file out of the way under the same lock
+   as the appenders take.  */
+
+#include "config.h"
+#include "system.h"
+#include "cpplib.h"
+#include "internal.h"
+#include "omnibor-pack.h"
+#include <dirent.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+
+#define OMNIBOR_PACK_MAGIC "OBPACK01"
+#define OMNIBOR_PACK_RECORD_MAGIC "OBPR"
+#define OMNIBOR_PACK_INDEX_MAGIC "OBPKIDX1"
+#define OMNIBOR_PACK_VERSION 1
+
+#define OMNIBOR_PACK_HEADER_SIZE 16
+#define OMNIBOR_PACK_RECORD_SIZE 56
+#define OMNIBOR_PACK_INDEX_ENTRY_SIZE 48
+#define OMNIBOR_PACK_FANOUT_SIZE (256 * 4)
+
+/* Offsets of the fields of a record header.  */
+#define OMNIBOR_PACK_RECORD_KIND 4
+#define OMNIBOR_PACK_RECORD_LEN 8
+#define OMNIBOR_PACK_RECORD_GITOID 16
+#define OMNIBOR_PACK_RECORD_CHECK 48
+
+/* The size of the key of an index entry: the padded gitoid and the
+   kind.  */
+#define OMNIBOR_PACK_KEY_SIZE 36
+
+static void
+omnibor_pack_put (unsigned char *p, uint64_t value, unsigned size)
+{
+  for (unsigned i = size; i-- != 0; value >>= 8)
+    p[i] = value & 0xff;
+}
+
+static uint64_t
+omnibor_pack_get (const unsigned char *p, unsigned size)
+{
+  uint64_t value = 0;
+
+  for (unsigned i = 0; i != size; i++)
+    value = (value << 8) | p[i];
+
+  return value;
+}
+
+/* Return the length of the gitoids of objects of kind KIND.  */
+
+static unsigned
+omnibor_pack_gitoid_len (enum omnibor_pack_kind kind)
+{
+  return (kind == OMNIBOR_PACK_DOCUMENT_SHA1
+	  || kind == OMNIBOR_PACK_METADATA_SHA1) ? 20 : 32;
+}
+
+/* Fill in KEY, of OMNIBOR_PACK_KEY_SIZE bytes, for the object of kind
+   KIND and gitoid GITOID.  */
+
+static void
+omnibor_pack_key (unsigned char *key, enum omnibor_pack_kind kind,
+		  const unsigned char *gitoid)
+{
+  memset (key, 0, OMNIBOR_PACK_KEY_SIZE);
+  memcpy (key, gitoid, omnibor_pack_gitoid_len (kind));
+  omnibor_pack_put (key + 32, kind, 4);
+}
+
+/* Return the checksum of the record with the header HEADER and the LEN
+   bytes of contents at DATA.  */
+
+static uint32_t
+omnibor_pack_checksum (const unsigned char *header, const unsigned char *data,
+		       size_t len)
+{
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i != OMNIBOR_PACK_RECORD_CHECK; i++)
+    h = (h ^ header[i]) * 16777619u;
+  for (size_t i = 0; i != len; i++)
+    h = (h ^ data[i]) * 16777619u;
+
+  return h;
+}
+
+/* Write the LEN bytes at DATA to FD.  Return true on success.  */
+
+static bool
+omnibor_pack_write (int fd, const unsigned char *data, size_t len)
+{
+  while (len)
+    {
+      ssize_t count = write (fd, data, len);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	return false;
+      data += count;
+      len -= count;
+    }
+
+  return true;
+}
+
+bool
+omnibor_pack_append (const char *dir, enum omnibor_pack_kind kind,
+		     const unsigned char *gitoid, const void *data,
+		     size_t len)
+{
+  if (_cpp_omnibor_cancelled ())
+    return false;
+
+  char *pack_dir = concat (dir, "/", OMNIBOR_PACK_DIR, NULL);
+  char *path = concat (pack_dir, "/", OMNIBOR_PACK_INCOMING, NULL);
+
+  /* Build the whole record first, so that it is appended with a single
+     write.  */
+  unsigned char *record = XNEWVEC (unsigned char,
+				   OMNIBOR_PACK_RECORD_SIZE + len);
+  memset (record, 0, OMNIBOR_PACK_RECORD_SIZE);
+  memcpy (record, OMNIBOR_PACK_RECORD_MAGIC, 4);
+  omnibor_pack_put (record + OMNIBOR_PACK_RECORD_KIND, kind, 4);
+  omnibor_pack_put (record + OMNIBOR_PACK_RECORD_LEN, len, 8);
+  memcpy (record + OMNIBOR_PACK_RECORD_GITOID, gitoid,
+	  omnibor_pack_gitoid_len (kind));
+  memcpy (record + OMNIBOR_PACK_RECORD_SIZE, data, len);
+  omnibor_pack_put (record + OMNIBOR_PACK_RECORD_CHECK,
+		    omnibor_pack_checksum (record,
+					   record + OMNIBOR_PACK_RECORD_SIZE,
+					   len), 4);
+
+  bool ok = false;
+  for (int attempt = 0; attempt != 8 && !ok; attempt++)
+    {
+      int fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666);
+      if (fd == -1 && errno == ENOENT && attempt == 0)
+	{
+	  _cpp_omnibor_mkdirs (pack_dir);
+	  fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666);
+	}
+      if (fd == -1)
+	break;
+
+#ifdef LOCK_EX
+      flock (fd, LOCK_EX);
+#endif
+
+      /* The compactor may have renamed the file away while we were
+	 waiting for the lock; then append to the new one instead.  */
+      struct stat st, path_st;
+      bool current = (fstat (fd, &st) == 0 && stat (path, &path_st) == 0
+		      && st.st_dev == path_st.st_dev
+		      && st.st_ino == path_st.st_ino);
+      if (current)
+	{
+	  unsigned char header[OMNIBOR_PACK_HEADER_SIZE];
+	  memset (header, 0, sizeof (header));
+	  memcpy (header, OMNIBOR_PACK_MAGIC, 8);
+	  omnibor_pack_put (header + 8, OMNIBOR_PACK_VERSION, 4);
+
+	  ok = ((st.st_size != 0
+		 || omnibor_pack_write (fd, header, sizeof (header)))
+		&& omnibor_pack_write (fd, record,
+				       OMNIBOR_PACK_RECORD_SIZE + len)
+		&& (!omnibor_fsync || fsync (fd) == 0));
+	}
+
+#ifdef LOCK_EX
+      flock (fd, LOCK_UN);
+#endif
+      close (fd);
+
+      if (current)
+	break;
+    }
+
+  if (ok)
+    _cpp_omnibor_count_store (OMNIBOR_PACK_RECORD_SIZE + len);
+
+  XDELETEVEC (record);
+  free (path);
+  free (pack_dir);
+  return ok;
+}
+
+/* Map the file PATH for reading, or read it into memory where mmap is
+   not available.  Return its contents and store their size in *SIZE, or
+   return NULL if the file cannot be read or holds fewer than MIN_SIZE
+   bytes.  The contents are released with omnibor_pack_unmap.  */
+
+static unsigned char *
+omnibor_pack_map (const char *path, size_t min_size, size_t *size)
+{
+  int fd = open (path, O_RDONLY | O_BINARY);
+  if (fd == -1)
+    return NULL;
+
+  unsigned char *map = NULL;
+  struct stat st;
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size >= min_size
+      && st.st_size > 0)
+    {
+#ifdef HAVE_SYS_MMAN_H
+      void *p = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+	map = (unsigned char *) p;
+#else
+      /* The file may still grow; only its first ST_SIZE bytes are
+	 looked at.  */
+      map = XNEWVEC (unsigned char, st.st_size);
+      size_t got = 0;
+      while (got != (size_t) st.st_size)
+	{
+	  ssize_t count = read (fd, map + got, st.st_size - got);
+	  if (count < 0 && errno == EINTR)
+	    continue;
+	  if (count <= 0)
+	    break;
+	  got += count;
+	}
+      if (got != (size_t) st.st_size)
+	{
+	  XDELETEVEC (map);
+	  map = NULL;
+	}
+#endif
+    }
+  close (fd);
+
+  if (map)
+    *size = st.st_size;
+  return map;
+}
+
+/* Release MAP, of SIZE bytes, returned by omnibor_pack_map.  */
+
+static void
+omnibor_pack_unmap (unsigned char *map, size_t size ATTRIBUTE_UNUSED)
+{
+#ifdef HAVE_SYS_MMAN_H
+  munmap (map, size);
+#else
+  XDELETEVEC (map);
+#endif
+}
+
+/* Return true if the index file PATH has an entry with key KEY.  */
+
+static bool
+omnibor_pack_find_in_index (const char *path, const unsigned char *key)
+{
+  size_t size;
+  unsigned char *map
+    = omnibor_pack_map (path,
+			OMNIBOR_PACK_HEADER_SIZE + OMNIBOR_PACK_FANOUT_SIZE,
+			&size);
+  if (map == NULL)
+    return false;
+
+  const unsigned char *fanout = map + OMNIBOR_PACK_HEADER_SIZE;
+  const unsigned char *entries = fanout + OMNIBOR_PACK_FANOUT_SIZE;
+  uint64_t count = omnibor_pack_get (map + 12, 4);
+  bool found = false;
+
+  if (memcmp (map, OMNIBOR_PACK_INDEX_MAGIC, 8) == 0
+      && omnibor_pack_get (map + 8, 4) == OMNIBOR_PACK_VERSION
+      && (size == (OMNIBOR_PACK_HEADER_SIZE + OMNIBOR_PACK_FANOUT_SIZE
+		   + count * OMNIBOR_PACK_INDEX_ENTRY_SIZE)))
+    {
+      /* The fan-out table bounds the entries whose gitoid starts with the
+	 same byte; binary search among those.  */
+      uint64_t lo = key[0] ? omnibor_pack_get (fanout + 4 * (key[0] - 1), 4)
+		   : 0;
+      uint64_t hi = omnibor_pack_get (fanout + 4 * key[0], 4);
+      if (hi > count)
+	hi = count;
+      while (lo < hi && !found)
+	{
+	  uint64_t mid = lo + (hi - lo) / 2;
+	  int cmp = memcmp (entries + mid * OMNIBOR_PACK_INDEX_ENTRY_SIZE,
+			    key, OMNIBOR_PACK_KEY_SIZE);
+	  if (cmp < 0)
+	    lo = mid + 1;
+	  else if (cmp > 0)
+	    hi = mid;
+	  else
+	    found = true;
+	}
+    }
+
+  omnibor_pack_unmap (map, size);
+  return found;
+}
+
+/* Return true if the pack file PATH, which is not indexed, holds a valid
+   record with key KEY which starts within its last TAIL bytes.  */
+
+static bool
+omnibor_pack_find_in_pack (const char *path, const unsigned char *key,
+			   size_t tail)
+{
+  size_t size;
+  unsigned char *map = omnibor_pack_map (path, OMNIBOR_PACK_HEADER_SIZE,
+					 &size);
+  if (map == NULL)
+    return false;
+
+  /* Records cannot be found from the end, so start at the first record
+     header within the tail; a false one is skipped like a damaged
+     record.  */
+  size_t pos = OMNIBOR_PACK_HEADER_SIZE;
+  if (tail < size - pos)
+    {
+      pos = size - tail;
+      while (size - pos >= OMNIBOR_PACK_RECORD_SIZE
+	     && memcmp (map + pos, OMNIBOR_PACK_RECORD_MAGIC, 4) != 0)
+	pos++;
+    }
+
+  bool found = false;
+  if (memcmp (map, OMNIBOR_PACK_MAGIC, 8) == 0)
+    while (!found && size - pos >= OMNIBOR_PACK_RECORD_SIZE)
+      {
+	const unsigned char *r = map + pos;
+	uint64_t len = omnibor_pack_get (r + OMNIBOR_PACK_RECORD_LEN, 8);
+
+	/* Skip over damaged records one byte at a time, until the next
+	   record header.  */
+	if (memcmp (r, OMNIBOR_PACK_RECORD_MAGIC, 4) != 0
+	    || len > size - pos - OMNIBOR_PACK_RECORD_SIZE
+	    || (omnibor_pack_get (r + OMNIBOR_PACK_RECORD_CHECK, 4)
+		!= omnibor_pack_checksum (r, r + OMNIBOR_PACK_RECORD_SIZE,
+					  len)))
+	  {
+	    pos++;
+	    continue;
+	  }
+
+	found = (memcmp (r + OMNIBOR_PACK_RECORD_GITOID, key, 32) == 0
+		 && memcmp (r + OMNIBOR_PACK_RECORD_KIND, key + 32, 4) == 0);
+	pos += OMNIBOR_PACK_RECORD_SIZE + len;
+      }
+
+  omnibor_pack_unmap (map, size);
+  return found;
+}
+
+bool
+omnibor_pack_find (const char *dir, enum omnibor_pack_kind kind,
+		   const unsigned char *gitoid, size_t incoming)
+{
+  unsigned char key[OMNIBOR_PACK_KEY_SIZE];
+  omnibor_pack_key (key, kind, gitoid);
+
+  char *pack_dir = concat (dir, "/", OMNIBOR_PACK_DIR, NULL);
+  bool found = false;
+  DIR *d = opendir (pack_dir);
+
+  if (d)
+    {
+      struct dirent *e;
+      while ((e = readdir (d)) != NULL)
+	{
+	  size_t len = strlen (e->d_name);
+	  if (len > 4 && strcmp (e->d_name + len - 4, ".idx") == 0)
+	    {
+	      char *path = concat (pack_dir, "/", e->d_name, NULL);
+	      found = omnibor_pack_find_in_index (path, key);
+	      free (path);
+	      if (found)
+		break;
+	    }
+	}
+      closedir (d);
+    }
+
+  if (!found && incoming != 0)
+    {
+      char *path = concat (pack_dir, "/", OMNIBOR_PACK_INCOMING, NULL);
+      found = omnibor_pack_find_in_pack (path, key, incoming);
+      free (path);
+    }
+
+  free (pack_dir);
+  return found;
+}
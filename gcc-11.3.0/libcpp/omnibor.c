@@ -0,0 +1,1193 @@
+/* Persistent cache of OmniBOR gitoids and OmniBOR object store.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING3.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include "config.h"
+#include "system.h"
+#include "cpplib.h"
+#include "internal.h"
+#include "mkdeps.h"
+#include "hashtab.h"
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if defined (HAVE_SYS_SOCKET_H) && defined (HAVE_SYS_UN_H)
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef SCM_RIGHTS
+#define OMNIBOR_SERVER_SUPPORTED 1
+#endif
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
+#include "omnibor-server.h"
+#include "omnibor-cache.h"
+
+/* The gitoids of every file hashed for OmniBOR are remembered in a cache
+   file inside the OmniBOR directory, so that other compilations of the
+   same build do not have to hash the same (typically system) headers
+   again.  A file is identified by its device, inode, size and modification
+   and change times.
+
+   The cache file starts with an omnibor_cache_header and is followed by
+   fixed-size omnibor_cache_record entries.  It is only ever appended to:
+   readers map it and never take a lock, while writers append whole
+   records with a single write under an exclusive flock.  Every record
+   carries a checksum, so a torn or otherwise damaged record is simply
+   ignored.  Records for files which changed on disk are never looked up
+   again, so duplicates and stale records are harmless.  */
+
+#define OMNIBOR_CACHE_FILE "gitoid-cache"
+#define OMNIBOR_CACHE_MAGIC "OBGITOID"
+#define OMNIBOR_CACHE_VERSION 1
+
+struct omnibor_cache_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct omnibor_cache_record
+{
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime;
+  int64_t ctime;
+  struct omnibor_gitoids gitoids;
+  uint32_t check;
+};
+
+/* The state of this file, which is the statistics, the cache below, the
+   connection to the gitoid server and the store, is shared by the main
+   thread and the thread of deps_start_omnibor, which writes the OmniBOR
+   Document files while the main thread generates code, and may still
+   record inputs such as C++ modules.  OMNIBOR_STATE_LOCK protects it.
+   It is only held while the state is looked at or changed, and not
+   while a file is hashed or written.  The worker threads which hash the
+   dependencies do not touch it: they only own the jobs they take, and
+   OMNIBOR_POOL has a lock of its own, which is taken after
+   OMNIBOR_STATE_LOCK when both are.  The OmniBOR options, such as
+   OMNIBOR_DIR, are set before any thread starts.  */
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t omnibor_state_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+omnibor_lock_state (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&omnibor_state_lock);
+#endif
+}
+
+static void
+omnibor_unlock_state (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock (&omnibor_state_lock);
+#endif
+}
+
+/* The state of the cache of this process.  */
+
+static struct
+{
+  /* True once the cache file has been looked at.  */
+  bool initialized;
+
+  /* True if the cache file has an unexpected format; it is then neither
+     read nor written.  */
+  bool disabled;
+
+  /* The path of the cache file.  */
+  char *path;
+
+  /* The contents of the cache file as it was when it was first used,
+     mapped if MAPPED and read into memory otherwise.  */
+  void *map;
+  size_t map_size;
+  bool mapped;
+
+  /* The valid records of the loaded cache file, hashed by file
+     identity.  */
+  htab_t table;
+
+  /* Records added by this process which still have to be written.  */
+  struct omnibor_cache_record *pending;
+  unsigned pending_num, pending_alloc;
+} omnibor_cache;
+
+/* Statistics of the OmniBOR work for -ftime-report.  */
+
+static struct cpp_omnibor_stats omnibor_stats;
+
+/* Return the checksum of record R, excluding the checksum itself.  */
+
+static uint32_t
+omnibor_cache_checksum (const struct omnibor_cache_record *r)
+{
+  const unsigned char *p = (const unsigned char *) r;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i != offsetof (struct omnibor_cache_record, check); i++)
+    h = (h ^ p[i]) * 16777619u;
+
+  return h;
+}
+
+static hashval_t
+omnibor_cache_hash (const void *p)
+{
+  const struct omnibor_cache_record *r
+    = (const struct omnibor_cache_record *) p;
+
+  return (hashval_t) (r->ino ^ (r->ino >> 32) ^ r->dev ^ r->size);
+}
+
+static int
+omnibor_cache_eq (const void *p, const void *q)
+{
+  const struct omnibor_cache_record *a
+    = (const struct omnibor_cache_record *) p;
+  const struct omnibor_cache_record *b
+    = (const struct omnibor_cache_record *) q;
+
+  return (a->dev == b->dev && a->ino == b->ino && a->size == b->size
+	  && a->mtime == b->mtime && a->ctime == b->ctime);
+}
+
+/* Fill in the identity of the file described by ST in record R.  */
+
+static void
+omnibor_cache_key (const struct stat *st, struct omnibor_cache_record *r)
+{
+  memset (r, 0, sizeof (*r));
+  r->dev = st->st_dev;
+  r->ino = st->st_ino;
+  r->size = st->st_size;
+  r->mtime = st->st_mtime;
+  r->ctime = st->st_ctime;
+}
+
+/* Return the SIZE bytes of the cache file open on FD, mapped where
+   mmap is available and read into memory otherwise, or NULL.  */
+
+static void *
+omnibor_cache_load (int fd, size_t size)
+{
+#ifdef HAVE_SYS_MMAN_H
+  void *map = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map != MAP_FAILED)
+    {
+      omnibor_cache.mapped = true;
+      return map;
+    }
+#endif
+
+  char *buf = XNEWVEC (char, size);
+  size_t got = 0;
+  while (got != size)
+    {
+      ssize_t count = read (fd, buf + got, size - got);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	break;
+      got += count;
+    }
+  if (got != size)
+    {
+      XDELETEVEC (buf);
+      return NULL;
+    }
+
+  omnibor_cache.mapped = false;
+  return buf;
+}
+
+/* Release MAP, of SIZE bytes, returned by omnibor_cache_load.  */
+
+static void
+omnibor_cache_unload (void *map, size_t size ATTRIBUTE_UNUSED)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (omnibor_cache.mapped)
+    {
+      munmap (map, size);
+      return;
+    }
+#endif
+  XDELETEVEC ((char *) map);
+}
+
+/* Open and load the cache file in the OmniBOR directory, if any.  Return
+   false if the cache cannot be used.  The caller holds
+   OMNIBOR_STATE_LOCK.  */
+
+static bool
+omnibor_cache_init (void)
+{
+  if (omnibor_cache.initialized)
+    return !omnibor_cache.disabled;
+
+  omnibor_cache.initialized = true;
+  omnibor_cache.disabled = true;
+
+  if (!omnibor_dir || !*omnibor_dir)
+    return false;
+
+  omnibor_cache.path = concat (omnibor_dir, "/", OMNIBOR_CACHE_FILE, NULL);
+  omnibor_cache.table = htab_create_alloc (1024, omnibor_cache_hash,
+					   omnibor_cache_eq, NULL,
+					   xcalloc, free);
+  omnibor_cache.disabled = false;
+
+  int fd = open (omnibor_cache.path, O_RDONLY | O_BINARY);
+  if (fd == -1)
+    return true;
+
+  struct stat st;
+  const size_t header_size = sizeof (struct omnibor_cache_header);
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size >= header_size)
+    {
+      void *map = omnibor_cache_load (fd, st.st_size);
+      if (map != NULL)
+	{
+	  const struct omnibor_cache_header *header
+	    = (const struct omnibor_cache_header *) map;
+
+	  if (memcmp (header->magic, OMNIBOR_CACHE_MAGIC, 8) != 0
+	      || header->version != OMNIBOR_CACHE_VERSION
+	      || header->record_size != sizeof (struct omnibor_cache_record))
+	    {
+	      omnibor_cache_unload (map, st.st_size);
+	      omnibor_cache.disabled = true;
+	    }
+	  else
+	    {
+	      omnibor_cache.map = map;
+	      omnibor_cache.map_size = st.st_size;
+
+	      /* Only look at whole records; one may still be being
+		 appended.  */
+	      size_t num = ((st.st_size - header_size)
+			    / sizeof (struct omnibor_cache_record));
+	      struct omnibor_cache_record *records
+		= (struct omnibor_cache_record *) (header + 1);
+	      for (size_t i = 0; i != num; i++)
+		if (records[i].check == omnibor_cache_checksum (&records[i]))
+		  *htab_find_slot (omnibor_cache.table, &records[i],
+				   INSERT) = &records[i];
+	    }
+	}
+    }
+  close (fd);
+
+  return !omnibor_cache.disabled;
+}
+
+/* Return true if the file described by ST was modified within the
+   resolution of the timestamps: it could then be modified again without
+   its identity changing, so its identity cannot be trusted (this is the
+   "racily clean" problem known from git's index).  */
+
+static bool
+omnibor_racily_clean (const struct stat *st)
+{
+  time_t now = time (NULL);
+  return st->st_mtime >= now - 1 || st->st_ctime >= now - 1;
+}
+
+static void omnibor_cache_insert (const struct stat *,
+				  const struct omnibor_gitoids *);
+
+/* The connection to the gitoid server of the OmniBOR directory: -2 until
+   it has been looked for, and -1 if there is none or it failed.  */
+static int omnibor_server_fd = -2;
+
+/* How long to wait for an answer of the gitoid server, in milliseconds.
+   It answers from memory, so one which takes longer is overloaded or
+   wedged, and hashing the file here is quicker.  */
+#define OMNIBOR_SERVER_TIMEOUT 200
+
+/* Connect to the gitoid server of the OmniBOR directory, if there is one
+   and that has not been tried yet.  Return true if it can be asked.  */
+
+static bool
+omnibor_server_connect (void)
+{
+  if (omnibor_server_fd != -2)
+    return omnibor_server_fd >= 0;
+
+  omnibor_server_fd = -1;
+#ifdef OMNIBOR_SERVER_SUPPORTED
+  struct sockaddr_un addr;
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen (omnibor_dir) + strlen ("/" OMNIBOR_SERVER_SOCKET)
+      >= sizeof (addr.sun_path))
+    return false;
+  strcpy (addr.sun_path, omnibor_dir);
+  strcat (addr.sun_path, "/" OMNIBOR_SERVER_SOCKET);
+
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return false;
+  fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+  if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+    {
+      close (fd);
+      return false;
+    }
+
+  /* Do not let a slow server hold up the compilation.  */
+  struct timeval timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = OMNIBOR_SERVER_TIMEOUT * 1000;
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+  omnibor_server_fd = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef OMNIBOR_SERVER_SUPPORTED
+/* Stop talking to the gitoid server.  */
+
+static void
+omnibor_server_drop (void)
+{
+  close (omnibor_server_fd);
+  omnibor_server_fd = -1;
+}
+
+/* Send a request of KIND for the regular file described by ST and open
+   on FD to the gitoid server.  Return true if the whole request was
+   sent; the server is not asked again otherwise, as the rest of the
+   request would be taken for the start of the next one.  */
+
+static bool
+omnibor_server_send (enum omnibor_server_kind kind, const struct stat *st,
+		     int fd)
+{
+  struct omnibor_server_request request;
+  memset (&request, 0, sizeof (request));
+  request.magic = OMNIBOR_SERVER_MAGIC;
+  request.kind = kind;
+  request.dev = st->st_dev;
+  request.ino = st->st_ino;
+  request.size = st->st_size;
+  request.mtime = st->st_mtime;
+  request.ctime = st->st_ctime;
+
+  struct iovec iov;
+  iov.iov_base = &request;
+  iov.iov_len = sizeof (request);
+
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  memset (&control, 0, sizeof (control));
+
+  struct msghdr msg;
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+  /* A server which went away must not kill the compilation with
+     SIGPIPE, and one which does not keep up must not hold it up.  */
+  ssize_t count;
+  do
+    count = sendmsg (omnibor_server_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+  while (count < 0 && errno == EINTR);
+
+  if (count == (ssize_t) sizeof (request))
+    return true;
+  omnibor_server_drop ();
+  return false;
+}
+#endif
+
+/* Ask the gitoid server for the OmniBOR gitoids of the regular file
+   described by ST and open on FD.  Return them, or NULL if there is no
+   server or it does not know them yet; they remain valid until the end
+   of the process.  If the server fails or is slow to answer, it is not
+   asked again.  */
+
+static const struct omnibor_gitoids *
+omnibor_server_lookup (const struct stat *st, int fd)
+{
+  if (fd < 0 || omnibor_racily_clean (st) || !omnibor_server_connect ())
+    return NULL;
+
+#ifdef OMNIBOR_SERVER_SUPPORTED
+  if (!omnibor_server_send (OMNIBOR_SERVER_LOOKUP, st, fd))
+    return NULL;
+
+  struct omnibor_server_reply reply;
+  size_t got = 0;
+  bool ok = true;
+  while (ok && got != sizeof (reply))
+    {
+      ssize_t count = read (omnibor_server_fd, (char *) &reply + got,
+			    sizeof (reply) - got);
+      if (count < 0 && errno == EINTR)
+	continue;
+      ok = count > 0;
+      if (ok)
+	got += count;
+    }
+
+  if (!ok || reply.magic != OMNIBOR_SERVER_MAGIC)
+    {
+      omnibor_server_drop ();
+      return NULL;
+    }
+
+  if (reply.status != OMNIBOR_SERVER_OK)
+    return NULL;
+
+  struct omnibor_gitoids *gitoids = XNEW (struct omnibor_gitoids);
+  memcpy (gitoids->sha1, reply.sha1, sizeof (gitoids->sha1));
+  memcpy (gitoids->sha256, reply.sha256, sizeof (gitoids->sha256));
+  omnibor_stats.server_hits++;
+  return gitoids;
+#else
+  return NULL;
+#endif
+}
+
+/* Return the OmniBOR gitoids of the file described by ST if they are in
+   the persistent cache, or if the gitoid server of the OmniBOR directory
+   knows them, or NULL.  FD is the file open for reading, or -1.  The
+   gitoids remain valid until the end of the process.  */
+
+const struct omnibor_gitoids *
+_cpp_omnibor_lookup (const struct stat *st, int fd)
+{
+  if (!S_ISREG (st->st_mode))
+    return NULL;
+
+  omnibor_lock_state ();
+  const struct omnibor_gitoids *gitoids = NULL;
+  if (omnibor_cache_init ())
+    {
+      struct omnibor_cache_record key;
+      omnibor_cache_key (st, &key);
+
+      const struct omnibor_cache_record *r
+	= ((const struct omnibor_cache_record *)
+	   htab_find (omnibor_cache.table, &key));
+      if (r == NULL)
+	{
+	  omnibor_stats.cache_misses++;
+	  gitoids = omnibor_server_lookup (st, fd);
+	  if (gitoids)
+	    omnibor_cache_insert (st, gitoids);
+	}
+      else
+	{
+	  omnibor_stats.cache_hits++;
+	  gitoids = &r->gitoids;
+	}
+    }
+  omnibor_unlock_state ();
+
+  return gitoids;
+}
+
+/* Remember the OmniBOR gitoids of the file described by ST, so that they
+   are written to the persistent cache by _cpp_omnibor_cache_flush.  The
+   caller holds OMNIBOR_STATE_LOCK.  */
+
+static void
+omnibor_cache_insert (const struct stat *st,
+		      const struct omnibor_gitoids *gitoids)
+{
+  if (!S_ISREG (st->st_mode) || !omnibor_cache_init ())
+    return;
+
+  if (omnibor_racily_clean (st))
+    return;
+
+  if (omnibor_cache.pending_num == omnibor_cache.pending_alloc)
+    {
+      omnibor_cache.pending_alloc = omnibor_cache.pending_alloc * 2 + 64;
+      omnibor_cache.pending
+	= XRESIZEVEC (struct omnibor_cache_record, omnibor_cache.pending,
+		      omnibor_cache.pending_alloc);
+    }
+
+  struct omnibor_cache_record *r
+    = &omnibor_cache.pending[omnibor_cache.pending_num++];
+  omnibor_cache_key (st, r);
+  r->gitoids = *gitoids;
+  r->check = omnibor_cache_checksum (r);
+}
+
+/* Append the records gathered by this process to the cache file.  */
+
+void
+_cpp_omnibor_cache_flush (void)
+{
+  omnibor_lock_state ();
+  int fd = -1;
+  if (omnibor_cache.pending_num && !omnibor_cache.disabled)
+    fd = open (omnibor_cache.path,
+	       O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666);
+  if (fd == -1)
+    {
+      omnibor_unlock_state ();
+      return;
+    }
+
+#ifdef LOCK_EX
+  flock (fd, LOCK_EX);
+#endif
+
+  const size_t header_size = sizeof (struct omnibor_cache_header);
+  const size_t record_size = sizeof (struct omnibor_cache_record);
+  struct stat st;
+  bool ok = fstat (fd, &st) == 0;
+
+  if (ok && st.st_size == 0)
+    {
+      struct omnibor_cache_header header;
+      memset (&header, 0, sizeof (header));
+      memcpy (header.magic, OMNIBOR_CACHE_MAGIC, 8);
+      header.version = OMNIBOR_CACHE_VERSION;
+      header.record_size = record_size;
+      ok = write (fd, &header, header_size) == (ssize_t) header_size;
+    }
+  else if (ok && (size_t) st.st_size < header_size)
+    ok = false;
+  else if (ok)
+    {
+      /* A writer may have died in the middle of a record.  Readers could
+	 have the file mapped, so pad the damaged record (its checksum
+	 will not match) rather than truncating the file.  */
+      size_t tail = (st.st_size - header_size) % record_size;
+      if (tail)
+	{
+	  char zeros[sizeof (struct omnibor_cache_record)];
+	  memset (zeros, 0, sizeof (zeros));
+	  ok = (write (fd, zeros, record_size - tail)
+		== (ssize_t) (record_size - tail));
+	}
+    }
+
+  if (ok)
+    {
+      size_t len = omnibor_cache.pending_num * record_size;
+      if (write (fd, omnibor_cache.pending, len) == (ssize_t) len)
+	omnibor_cache.pending_num = 0;
+    }
+
+#ifdef LOCK_EX
+  flock (fd, LOCK_UN);
+#endif
+  close (fd);
+  omnibor_unlock_state ();
+}
+
+/* The OmniBOR Document files and the metadata files are written to the
+   OmniBOR directory by the store below.  Every directory it opens or
+   creates stays open for the rest of the process, and files are created
+   relative to those descriptors, so that each directory is looked up
+   (and created if need be) only once.  A file is written under a
+   temporary name and renamed into place, so that neither readers nor
+   compilations writing the same file at the same time ever see a partial
+   file.  OmniBOR Document files are named after their gitoid, so one
+   which already exists is not written again.  */
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+/* A directory of the store.  */
+
+struct omnibor_store_dir
+{
+  /* Its path relative to the OmniBOR directory, "" for the latter.  */
+  char *path;
+  int fd;
+};
+
+static struct
+{
+  /* The OmniBOR directory the directories are relative to.  */
+  char *root;
+
+  /* The omnibor_store_dir entries, hashed by path.  */
+  htab_t dirs;
+
+  /* Makes the temporary names unique within the process.  */
+  unsigned tmp_counter;
+} omnibor_store;
+
+static hashval_t
+omnibor_store_dir_hash (const void *p)
+{
+  return htab_hash_string (((const struct omnibor_store_dir *) p)->path);
+}
+
+static int
+omnibor_store_dir_eq (const void *p, const void *q)
+{
+  return strcmp (((const struct omnibor_store_dir *) p)->path,
+		 (const char *) q) == 0;
+}
+
+static void
+omnibor_store_dir_del (void *p)
+{
+  struct omnibor_store_dir *d = (struct omnibor_store_dir *) p;
+
+  close (d->fd);
+  free (d->path);
+  free (d);
+}
+
+/* Create the directory PATH and any of its parents which do not exist.  */
+
+void
+_cpp_omnibor_mkdirs (const char *path)
+{
+  char *copy = xstrdup (path);
+
+  for (char *p = copy + 1; *p; p++)
+    if (*p == '/')
+      {
+	*p = '\0';
+	mkdir (copy, S_IRWXU);
+	*p = '/';
+      }
+  mkdir (copy, S_IRWXU);
+
+  free (copy);
+}
+
+/* Return a descriptor of the directory PATH, relative to the OmniBOR
+   directory ROOT, creating the directories on the way if they do not
+   exist.  Return -1 on failure.  The caller holds OMNIBOR_STATE_LOCK.  */
+
+static int
+omnibor_store_dir (const char *root, const char *path)
+{
+  if (omnibor_store.root && strcmp (omnibor_store.root, root) != 0)
+    {
+      htab_delete (omnibor_store.dirs);
+      free (omnibor_store.root);
+      omnibor_store.root = NULL;
+    }
+  if (!omnibor_store.root)
+    {
+      omnibor_store.root = xstrdup (root);
+      omnibor_store.dirs = htab_create_alloc (16, omnibor_store_dir_hash,
+					      omnibor_store_dir_eq,
+					      omnibor_store_dir_del,
+					      xcalloc, free);
+    }
+
+  hashval_t hash = htab_hash_string (path);
+  struct omnibor_store_dir *d
+    = (struct omnibor_store_dir *) htab_find_with_hash (omnibor_store.dirs,
+							 path, hash);
+  if (d)
+    return d->fd;
+
+  int fd;
+  if (!*path)
+    {
+      fd = open (root, O_RDONLY | O_DIRECTORY);
+      if (fd == -1 && errno == ENOENT)
+	{
+	  _cpp_omnibor_mkdirs (root);
+	  fd = open (root, O_RDONLY | O_DIRECTORY);
+	}
+    }
+  else
+    {
+      const char *slash = strrchr (path, '/');
+      const char *name = slash ? slash + 1 : path;
+      char *parent = xstrndup (path, name - path - (slash != NULL));
+      int parent_fd = omnibor_store_dir (root, parent);
+      free (parent);
+      if (parent_fd == -1)
+	return -1;
+
+      fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY);
+      if (fd == -1 && errno == ENOENT)
+	{
+	  mkdirat (parent_fd, name, S_IRWXU);
+	  fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY);
+	}
+    }
+  if (fd == -1)
+    return -1;
+
+  d = XNEW (struct omnibor_store_dir);
+  d->path = xstrdup (path);
+  d->fd = fd;
+  *htab_find_slot_with_hash (omnibor_store.dirs, path, hash, INSERT) = d;
+
+  return fd;
+}
+
+/* Whether the OmniBOR files are not to be written any more, because the
+   process is exiting while the thread of deps_start_omnibor may still be
+   writing them.  */
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t omnibor_cancel_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static bool omnibor_cancelled;
+
+/* Make the OmniBOR files which are being written fail, and leave nothing
+   behind, and prevent any more from being written.  */
+
+void
+_cpp_omnibor_cancel (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&omnibor_cancel_lock);
+#endif
+  omnibor_cancelled = true;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock (&omnibor_cancel_lock);
+#endif
+}
+
+/* Return true once _cpp_omnibor_cancel has been called.  */
+
+bool
+_cpp_omnibor_cancelled (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&omnibor_cancel_lock);
+#endif
+  bool cancelled = omnibor_cancelled;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock (&omnibor_cancel_lock);
+#endif
+  return cancelled;
+}
+
+/* Write the LEN bytes at DATA to the file NAME in the directory DIR of
+   the OmniBOR directory ROOT, creating the directories as needed.  If
+   CONTENT_ADDRESSED, NAME identifies the contents, and an existing file
+   is left alone.  With -frecord-omnibor-fsync, the file is flushed to
+   disk before it is renamed into place.  Once the writing has been
+   cancelled, the file is not renamed into place but removed.  Return
+   true on success.  */
+
+bool
+_cpp_omnibor_store_write (const char *root, const char *dir,
+			  const char *name, const void *data, size_t len,
+			  bool content_addressed)
+{
+  if (_cpp_omnibor_cancelled ())
+    return false;
+
+  omnibor_lock_state ();
+  int dfd = omnibor_store_dir (root, dir);
+  unsigned counter = omnibor_store.tmp_counter++;
+  omnibor_unlock_state ();
+  if (dfd == -1)
+    return false;
+
+  struct stat st;
+  if (content_addressed && fstatat (dfd, name, &st, 0) == 0)
+    return true;
+
+  size_t size = len;
+
+  char *tmp = xasprintf (".%s.%ld.%u.tmp", name, (long) getpid (), counter);
+  int fd = openat (dfd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+  bool ok = fd != -1;
+
+  const char *p = (const char *) data;
+  while (ok && len)
+    {
+      ssize_t count = write (fd, p, len);
+      if (count < 0 && errno == EINTR)
+	continue;
+      if (count <= 0)
+	ok = false;
+      else
+	{
+	  p += count;
+	  len -= count;
+	}
+    }
+
+  if (ok && omnibor_fsync && fsync (fd) != 0)
+    ok = false;
+  if (fd != -1 && close (fd) != 0)
+    ok = false;
+  if (ok && _cpp_omnibor_cancelled ())
+    ok = false;
+  if (ok && renameat (dfd, tmp, dfd, name) != 0)
+    ok = false;
+  if (!ok && fd != -1)
+    unlinkat (dfd, tmp, 0);
+  if (ok && omnibor_fsync)
+    fsync (dfd);
+  if (ok)
+    _cpp_omnibor_count_store (size);
+
+  free (tmp);
+  return ok;
+}
+
+/* Account for a file or pack record of SIZE bytes written to the OmniBOR
+   directory.  */
+
+void
+_cpp_omnibor_count_store (size_t size)
+{
+  omnibor_lock_state ();
+  omnibor_stats.store_writes++;
+  omnibor_stats.store_bytes += size;
+  omnibor_unlock_state ();
+}
+
+/* Dependencies are hashed while the front end is still parsing, by a
+   small pool of worker threads, so that hashing them is not on the
+   critical path of the compilation.  The main thread hands every file it
+   reads over to the pool, together with a private copy of its contents
+   (the lexer modifies the buffer it lexes in place), and only waits for
+   the workers when the OmniBOR Document files are written.  Without
+   worker threads, the contents are hashed as soon as they are read.
+
+   The copies queued for the workers are limited to OMNIBOR_MAX_QUEUED
+   bytes in total, so that the memory used does not grow with the size
+   of the dependencies; beyond that, the main thread hashes the contents
+   itself rather than copying them.  */
+
+#define OMNIBOR_MAX_QUEUED (16 * 1024 * 1024)
+
+/* The OmniBOR gitoids of a dependency, which may still have to be
+   calculated.  */
+
+struct omnibor_hash_job
+{
+  struct omnibor_gitoids gitoids;
+
+  /* The contents to hash, owned by the job, and their length.  */
+  unsigned char *data;
+  size_t len;
+
+  /* The identity of the file holding exactly those contents, if
+     CACHEABLE.  The gitoids are then added to the persistent cache.  */
+  bool cacheable;
+  struct stat st;
+
+  struct omnibor_hash_job *next;
+};
+
+#ifdef HAVE_PTHREAD_H
+/* The state of the worker threads.  */
+
+static struct
+{
+  /* True once the threads have been started, and true once they have
+     been told to exit.  */
+  bool started, stopped;
+
+  pthread_t *threads;
+  unsigned num_threads;
+
+  /* LOCK protects everything below.  */
+  pthread_mutex_t lock;
+
+  /* Signalled when a job is queued or the threads have to exit.  */
+  pthread_cond_t work;
+
+  /* Signalled when the last queued job has been done.  */
+  pthread_cond_t idle;
+
+  /* The jobs which have not been started yet, in order.  */
+  struct omnibor_hash_job *queue_head, *queue_tail;
+
+  /* The jobs which have been done.  */
+  struct omnibor_hash_job *done;
+
+  /* The number of jobs which have been queued but not done yet, and
+     the size of their contents.  */
+  unsigned pending;
+  size_t queued_bytes;
+} omnibor_pool;
+
+static void *
+omnibor_worker (void *)
+{
+  pthread_mutex_lock (&omnibor_pool.lock);
+  for (;;)
+    {
+      while (!omnibor_pool.queue_head && !omnibor_pool.stopped)
+	pthread_cond_wait (&omnibor_pool.work, &omnibor_pool.lock);
+
+      struct omnibor_hash_job *job = omnibor_pool.queue_head;
+      if (!job)
+	break;
+      omnibor_pool.queue_head = job->next;
+      if (!omnibor_pool.queue_head)
+	omnibor_pool.queue_tail = NULL;
+      pthread_mutex_unlock (&omnibor_pool.lock);
+
+      deps_omnibor_hash_buffer (job->data, job->len, &job->gitoids);
+
+      XDELETEVEC (job->data);
+      job->data = NULL;
+
+      pthread_mutex_lock (&omnibor_pool.lock);
+      job->next = omnibor_pool.done;
+      omnibor_pool.done = job;
+      omnibor_pool.queued_bytes -= job->len;
+      if (--omnibor_pool.pending == 0)
+	pthread_cond_signal (&omnibor_pool.idle);
+    }
+  pthread_mutex_unlock (&omnibor_pool.lock);
+
+  return NULL;
+}
+
+/* Start the worker threads if that has not been tried yet.  Return true
+   if jobs can be handed over to them.  The caller holds
+   OMNIBOR_STATE_LOCK.  */
+
+static bool
+omnibor_pool_start (void)
+{
+  if (omnibor_pool.started || omnibor_pool.stopped || omnibor_jobs <= 0)
+    return omnibor_pool.started && !omnibor_pool.stopped;
+
+  /* Let libiberty pick its SHA1 and SHA256 implementations before any
+     thread uses them.  */
+  struct omnibor_gitoids dummy;
+  deps_omnibor_hash_buffer ((const unsigned char *) "", 0, &dummy);
+
+  pthread_mutex_init (&omnibor_pool.lock, NULL);
+  pthread_cond_init (&omnibor_pool.work, NULL);
+  pthread_cond_init (&omnibor_pool.idle, NULL);
+
+  omnibor_pool.threads = XNEWVEC (pthread_t, omnibor_jobs);
+  for (int i = 0; i != omnibor_jobs; i++)
+    if (pthread_create (&omnibor_pool.threads[omnibor_pool.num_threads],
+			NULL, omnibor_worker, NULL) == 0)
+      omnibor_pool.num_threads++;
+
+  omnibor_pool.started = omnibor_pool.num_threads != 0;
+  omnibor_pool.stopped = !omnibor_pool.started;
+  return omnibor_pool.started;
+}
+
+/* Return true if a copy of LEN more bytes can be queued for the worker
+   threads, and account for it.  */
+
+static bool
+omnibor_pool_reserve (size_t len)
+{
+  bool ok;
+
+  pthread_mutex_lock (&omnibor_pool.lock);
+  ok = len <= OMNIBOR_MAX_QUEUED - omnibor_pool.queued_bytes;
+  if (ok)
+    omnibor_pool.queued_bytes += len;
+  pthread_mutex_unlock (&omnibor_pool.lock);
+
+  return ok;
+}
+#endif
+
+/* Start calculating the OmniBOR gitoids of the LEN bytes at BUF.  ST, if
+   non-NULL, describes the file holding exactly those contents, and the
+   gitoids are then added to the persistent cache.  The returned gitoids
+   may be filled in by a worker thread: they are only valid once
+   _cpp_omnibor_finish_hashing has been called, and they remain valid
+   until the end of the process.  */
+
+const struct omnibor_gitoids *
+_cpp_omnibor_hash (const struct stat *st, const unsigned char *buf,
+		   size_t len)
+{
+  struct omnibor_hash_job *job = XNEW (struct omnibor_hash_job);
+
+  job->cacheable = st != NULL;
+  if (st)
+    job->st = *st;
+  job->data = NULL;
+  job->len = len;
+  job->next = NULL;
+
+  omnibor_lock_state ();
+  omnibor_stats.files_hashed++;
+  omnibor_stats.bytes_hashed += len;
+
+#ifdef HAVE_PTHREAD_H
+  if (omnibor_pool_start () && omnibor_pool_reserve (len))
+    {
+      job->data = XNEWVEC (unsigned char, len ? len : 1);
+      memcpy (job->data, buf, len);
+
+      pthread_mutex_lock (&omnibor_pool.lock);
+      if (omnibor_pool.queue_tail)
+	omnibor_pool.queue_tail->next = job;
+      else
+	omnibor_pool.queue_head = job;
+      omnibor_pool.queue_tail = job;
+      omnibor_pool.pending++;
+      pthread_cond_signal (&omnibor_pool.work);
+      pthread_mutex_unlock (&omnibor_pool.lock);
+      omnibor_unlock_state ();
+
+      return &job->gitoids;
+    }
+#endif
+  omnibor_unlock_state ();
+
+  deps_omnibor_hash_buffer (buf, len, &job->gitoids);
+  if (job->cacheable)
+    {
+      omnibor_lock_state ();
+      omnibor_cache_insert (&job->st, &job->gitoids);
+      omnibor_unlock_state ();
+    }
+
+  return &job->gitoids;
+}
+
+/* Calculate the OmniBOR gitoids of the regular file described by ST and
+   open on FD, reading it in chunks of fixed size, and add them to the
+   persistent cache.  Return NULL if the file cannot be read.  The
+   returned gitoids remain valid until the end of the process.  */
+
+const struct omnibor_gitoids *
+_cpp_omnibor_hash_fd (const struct stat *st, int fd)
+{
+  struct omnibor_gitoids *gitoids = XNEW (struct omnibor_gitoids);
+
+  if (!deps_omnibor_hash_fd (fd, st->st_size, gitoids))
+    {
+      XDELETE (gitoids);
+      return NULL;
+    }
+
+  omnibor_lock_state ();
+  omnibor_stats.files_hashed++;
+  omnibor_stats.bytes_hashed += st->st_size;
+  omnibor_cache_insert (st, gitoids);
+  omnibor_unlock_state ();
+  return gitoids;
+}
+
+/* Wait until the OmniBOR gitoids of all the dependencies handed over to
+   the worker threads have been calculated, and stop the threads; any
+   later dependency is hashed by the calling thread.  */
+
+void
+_cpp_omnibor_finish_hashing (void)
+{
+#ifdef HAVE_PTHREAD_H
+  omnibor_lock_state ();
+  if (!omnibor_pool.started || omnibor_pool.stopped)
+    {
+      omnibor_unlock_state ();
+      return;
+    }
+
+  pthread_mutex_lock (&omnibor_pool.lock);
+  while (omnibor_pool.pending)
+    pthread_cond_wait (&omnibor_pool.idle, &omnibor_pool.lock);
+  omnibor_pool.stopped = true;
+  pthread_cond_broadcast (&omnibor_pool.work);
+  pthread_mutex_unlock (&omnibor_pool.lock);
+
+  for (unsigned i = 0; i != omnibor_pool.num_threads; i++)
+    pthread_join (omnibor_pool.threads[i], NULL);
+  XDELETEVEC (omnibor_pool.threads);
+
+  /* The workers do not touch the cache, so only add to it now.  */
+  for (struct omnibor_hash_job *job = omnibor_pool.done; job;
+       job = job->next)
+    if (job->cacheable)
+      omnibor_cache_insert (&job->st, &job->gitoids);
+  omnibor_pool.done = NULL;
+  omnibor_unlock_state ();
+#endif
+}
+
+/* Report the statistics of the OmniBOR work so far in *STATS.  */
+
+void
+cpp_omnibor_get_stats (struct cpp_omnibor_stats *stats)
+{
+  omnibor_lock_state ();
+  *stats = omnibor_stats;
+  omnibor_unlock_state ();
+}
+
+/* Store the SHA1 gitoid of the file PATH in SHA1, for the driver, which
+   does not otherwise use libcpp; see omnibor-cache.h.  */
+
+bool
+omnibor_file_sha1_gitoid (const char *dir, const char *path,
+			  unsigned char *sha1)
+{
+  if (omnibor_dir == NULL)
+    set_omnibor_dir (dir);
+
+  int fd = open (path, O_RDONLY | O_BINARY);
+  if (fd == -1)
+    return false;
+
+  const struct omnibor_gitoids *gitoids = deps_omnibor_file_gitoids (fd);
+  close (fd);
+  if (gitoids == NULL)
+    return false;
+
+  memcpy (sha1, gitoids->sha1, sizeof (gitoids->sha1));
+  _cpp_omnibor_cache_flush ();
+  return true;
+}
@@ -854,8 +854,11 @@ cpp_read_state (cpp_reader *r, const char *name, FILE *f,
 
   free (data);
 
-  if (deps_restore (r->deps, f, CPP_OPTION (r, restore_pch_deps) ? name : NULL)
-      != 0)
+  if (omnibor_enabled && !r->deps)
+    r->deps = deps_init ();
+
+  if (deps_restore (r->deps, f, CPP_OPTION (r, restore_pch_deps) ? name : NULL,
+		    r) != 0)
     goto error;
 
   if (! _cpp_read_file_entries (r, f))
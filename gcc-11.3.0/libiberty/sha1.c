@@ -33,6 +33,11 @@
 # include "unlocked-io.h"
 #endif
 
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+# include <x86intrin.h>
+# include <cpuid.h>
+#endif
+
 #ifdef WORDS_BIGENDIAN
 # define SWAP(n) (n)
 #else
@@ -278,6 +283,143 @@ sha1_process_bytes (const void *buffer, size_t len, struct sha1_ctx *ctx)
 #define F3(B,C,D) ( ( B & C ) | ( D & ( B | C ) ) )
 #define F4(B,C,D) (B ^ C ^ D)
 
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+/* Whether sha1_process_block uses the x86 SHA extensions: zero if not
+   known yet, positive if it does and negative if it does not.  */
+static int sha1_hw;
+
+/* Return nonzero if the CPU supports the x86 SHA extensions.  */
+
+static int
+sha1_hw_supported (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  return (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx)
+	  && (ebx & bit_SHA) != 0
+	  && __get_cpuid (1, &eax, &ebx, &ecx, &edx)
+	  && (ecx & bit_SSE4_1) != 0);
+}
+
+/* Process LEN bytes of BUFFER, accumulating context into CTX, using the
+   x86 SHA extensions.  It is assumed that LEN % 64 == 0.  This follows
+   the sample code in Intel's "Intel SHA Extensions" white paper.  */
+
+static void __attribute__ ((__target__ ("sse4.1,sha")))
+sha1_process_block_x86 (const void *buffer, size_t len, struct sha1_ctx *ctx)
+{
+  const __m128i *words = (const __m128i *) buffer;
+  const __m128i *endp = words + len / sizeof (__m128i);
+  const __m128i shuf_mask
+    = _mm_set_epi64x (0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_set_epi32 (ctx->A, ctx->B, ctx->C, ctx->D);
+  __m128i e0 = _mm_set_epi32 (ctx->E, 0, 0, 0);
+  __m128i e1, abcd_save, e0_save;
+  __m128i msg0, msg1, msg2, msg3;
+
+  /* Four rounds using message words W, which must already have been added
+     to (or, from the second group on, combined by sha1nexte with) EA.
+     EB receives the state needed by the next group.  */
+#define R4(EA, EB, F) \
+  EB = abcd; \
+  abcd = _mm_sha1rnds4_epu32 (abcd, EA, F)
+
+  while (words < endp)
+    {
+      abcd_save = abcd;
+      e0_save = e0;
+
+      /* Rounds 0-15 load the message.  */
+      msg0 = _mm_shuffle_epi8 (_mm_loadu_si128 (words), shuf_mask);
+      e0 = _mm_add_epi32 (e0, msg0);
+      R4 (e0, e1, 0);
+
+      msg1 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 1), shuf_mask);
+      e1 = _mm_sha1nexte_epu32 (e1, msg1);
+      R4 (e1, e0, 0);
+      msg0 = _mm_sha1msg1_epu32 (msg0, msg1);
+
+      msg2 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 2), shuf_mask);
+      e0 = _mm_sha1nexte_epu32 (e0, msg2);
+      R4 (e0, e1, 0);
+      msg1 = _mm_sha1msg1_epu32 (msg1, msg2);
+      msg0 = _mm_xor_si128 (msg0, msg2);
+
+      msg3 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 3), shuf_mask);
+      e1 = _mm_sha1nexte_epu32 (e1, msg3);
+      msg0 = _mm_sha1msg2_epu32 (msg0, msg3);
+      R4 (e1, e0, 0);
+      msg2 = _mm_sha1msg1_epu32 (msg2, msg3);
+      msg1 = _mm_xor_si128 (msg1, msg3);
+
+      /* Rounds 16-67 compute the message schedule four words at a time:
+	 CUR holds the words of this group, NEXT receives the words of the
+	 next one and the other two are being prepared.  */
+#define R4S(EA, EB, F, CUR, NEXT, NEXT2, NEXT3) \
+      EA = _mm_sha1nexte_epu32 (EA, CUR); \
+      NEXT = _mm_sha1msg2_epu32 (NEXT, CUR); \
+      R4 (EA, EB, F); \
+      NEXT3 = _mm_sha1msg1_epu32 (NEXT3, CUR); \
+      NEXT2 = _mm_xor_si128 (NEXT2, CUR)
+
+      R4S (e0, e1, 0, msg0, msg1, msg2, msg3);
+      R4S (e1, e0, 1, msg1, msg2, msg3, msg0);
+      R4S (e0, e1, 1, msg2, msg3, msg0, msg1);
+      R4S (e1, e0, 1, msg3, msg0, msg1, msg2);
+      R4S (e0, e1, 1, msg0, msg1, msg2, msg3);
+      R4S (e1, e0, 1, msg1, msg2, msg3, msg0);
+      R4S (e0, e1, 2, msg2, msg3, msg0, msg1);
+      R4S (e1, e0, 2, msg3, msg0, msg1, msg2);
+      R4S (e0, e1, 2, msg0, msg1, msg2, msg3);
+      R4S (e1, e0, 2, msg1, msg2, msg3, msg0);
+      R4S (e0, e1, 2, msg2, msg3, msg0, msg1);
+      R4S (e1, e0, 3, msg3, msg0, msg1, msg2);
+      R4S (e0, e1, 3, msg0, msg1, msg2, msg3);
+
+      /* Rounds 68-79 only finish the message schedule.  */
+      e1 = _mm_sha1nexte_epu32 (e1, msg1);
+      msg2 = _mm_sha1msg2_epu32 (msg2, msg1);
+      R4 (e1, e0, 3);
+      msg3 = _mm_xor_si128 (msg3, msg1);
+
+      e0 = _mm_sha1nexte_epu32 (e0, msg2);
+      msg3 = _mm_sha1msg2_epu32 (msg3, msg2);
+      R4 (e0, e1, 3);
+
+      e1 = _mm_sha1nexte_epu32 (e1, msg3);
+      R4 (e1, e0, 3);
+
+      e0 = _mm_sha1nexte_epu32 (e0, e0_save);
+      abcd = _mm_add_epi32 (abcd, abcd_save);
+
+      words += 4;
+    }
+
+#undef R4S
+#undef R4
+
+  ctx->A = _mm_extract_epi32 (abcd, 3);
+  ctx->B = _mm_extract_epi32 (abcd, 2);
+  ctx->C = _mm_extract_epi32 (abcd, 1);
+  ctx->D = _mm_extract_epi32 (abcd, 0);
+  ctx->E = _mm_extract_epi32 (e0, 3);
+}
+#endif
+
+/* Select the implementation used by sha1_process_block.  See sha1.h.  */
+
+int
+sha1_select_hw (int enable)
+{
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+  sha1_hw = enable && sha1_hw_supported () ? 1 : -1;
+  return sha1_hw > 0;
+#else
+  (void) enable;
+  return 0;
+#endif
+}
+
 /* Process LEN bytes of BUFFER, accumulating context into CTX.
    It is assumed that LEN % 64 == 0.
    Most of this code comes from GnuPG's cipher/sha1.c.  */
@@ -301,6 +443,16 @@ sha1_process_block (const void *buffer, size_t len, struct sha1_ctx *ctx)
   ctx->total[0] += len;
   ctx->total[1] += ((len >> 31) >> 1) + (ctx->total[0] < len);
 
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+  if (sha1_hw == 0)
+    sha1_select_hw (1);
+  if (sha1_hw > 0)
+    {
+      sha1_process_block_x86 (buffer, len, ctx);
+      return;
+    }
+#endif
+
 #define rol(x, n) (((x) << (n)) | ((sha1_uint32) (x) >> (32 - (n))))
 
 #define M(I) ( tm =   x[I&0x0f] ^ x[(I-14)&0x0f] \
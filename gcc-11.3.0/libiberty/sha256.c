@@ -32,6 +32,11 @@
 #include <string.h>
 
 #include <byteswap.h>
+
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+# include <x86intrin.h>
+# include <cpuid.h>
+#endif
 #ifdef WORDS_BIGENDIAN
 # define SWAP(n) (n)
 #else
@@ -289,6 +294,135 @@ static const uint32_t sha256_round_constants[64] = {
 #define F2(A,B,C) ( ( A & B ) | ( C & ( A | B ) ) )
 #define F1(E,F,G) ( G ^ ( E & ( F ^ G ) ) )
 
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+/* Whether sha256_process_block uses the x86 SHA extensions: zero if not
+   known yet, positive if it does and negative if it does not.  */
+static int sha256_hw;
+
+/* Return nonzero if the CPU supports the x86 SHA extensions.  */
+
+static int
+sha256_hw_supported (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  return (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx)
+          && (ebx & bit_SHA) != 0
+          && __get_cpuid (1, &eax, &ebx, &ecx, &edx)
+          && (ecx & bit_SSE4_1) != 0);
+}
+
+/* Process LEN bytes of BUFFER, accumulating context into CTX, using the
+   x86 SHA extensions.  It is assumed that LEN % 64 == 0.  This follows
+   the sample code in Intel's "Intel SHA Extensions" white paper.  */
+
+static void __attribute__ ((__target__ ("sse4.1,sha")))
+sha256_process_block_x86 (const void *buffer, size_t len,
+                          struct sha256_ctx *ctx)
+{
+  const __m128i *words = (const __m128i *) buffer;
+  const __m128i *endp = words + len / sizeof (__m128i);
+  const __m128i shuf_mask
+    = _mm_set_epi64x (0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i abef, cdgh, abef_save, cdgh_save, tmp, msg;
+  __m128i msg0, msg1, msg2, msg3;
+
+  /* The instructions want the state as ABEF and CDGH.  */
+  tmp = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) &ctx->state[0]),
+                           0xb1);
+  cdgh = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) &ctx->state[4]),
+                            0x1b);
+  abef = _mm_alignr_epi8 (tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16 (cdgh, tmp, 0xf0);
+
+  /* Four rounds I .. I + 3 using message words W.  */
+#define R4(I, W) \
+  msg = _mm_add_epi32 (W, _mm_loadu_si128 \
+                          ((const __m128i *) &sha256_round_constants[I])); \
+  cdgh = _mm_sha256rnds2_epu32 (cdgh, abef, msg); \
+  abef = _mm_sha256rnds2_epu32 (abef, cdgh, _mm_shuffle_epi32 (msg, 0x0e))
+
+  /* Compute the next four message words into NEXT from the current ones
+     in CUR and the previous ones in PREV.  */
+#define MSG2(NEXT, CUR, PREV) \
+  NEXT = _mm_add_epi32 (NEXT, _mm_alignr_epi8 (CUR, PREV, 4)); \
+  NEXT = _mm_sha256msg2_epu32 (NEXT, CUR)
+
+  while (words < endp)
+    {
+      abef_save = abef;
+      cdgh_save = cdgh;
+
+      msg0 = _mm_shuffle_epi8 (_mm_loadu_si128 (words), shuf_mask);
+      R4 (0, msg0);
+
+      msg1 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 1), shuf_mask);
+      R4 (4, msg1);
+      msg0 = _mm_sha256msg1_epu32 (msg0, msg1);
+
+      msg2 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 2), shuf_mask);
+      R4 (8, msg2);
+      msg1 = _mm_sha256msg1_epu32 (msg1, msg2);
+
+      msg3 = _mm_shuffle_epi8 (_mm_loadu_si128 (words + 3), shuf_mask);
+      R4 (12, msg3);
+      MSG2 (msg0, msg3, msg2);
+      msg2 = _mm_sha256msg1_epu32 (msg2, msg3);
+
+      R4 (16, msg0); MSG2 (msg1, msg0, msg3);
+      msg3 = _mm_sha256msg1_epu32 (msg3, msg0);
+      R4 (20, msg1); MSG2 (msg2, msg1, msg0);
+      msg0 = _mm_sha256msg1_epu32 (msg0, msg1);
+      R4 (24, msg2); MSG2 (msg3, msg2, msg1);
+      msg1 = _mm_sha256msg1_epu32 (msg1, msg2);
+      R4 (28, msg3); MSG2 (msg0, msg3, msg2);
+      msg2 = _mm_sha256msg1_epu32 (msg2, msg3);
+      R4 (32, msg0); MSG2 (msg1, msg0, msg3);
+      msg3 = _mm_sha256msg1_epu32 (msg3, msg0);
+      R4 (36, msg1); MSG2 (msg2, msg1, msg0);
+      msg0 = _mm_sha256msg1_epu32 (msg0, msg1);
+      R4 (40, msg2); MSG2 (msg3, msg2, msg1);
+      msg1 = _mm_sha256msg1_epu32 (msg1, msg2);
+      R4 (44, msg3); MSG2 (msg0, msg3, msg2);
+      msg2 = _mm_sha256msg1_epu32 (msg2, msg3);
+      R4 (48, msg0); MSG2 (msg1, msg0, msg3);
+      msg3 = _mm_sha256msg1_epu32 (msg3, msg0);
+      R4 (52, msg1); MSG2 (msg2, msg1, msg0);
+      R4 (56, msg2); MSG2 (msg3, msg2, msg1);
+      R4 (60, msg3);
+
+      abef = _mm_add_epi32 (abef, abef_save);
+      cdgh = _mm_add_epi32 (cdgh, cdgh_save);
+
+      words += 4;
+    }
+
+#undef MSG2
+#undef R4
+
+  tmp = _mm_shuffle_epi32 (abef, 0x1b);
+  cdgh = _mm_shuffle_epi32 (cdgh, 0xb1);
+  _mm_storeu_si128 ((__m128i *) &ctx->state[0],
+                    _mm_blend_epi16 (tmp, cdgh, 0xf0));
+  _mm_storeu_si128 ((__m128i *) &ctx->state[4],
+                    _mm_alignr_epi8 (cdgh, tmp, 8));
+}
+#endif
+
+/* Select the implementation used by sha256_process_block.  See sha256.h.  */
+
+int
+sha256_select_hw (int enable)
+{
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+  sha256_hw = enable && sha256_hw_supported () ? 1 : -1;
+  return sha256_hw > 0;
+#else
+  (void) enable;
+  return 0;
+#endif
+}
+
 /* Process LEN bytes of BUFFER, accumulating context into CTX.
    It is assumed that LEN % 64 == 0.
    Most of this code comes from GnuPG's cipher/sha1.c.  */
@@ -316,6 +450,16 @@ sha256_process_block (const void *buffer, size_t len, struct sha256_ctx *ctx)
   ctx->total[0] += lolen;
   ctx->total[1] += (len >> 31 >> 1) + (ctx->total[0] < lolen);
 
+#ifdef HAVE_X86_SHA_HW_SUPPORT
+  if (sha256_hw == 0)
+    sha256_select_hw (1);
+  if (sha256_hw > 0)
+    {
+      sha256_process_block_x86 (buffer, len, ctx);
+      return;
+    }
+#endif
+
 #define rol(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
 #define S0(x) (rol(x,25)^rol(x,14)^(x>>3))
 #define S1(x) (rol(x,15)^rol(x,13)^(x>>10))
@@ -0,0 +1,330 @@
+/* Test program for the SHA1 and SHA256 implementations.
+   Copyright (C) 2022 Free Software Foundation, Inc.
+
+   This file is part of the libiberty library, which is part of GCC.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   In addition to the permissions in the GNU General Public License, the
+   Free Software Foundation gives you unlimited permission to link the
+   compiled version of this file into combinations with other programs,
+   and to distribute those combinations without any restriction coming
+   from the use of this file.  (The General Public License restrictions
+   do apply in other respects; for example, they cover modification of
+   the file, and distribution when not linked into a combined
+   executable.)
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/* Without arguments, check both implementations of each hash (the
+   portable one and, where available, the one using the x86 SHA
+   extensions) against the FIPS 180 test vectors and against each other.
+   With --bench, print the throughput of each implementation instead.  */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libiberty.h"
+#include "sha1.h"
+#include "sha256.h"
+#include <stdio.h>
+#include <time.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifndef EXIT_SUCCESS
+#define EXIT_SUCCESS 0
+#endif
+
+#ifndef EXIT_FAILURE
+#define EXIT_FAILURE 1
+#endif
+
+/* The largest digest size.  */
+#define MAX_DIGEST_SIZE 32
+
+/* The hashes which are tested.  */
+
+struct hash_t
+{
+  const char *name;
+  size_t digest_size;
+  int (*select_hw) (int);
+  void (*hash) (const void *, size_t, size_t, unsigned char *);
+};
+
+/* Compute the SHA1 digest of the LEN bytes at BUF into DIGEST, passing
+   them to sha1_process_bytes in pieces of at most CHUNK bytes.  */
+
+static void
+hash_sha1 (const void *buf, size_t len, size_t chunk, unsigned char *digest)
+{
+  struct sha1_ctx ctx;
+  const char *p = (const char *) buf;
+
+  sha1_init_ctx (&ctx);
+  while (len)
+    {
+      size_t n = len < chunk ? len : chunk;
+      sha1_process_bytes (p, n, &ctx);
+      p += n;
+      len -= n;
+    }
+  sha1_finish_ctx (&ctx, digest);
+}
+
+/* Likewise for SHA256.  */
+
+static void
+hash_sha256 (const void *buf, size_t len, size_t chunk, unsigned char *digest)
+{
+  struct sha256_ctx ctx;
+  const char *p = (const char *) buf;
+
+  sha256_init_ctx (&ctx);
+  while (len)
+    {
+      size_t n = len < chunk ? len : chunk;
+      sha256_process_bytes (p, n, &ctx);
+      p += n;
+      len -= n;
+    }
+  sha256_finish_ctx (&ctx, digest);
+}
+
+static const struct hash_t hashes[] =
+{
+  { "sha1", 20, sha1_select_hw, hash_sha1 },
+  { "sha256", 32, sha256_select_hw, hash_sha256 }
+};
+
+#define NUM_HASHES (sizeof (hashes) / sizeof (hashes[0]))
+
+/* Test input data: the FIPS 180 test vectors.  A message of one million
+   'a' characters is represented by a NULL message.  */
+
+struct test_data_t
+{
+  const char *msg;
+  const char *digest[NUM_HASHES];
+};
+
+static const struct test_data_t test_data[] =
+{
+  { "",
+    { "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" } },
+  { "abc",
+    { "a9993e364706816aba3e25717850c26c9cd0d89d",
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" } },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    { "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" } },
+  { NULL,
+    { "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" } }
+};
+
+#define MILLION 1000000
+
+/* Return the hexadecimal representation of the SIZE bytes of DIGEST in
+   the static buffer HEX.  */
+
+static const char *
+to_hex (const unsigned char *digest, size_t size)
+{
+  static char hex[2 * MAX_DIGEST_SIZE + 1];
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    sprintf (hex + 2 * i, "%02x", digest[i]);
+  return hex;
+}
+
+/* Fill the LEN bytes at BUF with pseudo-random data.  */
+
+static void
+fill_buffer (unsigned char *buf, size_t len)
+{
+  unsigned int seed = 12345;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = seed >> 16;
+    }
+}
+
+/* run_tests:
+    Hash the test vectors and random data with every implementation
+    Compare results
+    Return number of fails */
+
+static int
+run_tests (void)
+{
+  int fails = 0;
+  size_t h, i;
+  char *million = XNEWVEC (char, MILLION);
+  const size_t random_len = 4096 + 64;
+  unsigned char *random = XNEWVEC (unsigned char, random_len);
+
+  memset (million, 'a', MILLION);
+  fill_buffer (random, random_len);
+
+  for (h = 0; h < NUM_HASHES; h++)
+    {
+      const struct hash_t *hash = &hashes[h];
+      int hw;
+
+      for (hw = 0; hw < 2; hw++)
+	{
+	  const char *impl;
+
+	  if (hash->select_hw (hw) != hw)
+	    continue;
+	  impl = hw ? "hw" : "generic";
+
+	  /* The test vectors; the long one is also hashed in pieces.  */
+	  for (i = 0; i < sizeof (test_data) / sizeof (test_data[0]); i++)
+	    {
+	      const char *msg = test_data[i].msg ? test_data[i].msg : million;
+	      size_t len = test_data[i].msg ? strlen (msg) : MILLION;
+	      unsigned char digest[MAX_DIGEST_SIZE];
+	      size_t chunk;
+
+	      for (chunk = 1; chunk <= 1000; chunk = chunk * 10 + 3)
+		{
+		  hash->hash (msg, len, test_data[i].msg ? len + 1 : chunk,
+			      digest);
+		  if (strcmp (to_hex (digest, hash->digest_size),
+			      test_data[i].digest[h]) != 0)
+		    {
+		      printf ("FAIL: test-sha-%s-%s-%lu-%lu. "
+			      "Digests don't match.\n", hash->name, impl,
+			      (unsigned long) i, (unsigned long) chunk);
+		      fails++;
+		    }
+		  else
+		    printf ("PASS: test-sha-%s-%s-%lu-%lu.\n", hash->name,
+			    impl, (unsigned long) i, (unsigned long) chunk);
+		  if (test_data[i].msg)
+		    break;
+		}
+	    }
+
+	  /* Random data at every alignment and of every length around
+	     the block size must hash like the portable implementation.  */
+	  if (hw)
+	    {
+	      size_t offset, len;
+	      int failed = 0;
+
+	      for (offset = 0; offset < 8; offset++)
+		for (len = 0; len <= 4096; len += len < 256 ? 1 : 61)
+		  {
+		    unsigned char digest[MAX_DIGEST_SIZE];
+		    unsigned char expected[MAX_DIGEST_SIZE];
+
+		    hash->select_hw (0);
+		    hash->hash (random + offset, len, len + 1, expected);
+		    hash->select_hw (1);
+		    hash->hash (random + offset, len, len + 1, digest);
+		    if (memcmp (digest, expected, hash->digest_size) != 0)
+		      {
+			printf ("FAIL: test-sha-%s-hw-random-%lu-%lu. "
+				"Digests don't match.\n", hash->name,
+				(unsigned long) offset, (unsigned long) len);
+			failed++;
+		      }
+		  }
+	      if (!failed)
+		printf ("PASS: test-sha-%s-hw-random.\n", hash->name);
+	      else
+		fails++;
+	    }
+	}
+
+      hash->select_hw (1);
+    }
+
+  free (million);
+  free (random);
+  return fails;
+}
+
+/* Print the throughput of every implementation of every hash for
+   messages of a few sizes.  */
+
+static void
+run_benchmark (void)
+{
+  static const size_t sizes[] = { 64, 1024, 16 * 1024, 1024 * 1024 };
+  const size_t total = 256 * 1024 * 1024;
+  unsigned char *buf = XNEWVEC (unsigned char, sizes[3]);
+  size_t h, s;
+
+  fill_buffer (buf, sizes[3]);
+
+  for (h = 0; h < NUM_HASHES; h++)
+    {
+      const struct hash_t *hash = &hashes[h];
+      int hw;
+
+      for (hw = 0; hw < 2; hw++)
+	{
+	  if (hash->select_hw (hw) != hw)
+	    continue;
+
+	  for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+	    {
+	      unsigned char digest[MAX_DIGEST_SIZE];
+	      size_t n, iterations = total / sizes[s];
+	      clock_t start = clock ();
+	      double seconds;
+
+	      for (n = 0; n < iterations; n++)
+		hash->hash (buf, sizes[s], sizes[s], digest);
+	      seconds = (double) (clock () - start) / CLOCKS_PER_SEC;
+	      printf ("%-6s %-7s %8lu bytes: %8.1f MB/s\n", hash->name,
+		      hw ? "hw" : "generic", (unsigned long) sizes[s],
+		      seconds > 0 ? total / seconds / 1e6 : 0.0);
+	    }
+	}
+
+      hash->select_hw (1);
+    }
+
+  free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  int fails;
+
+  if (argc > 1 && strcmp (argv[1], "--bench") == 0)
+    {
+      run_benchmark ();
+      exit (EXIT_SUCCESS);
+    }
+
+  fails = run_tests ();
+  exit (fails ? EXIT_FAILURE : EXIT_SUCCESS);
+}